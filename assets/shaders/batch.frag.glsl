@@ -1,13 +1,25 @@
 #version 460 core
 
+// Variants, see 'BatchShader' in engine/src/engine.c:
+// none      - Untextured, vertex color only.
+// TEXTURED  - Plain texture lookup.
+// IQ_FILTER - Textured with pixel art filtering.
+// TEXT      - Textured, red channel as coverage.
+
 layout (location = 0) out vec4 FragColor;
 
 in vec2 uv;
 in vec4 color;
-in float textureIndex;
+in vec2 worldPos;
+flat in int textureIndex;
+flat in int textureLayer;
 
-uniform sampler2D textures[32];
+#ifdef TEXTURED
+// One less than the texture units, the last one holds the lightmap.
+uniform sampler2DArray textures[31];
+#endif
 
+#ifdef IQ_FILTER
 // Stolen from: https://jorenjoestar.github.io/post/pixel_art_filtering/
 // Shader from: Inigo Quilez (<3)
 vec2 uv_iq(vec2 uv, ivec2 texture_size) {
@@ -19,8 +31,20 @@ vec2 uv_iq(vec2 uv, ivec2 texture_size) {
 
     return pixel / texture_size;
 }
+#endif
 
 void main() {
-    int iTextureIndex = int(textureIndex);
-    FragColor = texture(textures[iTextureIndex], uv_iq(uv, textureSize(textures[iTextureIndex], 0))) * color;
+#if defined(TEXT)
+    // Coverage scales every channel, blending expects premultiplied alpha.
+    FragColor = texture(textures[textureIndex], vec3(uv, textureLayer)).r * color;
+#elif defined(IQ_FILTER)
+    vec2 filtered = uv_iq(uv, textureSize(textures[textureIndex], 0).xy);
+    FragColor = texture(textures[textureIndex], vec3(filtered, textureLayer)) * color;
+#elif defined(TEXTURED)
+    FragColor = texture(textures[textureIndex], vec3(uv, textureLayer)) * color;
+#else
+    FragColor = color;
+#endif
+    // Alpha is premultiplied so it's left as is.
+    FragColor.rgb *= light(worldPos);
 }
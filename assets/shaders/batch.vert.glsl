@@ -1,20 +1,66 @@
 #version 460 core
 
-layout (location = 0) in vec2 aPos;
-layout (location = 1) in vec2 aUv;
-layout (location = 2) in vec4 aColor;
-layout (location = 3) in float aTextureIndex;
+// Must match 'Instance' in engine/src/engine.c (std430).
+struct Instance {
+    vec2 pos;
+    vec2 size;
+    vec2 pivot;
+    uint uvMin;
+    uint uvMax;
+    uint rotation;
+    uint color;
+    // Slot in the low 8 bits, layer in the next 16.
+    uint texture;
+    uint depth;
+};
+
+layout (std430, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
 
 out vec2 uv;
 out vec4 color;
-out float textureIndex;
+out vec2 worldPos;
+flat out int textureIndex;
+flat out int textureLayer;
 
 uniform mat4 projection;
 uniform mat4 view;
+// Added to the depth of every instance, used by retained sprite batches.
+uniform int depthOffset;
+
+const vec2 CORNERS[4] = vec2[4](
+    vec2(-0.5, -0.5),
+    vec2( 0.5, -0.5),
+    vec2(-0.5,  0.5),
+    vec2( 0.5,  0.5)
+);
+
+// Two triangles per quad, same winding as the old index buffer.
+const int CORNER_INDICES[6] = int[6](0, 1, 2, 2, 3, 1);
 
 void main() {
-    uv = aUv;
-    color = aColor;
-    textureIndex = aTextureIndex;
-    gl_Position = vec4(aPos, 0.0, 1.0) * view * projection;
+    Instance inst = instances[gl_BaseInstance + gl_InstanceID];
+    vec2 corner = CORNERS[CORNER_INDICES[gl_VertexID]];
+
+    vec2 pos = (corner - inst.pivot) * inst.size;
+    // (cos, sin) of the rotation, computed once per quad on the CPU.
+    vec2 rot = unpackSnorm2x16(inst.rotation);
+    pos = vec2(pos.x * rot.x - pos.y * rot.y, pos.x * rot.y + pos.y * rot.x);
+    pos += inst.pos;
+    worldPos = pos;
+
+    // uvMin = Top left, uvMax = Bottom right
+    vec2 uvMin = unpackUnorm2x16(inst.uvMin);
+    vec2 uvMax = unpackUnorm2x16(inst.uvMax);
+    vec2 t = corner + 0.5;
+    uv = vec2(mix(uvMin.x, uvMax.x, t.x), mix(uvMax.y, uvMin.y, t.y));
+
+    color = unpackUnorm4x8(inst.color);
+    textureIndex = int(inst.texture & 0xffu);
+    textureLayer = int(inst.texture >> 8);
+    gl_Position = vec4(pos, 0.0, 1.0) * view * projection;
+    // Later draws are closer, RENDERER_MAX_DEPTH is defined by engine.c.
+    float depth = float(inst.depth + uint(depthOffset));
+    gl_Position.z = 1.0 - 2.0 * (depth + 1.0) / RENDERER_MAX_DEPTH;
 }
@@ -5,7 +5,10 @@ layout (location = 0) out vec4 FragColor;
 in vec2 uv;
 
 uniform sampler2D tex;
+uniform vec2 uvScale;
 
 void main() {
-    FragColor = texture(tex, uv);
+    // Keep linear filtering from reading texels outside of the drawn part.
+    vec2 max_uv = uvScale - 0.5 / vec2(textureSize(tex, 0));
+    FragColor = texture(tex, min(uv, max_uv));
 }
@@ -5,7 +5,10 @@ layout (location = 1) in vec2 aUv;
 
 out vec2 uv;
 
+// Part of the source texture that was drawn to, used for dynamic resolution.
+uniform vec2 uvScale;
+
 void main() {
-    uv = aUv;
+    uv = aUv * uvScale;
     gl_Position = vec4(aPos, 0.0, 1.0);
 }
@@ -0,0 +1,12 @@
+#version 460 core
+
+// Positions are projected on the CPU when recorded, see 'DebugCtx'.
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec4 aColor;
+
+out vec4 color;
+
+void main() {
+    color = aColor;
+    gl_Position = vec4(aPos, 0.0, 1.0);
+}
@@ -0,0 +1,18 @@
+// Inserted into both stages of the batch, particle and tilemap shaders, see
+// 'renderer_init()' in engine/src/engine.c. Only called from fragment shaders.
+
+// See 'RendererLightmap' in engine/include/engine.h.
+uniform sampler2D lightmap;
+uniform bool lightmapEnabled;
+uniform vec2 lightmapOrigin;
+// One over the world size of the lightmap.
+uniform vec2 lightmapScale;
+uniform float lightmapAmbient;
+
+float light(vec2 pos) {
+    vec2 lightUv = (pos - lightmapOrigin) * lightmapScale;
+    if (!lightmapEnabled || any(lessThan(lightUv, vec2(0.0))) || any(greaterThan(lightUv, vec2(1.0)))) {
+        return 1.0;
+    }
+    return max(texture(lightmap, lightUv).r, lightmapAmbient);
+}
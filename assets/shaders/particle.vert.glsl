@@ -0,0 +1,59 @@
+#version 460 core
+
+// Arrays of a 'ParticleSystem' copied back to back into the region starting
+// at 'particleBase': pos_x[particleCount], pos_y[particleCount] and
+// life[particleCount]. See 'renderer_draw_particles_now()' in
+// engine/src/engine.c.
+layout (std430, binding = 0) readonly buffer Particles {
+    float particles[];
+};
+
+out vec2 uv;
+out vec4 color;
+out vec2 worldPos;
+flat out int textureIndex;
+flat out int textureLayer;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform int depthOffset;
+uniform int particleBase;
+uniform int particleCount;
+// -1 when the camera inverts y.
+uniform float ySign;
+// Start and end size.
+uniform vec2 sizes;
+uniform vec4 colorStart;
+uniform vec4 colorEnd;
+// Layer within the texture page bound to slot 0.
+uniform int layer;
+
+const vec2 CORNERS[4] = vec2[4](
+    vec2(-0.5, -0.5),
+    vec2( 0.5, -0.5),
+    vec2(-0.5,  0.5),
+    vec2( 0.5,  0.5)
+);
+
+const int CORNER_INDICES[6] = int[6](0, 1, 2, 2, 3, 1);
+
+void main() {
+    int i = particleBase + gl_InstanceID;
+    vec2 center = vec2(particles[i], particles[i + particleCount] * ySign);
+    float life = particles[i + 2 * particleCount];
+    vec2 corner = CORNERS[CORNER_INDICES[gl_VertexID]];
+
+    vec2 pos = center + corner * mix(sizes.x, sizes.y, life);
+    worldPos = pos;
+    uv = vec2(corner.x + 0.5, 0.5 - corner.y);
+    color = mix(colorStart, colorEnd, life);
+    // Interpolated unpremultiplied so a fade out keeps its hue, blending
+    // expects premultiplied alpha.
+    color.rgb *= color.a;
+    textureIndex = 0;
+    textureLayer = layer;
+    gl_Position = vec4(pos, 0.0, 1.0) * view * projection;
+    // The whole system shares one depth, see 'batch.vert.glsl'.
+    float depth = float(depthOffset);
+    gl_Position.z = 1.0 - 2.0 * (depth + 1.0) / RENDERER_MAX_DEPTH;
+}
@@ -0,0 +1,42 @@
+#version 460 core
+
+layout (location = 0) out vec4 FragColor;
+
+in vec2 tilePos;
+in vec2 worldPos;
+
+// Region of every tile in the sheet in pixels, xy = top left, zw = size.
+// Tile index i uses tiles[i - 1], index 0 is empty.
+layout (std430, binding = 0) readonly buffer Tiles {
+    vec4 tiles[];
+};
+
+uniform sampler2D sheet;
+uniform usampler2D tileIndices;
+
+void main() {
+    // Taken before any fragment is discarded, and from the continuous
+    // position so they don't jump at tile edges.
+    vec2 tileDerivative = fwidth(tilePos);
+
+    ivec2 cell = ivec2(floor(tilePos));
+    uint index = texelFetch(tileIndices, cell, 0).r;
+    if (index == 0u) {
+        discard;
+    }
+    vec4 rect = tiles[index - 1u];
+
+    // Tile rows go up, sheet rows go down.
+    vec2 local = tilePos - vec2(cell);
+    vec2 pixel = rect.xy + vec2(local.x, 1.0 - local.y) * rect.zw;
+
+    // Pixel art filtering, same as 'uv_iq()' in 'batch.frag.glsl'.
+    vec2 dudv = tileDerivative * rect.zw;
+    vec2 seam = floor(pixel + 0.5);
+    pixel = seam + clamp((pixel - seam) / dudv, -0.5, 0.5);
+    // Never bleed into the neighboring regions of the sheet.
+    pixel = clamp(pixel, rect.xy + 0.5, rect.xy + rect.zw - 0.5);
+
+    FragColor = textureLod(sheet, pixel / vec2(textureSize(sheet, 0)), 0.0);
+    FragColor.rgb *= light(worldPos);
+}
@@ -0,0 +1,40 @@
+#version 460 core
+
+// One quad per chunk, see 'renderer_draw_tilemap_now()' in
+// engine/src/engine.c.
+
+// Position in tiles, continuous across the chunk.
+out vec2 tilePos;
+out vec2 worldPos;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform int depthOffset;
+// World position of the bottom left corner of tile (0, 0) and the world size
+// of a tile.
+uniform vec2 origin;
+uniform float tileSize;
+// Tiles covered by the chunk, max is exclusive.
+uniform vec2 chunkMin;
+uniform vec2 chunkMax;
+
+const vec2 CORNERS[4] = vec2[4](
+    vec2(0.0, 0.0),
+    vec2(1.0, 0.0),
+    vec2(0.0, 1.0),
+    vec2(1.0, 1.0)
+);
+
+const int CORNER_INDICES[6] = int[6](0, 1, 2, 2, 3, 1);
+
+void main() {
+    vec2 corner = CORNERS[CORNER_INDICES[gl_VertexID]];
+    tilePos = mix(chunkMin, chunkMax, corner);
+
+    vec2 pos = origin + tilePos * tileSize;
+    worldPos = pos;
+    gl_Position = vec4(pos, 0.0, 1.0) * view * projection;
+    // The whole tilemap shares one depth, see 'batch.vert.glsl'.
+    float depth = float(depthOffset);
+    gl_Position.z = 1.0 - 2.0 * (depth + 1.0) / RENDERER_MAX_DEPTH;
+}
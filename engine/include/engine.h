@@ -5,9 +5,33 @@
 #include "engine/window.h"
 #include "engine/graphics.h"
 #include "engine/font.h"
+#include "engine/particles.h"
 
 typedef struct Renderer Renderer;
 
+typedef struct RendererDesc RendererDesc;
+struct RendererDesc {
+    // Submit the batches of each renderer pass with a single multi-draw
+    // indirect call instead of one draw per batch.
+    b8 multi_draw;
+    // Quads a single batch can hold before the renderer has grown to fit
+    // the scene. Defaults to 4096 when 0.
+    u32 initial_quad_capacity;
+
+    // Draws everything between 'renderer_begin_scaled()' and
+    // 'renderer_end_scaled()' at a fraction of the window resolution and
+    // upscales it. The fraction is adjusted every frame to keep the frame
+    // time within the target.
+    struct {
+        b8 enabled;
+        // In seconds. Defaults to the refresh interval of the monitor when 0,
+        // or 1/60 if it's unknown.
+        f32 target_frame_time;
+        // Defaults to 0.5 when 0.
+        f32 min_scale;
+    } dynamic_resolution;
+};
+
 typedef struct ApplicationDesc ApplicationDesc;
 struct ApplicationDesc {
     struct {
@@ -17,6 +41,8 @@ struct ApplicationDesc {
         b8 vsync;
     } window;
 
+    RendererDesc renderer;
+
     void (*startup)(void);
     void (*update)(void);
     void (*shutdown)(void);
@@ -49,8 +75,22 @@ struct Sprite {
     GfxTexture sheet;
     WDL_Ivec2 pos;
     WDL_Ivec2 size;
+    // Part of the region with visible texels, relative to 'pos'. Only drawn
+    // if 'trimmed' so transparent texels don't cost any fill rate.
+    b8 trimmed;
+    WDL_Ivec2 trim_pos;
+    WDL_Ivec2 trim_size;
 };
 
+// Sprite covering the whole texture.
+extern Sprite sprite_from_texture(GfxTexture texture);
+// Trims the sprite to the visible texels of its region. Only textures loaded
+// through the asset manager can be trimmed.
+extern Sprite sprite_trim(Sprite sprite);
+// uvs[0] = Top left
+// uvs[1] = Bottom right
+extern void sprite_get_uvs(Sprite sprite, WDL_Vec2 uvs[2]);
+
 typedef struct Camera Camera;
 struct Camera {
     WDL_Ivec2 screen_size;
@@ -66,12 +106,253 @@ extern WDL_Vec2 screen_to_world_space(WDL_Vec2 screen, Camera cam);
 // Renderer
 //
 
+// Draws are queued and sorted in 'renderer_end()'. Layers are drawn in
+// ascending order. Within a layer quads keep their submission (painter's)
+// order, except for RENDER_LAYER_TILES which is sorted by texture since tiles
+// never overlap.
+typedef enum RenderLayer {
+    RENDER_LAYER_BACKGROUND,
+    RENDER_LAYER_TILES,
+    RENDER_LAYER_ENTITIES,
+    RENDER_LAYER_UI,
+
+    RENDER_LAYER_COUNT,
+} RenderLayer;
+
+// Input to 'renderer_draw_quads()'.
+typedef struct QuadInstance QuadInstance;
+struct QuadInstance {
+    WDL_Vec2 pos;
+    WDL_Vec2 size;
+    WDL_Vec2 pivot;
+    f32 rotation;
+    Color color;
+    // Regular 2D textures are copied into a texture page the first time
+    // they're drawn and again whenever they change, so each one takes twice its
+    // size in VRAM while it's alive. 2D array textures are bound as a page of
+    // their own without a copy and their first layer is drawn.
+    GfxTexture texture;
+    // uvs[0] = Top left
+    // uvs[1] = Bottom right
+    WDL_Vec2 uvs[2];
+};
+
 extern void renderer_begin(Renderer* rend, Camera cam);
 extern void renderer_end(Renderer* rend);
+// The layer is reset to RENDER_LAYER_ENTITIES by 'renderer_begin()'.
+extern void renderer_set_layer(Renderer* rend, RenderLayer layer);
+// Bulk submission. Prefer this over the single quad functions when drawing
+// many quads, e.g. tiles or particles.
+extern void renderer_draw_quads(Renderer* rend, const QuadInstance* quads, u32 count);
 extern void renderer_draw_quad(Renderer* rend, WDL_Vec2 pivot, WDL_Vec2 pos, WDL_Vec2 size, f32 rot, Color color);
 extern void renderer_draw_quad_textured(Renderer* rend, WDL_Vec2 pivot, WDL_Vec2 pos, WDL_Vec2 size, f32 rot, Color color, GfxTexture texture);
 extern void renderer_draw_quad_textured_uvs(Renderer* rend, WDL_Vec2 pivot, WDL_Vec2 pos, WDL_Vec2 size, f32 rot, Color color, GfxTexture texture, WDL_Vec2 uvs[2]);
 extern void renderer_draw_sprite(Renderer* rend, WDL_Vec2 pivot, WDL_Vec2 pos, WDL_Vec2 size, f32 rot, Color color, Sprite sprite);
 extern void renderer_draw_text(Renderer* rend, WDL_Str text, Font* font, WDL_Vec2 pivot, WDL_Vec2 pos, Color color);
+// Bulk submission of already laid out glyphs, the red channel of the texture
+// is used as coverage like in 'renderer_draw_text()'.
+extern void renderer_draw_glyphs(Renderer* rend, const QuadInstance* quads, u32 count);
+
+// Dynamic resolution, see 'RendererDesc.dynamic_resolution'. Passes in
+// between are drawn into an offscreen target at the current scale of the
+// window size, e.g. the world, and 'renderer_end_scaled()' upscales it onto
+// the screen. Passes after it, e.g. the UI, stay at native resolution. Both
+// only bind the screen when dynamic resolution is disabled.
+extern void renderer_begin_scaled(Renderer* rend);
+extern void renderer_end_scaled(Renderer* rend);
+// Fraction of the window resolution the scaled passes are drawn at.
+extern f32  renderer_get_resolution_scale(const Renderer* rend);
+
+// What the renderer did since the last 'renderer_begin()', complete once
+// 'renderer_end()' returns. Frame totals are also added to the profiler
+// counters.
+typedef struct RendererStats RendererStats;
+struct RendererStats {
+    // Quads recorded after culling, sprite batch contents aren't included.
+    // Quads outside of the camera are culled before any other work is done on
+    // them.
+    u32 quads;
+    u32 culled_quads;
+    u32 text_glyphs;
+    u32 sprite_batches;
+    // Particles drawn, one instanced draw per particle system.
+    u32 particles;
+    // Tilemap chunks drawn, one quad and draw call each.
+    u32 tilemap_chunks;
+    // Instance batches drawn. With multi-draw several batches share a draw
+    // call.
+    u32 batches;
+    u32 draw_calls;
+    // Why a batch was split before the end of the pass.
+    struct {
+        u32 full;
+        u32 texture_slots;
+        u32 sprite_batch;
+        u32 particles;
+        u32 tilemap;
+        // Consecutive quads needing different shader variants.
+        u32 shader;
+    } flushes;
+    // Instances, indirect commands, sprite batch updates, particles and
+    // tilemap edits written to GPU buffers.
+    u64 uploaded_bytes;
+    u32 unique_textures;
+    u32 texture_binds;
+    // Textures copied into a texture page because they were new or changed.
+    u32 texture_copies;
+};
+
+extern RendererStats renderer_get_stats(const Renderer* rend);
+// Sum over every pass of the last complete frame.
+extern RendererStats renderer_get_frame_stats(const Renderer* rend);
+// Per frame average over the last 60 complete frames.
+extern RendererStats renderer_get_average_stats(const Renderer* rend);
+
+//
+// Sprite batch
+//
+
+// Retained set of quads sharing one texture, for content that rarely changes
+// like tiles and level decoration. Only sprites changed since the last draw
+// are uploaded and the whole batch is drawn with one draw call.
+//
+// Positions are in world space with y pointing up, 'Camera.invert_y' is not
+// applied. The texture of the quads is ignored, the batch texture is used.
+//
+// Overlapping sprites are drawn in the order of their slots. Removing a sprite
+// moves the last one into its slot.
+typedef struct SpriteBatch SpriteBatch;
+
+extern SpriteBatch* sprite_batch_new(WDL_Arena* arena, GfxTexture texture, u32 capacity);
+// Returns a handle that stays valid until the sprite is removed.
+extern u32  sprite_batch_add(SpriteBatch* batch, QuadInstance quad);
+extern void sprite_batch_set(SpriteBatch* batch, u32 sprite, QuadInstance quad);
+extern void sprite_batch_remove(SpriteBatch* batch, u32 sprite);
+extern u32  sprite_batch_get_count(const SpriteBatch* batch);
+// Drawn in the current layer like any other quad.
+extern void renderer_draw_sprite_batch(Renderer* rend, SpriteBatch* batch);
+
+//
+// Particles
+//
+
+// Draws every particle of the system with a single instanced draw, in the
+// current layer. The particle arrays are copied as is into GPU memory and the
+// quads are built in 'particle.vert.glsl'. Particles are never culled and are
+// always blended.
+extern void renderer_draw_particles(Renderer* rend, ParticleSystem* particles);
+
+//
+// Tilemap
+//
+
+// Grid of tiles cut from a single sheet. The tile indices live in an integer
+// texture and every visible, non-empty chunk of TILEMAP_CHUNK_SIZE^2 tiles is
+// drawn as a single quad which looks its tiles up in 'tilemap.frag.glsl', so
+// the draw cost doesn't depend on the number of tiles. Only the tiles changed
+// since the last draw are uploaded.
+//
+// Like sprite batches, positions are in world space with y pointing up and
+// 'Camera.invert_y' is not applied.
+#define TILEMAP_CHUNK_SIZE 32
+
+typedef struct Tilemap Tilemap;
+
+typedef struct TilemapDesc TilemapDesc;
+struct TilemapDesc {
+    // In tiles.
+    WDL_Ivec2 size;
+    // World position of the bottom left corner of tile (0, 0).
+    WDL_Vec2 origin;
+    // World size of a tile, defaults to 1 when 0.
+    f32 tile_size;
+    GfxTexture sheet;
+    // Regions of the sheet, tile index i draws 'tiles[i - 1]' and index 0 is
+    // empty. The sheet of the sprites is ignored.
+    const Sprite* tiles;
+    u32 tile_count;
+};
+
+extern Tilemap* tilemap_new(WDL_Arena* arena, TilemapDesc desc);
+// Tiles outside of the map are ignored.
+extern void tilemap_set(Tilemap* tilemap, i32 x, i32 y, u16 tile);
+// Returns 0 outside of the map.
+extern u16  tilemap_get(const Tilemap* tilemap, i32 x, i32 y);
+// Drawn in the current layer like any other quad.
+extern void renderer_draw_tilemap(Renderer* rend, Tilemap* tilemap);
+
+//
+// Lightmap
+//
+
+// Single channel texture covering a grid of tiles, quads and tilemaps drawn
+// over it are multiplied by the red channel, filtered by the sampler of the
+// texture. Everything outside of the grid and particles are left unlit.
+//
+// Positions are in world space with y pointing up, so it can only be used
+// with cameras that don't set 'Camera.invert_y'.
+typedef struct RendererLightmap RendererLightmap;
+struct RendererLightmap {
+    GfxTexture texture;
+    // World position of the bottom left corner of texel (0, 0).
+    WDL_Vec2 origin;
+    // World size of a texel, defaults to 1 when 0.
+    f32 tile_size;
+    // Lowest light level, keeps unlit areas from going fully black.
+    f32 ambient;
+};
+
+// Applies to the whole pass, 'renderer_begin()' removes the lightmap. A null
+// texture removes it too.
+extern void renderer_set_lightmap(Renderer* rend, RendererLightmap lightmap);
+
+//
+// Cached layers
+//
+
+// Offscreen texture for content that rarely changes, e.g. HUD text. The
+// content is kept until the layer is marked dirty, and compositing a clean
+// layer costs a single full screen draw.
+typedef struct CachedLayer CachedLayer;
+
+extern CachedLayer* cached_layer_new(WDL_Arena* arena);
+extern void cached_layer_mark_dirty(CachedLayer* layer);
+// Returns true if the layer has to be redrawn, i.e. it's dirty or 'size'
+// changed. In that case it's cleared to transparent and every renderer pass
+// up to 'cached_layer_end()' draws into it. 'cached_layer_end()' restores the
+// framebuffer and viewport bound before.
+extern b8   cached_layer_begin(CachedLayer* layer, WDL_Ivec2 size);
+extern void cached_layer_end(CachedLayer* layer);
+extern GfxTexture cached_layer_get_texture(const CachedLayer* layer);
+// Composites the layer over the whole bound framebuffer right away, so it's
+// called outside of a renderer pass. The layer is sampled directly instead of
+// being copied into a texture page.
+extern void renderer_draw_cached_layer(Renderer* rend, const CachedLayer* layer);
+
+//
+// Render lists
+//
+
+// Records quads away from the renderer so they can be built on other threads.
+// A list is started after 'renderer_begin()' and uses its camera for culling.
+// Each list must only be used by one thread at a time and all of its memory
+// comes from 'arena', which has to stay valid until 'renderer_end()'.
+//
+// Lists are merged on the renderer's thread with 'renderer_submit_list()'.
+// Their commands are inserted at that point of the submission order, so
+// painter's order within a layer follows the order the lists are submitted
+// in. Text isn't available in lists since the layout cache is shared.
+typedef struct RenderList RenderList;
+
+extern RenderList* render_list_begin(Renderer* rend, WDL_Arena* arena);
+// The layer is initially RENDER_LAYER_ENTITIES.
+extern void render_list_set_layer(RenderList* list, RenderLayer layer);
+extern void render_list_draw_quads(RenderList* list, const QuadInstance* quads, u32 count);
+extern void render_list_draw_sprite_batch(RenderList* list, SpriteBatch* batch);
+extern void render_list_draw_particles(RenderList* list, ParticleSystem* particles);
+extern void render_list_draw_tilemap(RenderList* list, Tilemap* tilemap);
+// Moves the recorded commands over to the renderer. The list is left empty
+// and can keep recording.
+extern void renderer_submit_list(Renderer* rend, RenderList* list);
 
 #endif // ENGINE_H
@@ -0,0 +1,69 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "waddle.h"
+#include "graphics.h"
+
+// -- Animation ----------------------------------------------------------------
+
+typedef enum AnimationDirection {
+    ANIMATION_DIRECTION_FORWARD,
+    ANIMATION_DIRECTION_REVERSE,
+    ANIMATION_DIRECTION_PINGPONG,
+} AnimationDirection;
+
+// Named range of frames, e.g. an Aseprite frame tag.
+typedef struct AnimationTag AnimationTag;
+struct AnimationTag {
+    WDL_Str name;
+    u32 from;
+    u32 to;
+    AnimationDirection direction;
+};
+
+// Frames of a sprite sheet, loaded through 'asset_load_animation()'.
+typedef struct Animation Animation;
+struct Animation {
+    GfxTexture texture;
+    u32 frame_count;
+    // Two per frame, normalized.
+    // uvs[frame * 2 + 0] = Top left
+    // uvs[frame * 2 + 1] = Bottom right
+    WDL_Vec2* uvs;
+    // In seconds, always above zero.
+    f32* durations;
+    // Size of the first frame in pixels.
+    WDL_Ivec2 frame_size;
+
+    AnimationTag* tags;
+    u32 tag_count;
+};
+
+// Returns -1 if the animation has no tag called 'name'.
+extern i32 animation_find_tag(const Animation* animation, WDL_Str name);
+
+// -- Animator -----------------------------------------------------------------
+
+// Plays back any number of animation instances. Instance state is kept in
+// separate arrays so 'animator_update()' only streams through the timers
+// until a frame actually ends.
+typedef struct Animator Animator;
+
+extern Animator*  animator_new(WDL_Arena* arena, u32 capacity);
+// Plays 'tag' of the animation on repeat, -1 plays every frame forward.
+// Returns a handle that stays valid until the instance is removed.
+extern u32        animator_add(Animator* animator, const Animation* animation, i32 tag);
+extern void       animator_remove(Animator* animator, u32 instance);
+// Restarts the instance on another tag of its animation.
+extern void       animator_play(Animator* animator, u32 instance, i32 tag);
+// Multiplier on the frame durations' playback rate, 1 by default.
+extern void       animator_set_speed(Animator* animator, u32 instance, f32 speed);
+// Advances every instance by 'dt' seconds.
+extern void       animator_update(Animator* animator, f32 dt);
+extern u32        animator_get_frame(const Animator* animator, u32 instance);
+extern GfxTexture animator_get_texture(const Animator* animator, u32 instance);
+// uvs[0] = Top left
+// uvs[1] = Bottom right
+extern void       animator_get_uvs(const Animator* animator, u32 instance, WDL_Vec2 uvs[2]);
+
+#endif // ANIMATION_H
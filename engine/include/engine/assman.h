@@ -4,14 +4,24 @@
 #include "waddle.h"
 #include "graphics.h"
 #include "font.h"
+#include "animation.h"
 
 extern void assman_init(void);
 extern void assman_terminate(void);
 
 extern GfxTexture asset_load_texture(WDL_Str name, WDL_Str filepath, GfxTextureSampler sampler);
 extern Font*      asset_load_font(WDL_Str name, WDL_Str filepath);
+// Loads an Aseprite sprite sheet exported as JSON along with the image it
+// references. UVs and durations of every frame are computed once here.
+extern Animation* asset_load_animation(WDL_Str name, WDL_Str filepath, GfxTextureSampler sampler);
 
 extern GfxTexture asset_get_texture(WDL_Str name);
+// Tight bounds of the texels with non-zero alpha within the region at 'pos'
+// of 'size' of a texture loaded through the asset manager, relative to 'pos'.
+// Returns false if the texture is opaque or unknown, in which case the bounds
+// are the whole region. The size is zero if the region is fully transparent.
+extern b8         asset_texture_trim(GfxTexture texture, WDL_Ivec2 pos, WDL_Ivec2 size, WDL_Ivec2* trim_pos, WDL_Ivec2* trim_size);
 extern Font*      asset_get_font(WDL_Str name);
+extern Animation* asset_get_animation(WDL_Str name);
 
 #endif // ASSMAN_H
@@ -0,0 +1,36 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "waddle.h"
+
+// Screenshots and continuous capture of the back buffer. Frames are copied
+// through a 'GfxReadback' ring so the main loop never waits on the GPU, and
+// are encoded and written on a background thread. When capture falls behind
+// frames are dropped instead of stalling the game.
+
+typedef enum CaptureFormat {
+    CAPTURE_FORMAT_PNG,
+    // Headerless RGBA8 rows, top row first.
+    CAPTURE_FORMAT_RAW,
+} CaptureFormat;
+
+extern void capture_init(void);
+// Waits for every frame already copied, including copies still on the GPU, to
+// be written.
+extern void capture_terminate(void);
+// Copies the back buffer if a capture is requested and hands finished copies
+// to the background thread. Called by the engine after the frame is drawn and
+// before the buffers are swapped.
+extern void capture_update(WDL_Ivec2 screen_size);
+
+// Writes the next frame to 'filepath'.
+extern void capture_screenshot(WDL_Str filepath, CaptureFormat format);
+// Writes every frame to '<directory>/frame_<n>.<ext>' until stopped, the
+// directory is created if needed.
+extern void capture_start(WDL_Str directory, CaptureFormat format);
+extern void capture_stop(void);
+extern b8   capture_is_recording(void);
+// Frames skipped since 'capture_start()' because every readback slot was busy.
+extern u32  capture_get_dropped_frames(void);
+
+#endif // CAPTURE_H
@@ -30,6 +30,10 @@ extern void        font_destroy(Font* font);
 extern void        font_set_size(Font* font, u32 size);
 extern Glyph       font_get_glyph(Font* font, u32 codepoint);
 extern GfxTexture  font_get_atlas(const Font* font);
+extern u32         font_get_size(const Font* font);
+// Changes whenever glyphs move within the atlas of the current size,
+// invalidating previously returned glyph UVs.
+extern u32         font_get_atlas_generation(const Font* font);
 extern FontMetrics font_get_metrics(const Font* font);
 extern f32         font_get_kerning(const Font* font, u32 left_codepoint, u32 right_codepoint);
 extern WDL_Vec2    font_measure_string(Font* font, WDL_Str str);
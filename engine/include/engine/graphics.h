@@ -23,6 +23,10 @@ extern Color color_rgb_hex(u32 hex);
 extern Color color_hsl(f32 hue, f32 saturation, f32 lightness);
 extern Color color_hsv(f32 hue, f32 saturation, f32 value);
 
+// Packs the color as 8-bit unsigned normalized RGBA with red in the lowest
+// byte, matching GLSL's 'unpackUnorm4x8()'.
+extern u32 color_pack_rgba8(Color color);
+
 #define color_arg(color) (color).r, (color).g, (color).b, (color).a
 
 #define COLOR_WHITE ((Color) {1.0f, 1.0f, 1.0f, 1.0f})
@@ -43,13 +47,23 @@ typedef enum GfxBufferUsage {
     GFX_BUFFER_USAGE_STATIC,
     GFX_BUFFER_USAGE_DYNAMIC,
     GFX_BUFFER_USAGE_STREAM,
+    // Persistently mapped storage split into 'region_count' regions of 'size'
+    // bytes each. Every region is guarded by a fence so the CPU never writes
+    // into memory the GPU is still reading from. Written through
+    // 'gfx_buffer_stream_begin()' instead of 'gfx_buffer_subdata()'.
+    GFX_BUFFER_USAGE_STREAM_RING,
 } GfxBufferUsage;
 
+#define GFX_BUFFER_MAX_STREAM_REGIONS 64
+
 typedef struct GfxBufferDesc GfxBufferDesc;
 struct GfxBufferDesc {
     const void* data;
     u64 size;
     GfxBufferUsage usage;
+    // Only used by GFX_BUFFER_USAGE_STREAM_RING, at most
+    // GFX_BUFFER_MAX_STREAM_REGIONS.
+    u32 region_count;
 };
 
 #define GFX_BUFFER_NULL ((GfxBuffer) { NULL })
@@ -57,7 +71,24 @@ struct GfxBufferDesc {
 extern GfxBuffer gfx_buffer_new(GfxBufferDesc desc);
 extern void      gfx_buffer_resize(GfxBuffer buffer, GfxBufferDesc desc);
 extern void      gfx_buffer_subdata(GfxBuffer buffer, const void* data, u32 size, u32 offset);
+extern void      gfx_buffer_destroy(GfxBuffer buffer);
 extern b8        gfx_buffer_is_null(GfxBuffer buffer);
+// Binds the buffer to a 'layout (std430, binding = N)' shader storage block.
+extern void      gfx_buffer_bind_storage(GfxBuffer buffer, u32 binding);
+
+// Waits for the next region of a stream ring buffer to be released by the GPU
+// and returns a pointer to it. 'offset' receives the byte offset of the region
+// within the buffer.
+extern void* gfx_buffer_stream_begin(GfxBuffer buffer, u64* offset);
+// Returns true if 'gfx_buffer_stream_begin()' wouldn't have to wait on the GPU.
+extern b8    gfx_buffer_stream_ready(GfxBuffer buffer);
+// Moves on to the next region while keeping the current one open, so a single
+// draw can read from several consecutive regions. Fewer than 'region_count'
+// regions can be open at once.
+extern void* gfx_buffer_stream_next(GfxBuffer buffer, u64* offset);
+// Fences every region opened since the last 'gfx_buffer_stream_begin()'. Must
+// be called after the draw calls reading from them have been issued.
+extern void  gfx_buffer_stream_end(GfxBuffer buffer);
 
 // -- Vertex array -------------------------------------------------------------
 
@@ -66,10 +97,28 @@ struct GfxVertexArray {
     void* handle;
 };
 
+typedef enum GfxVertexAttribType {
+    GFX_VERTEX_ATTRIB_TYPE_F32,
+    GFX_VERTEX_ATTRIB_TYPE_F16,
+
+    GFX_VERTEX_ATTRIB_TYPE_U8,
+    GFX_VERTEX_ATTRIB_TYPE_I8,
+    GFX_VERTEX_ATTRIB_TYPE_U16,
+    GFX_VERTEX_ATTRIB_TYPE_I16,
+    GFX_VERTEX_ATTRIB_TYPE_U32,
+    GFX_VERTEX_ATTRIB_TYPE_I32,
+} GfxVertexAttribType;
+
 typedef struct GfxVertexAttrib GfxVertexAttrib;
 struct GfxVertexAttrib {
     u32 count;
     u64 offset;
+    // Defaults to GFX_VERTEX_ATTRIB_TYPE_F32.
+    GfxVertexAttribType type;
+    // Only used by integer types. Normalized values are read as floats in
+    // [0, 1] ([-1, 1] if signed), otherwise they're read as integers and need
+    // an 'int' or 'uint' input in the shader.
+    b8 normalized;
 };
 
 typedef struct GfxVertexLayout GfxVertexLayout;
@@ -81,6 +130,8 @@ struct GfxVertexLayout {
 
 typedef struct GfxVertexArrayDesc GfxVertexArrayDesc;
 struct GfxVertexArrayDesc {
+    // May be NULL if the layout has no attributes, e.g. when the vertex shader
+    // pulls its data from a storage buffer.
     GfxBuffer vertex_buffer;
     GfxVertexLayout layout;
     GfxBuffer index_buffer;
@@ -105,9 +156,34 @@ extern void      gfx_shader_use(GfxShader shader);
 extern b8        gfx_shader_is_null(GfxShader shader);
 extern void      gfx_shader_uniform_i32(GfxShader shader, WDL_Str name, i32 value);
 extern void      gfx_shader_uniform_i32_arr(GfxShader shader, WDL_Str name, const i32* arr, u32 count);
+extern void      gfx_shader_uniform_f32(GfxShader shader, WDL_Str name, f32 value);
+extern void      gfx_shader_uniform_v2(GfxShader shader, WDL_Str name, WDL_Vec2 value);
+extern void      gfx_shader_uniform_color(GfxShader shader, WDL_Str name, Color value);
 extern void      gfx_shader_uniform_m4(GfxShader shader, WDL_Str name, WDL_Mat4 value);
 extern void      gfx_shader_uniform_m4_arr(GfxShader shader, WDL_Str name, const WDL_Mat4* arr, u32 count);
 
+// Same as 'gfx_shader_new()' but '#define's every name in 'defines' followed
+// by 'prelude' in both stages, right after the '#version' line.
+extern GfxShader gfx_shader_new_defines(WDL_Str vertex_source, WDL_Str fragment_source, WDL_Str prelude, const char* const* defines, u32 define_count);
+
+#define GFX_SHADER_MAX_FEATURES 4
+
+// Compile-time variants of one shader. Bit i of a feature mask defines
+// 'features[i]'. 'prelude' is shared by every variant. Variants are compiled
+// on first use and cached by mask, so the sources have to stay valid as long
+// as new masks are requested.
+typedef struct GfxShaderPermutations GfxShaderPermutations;
+struct GfxShaderPermutations {
+    WDL_Str vertex_source;
+    WDL_Str fragment_source;
+    WDL_Str prelude;
+    const char* features[GFX_SHADER_MAX_FEATURES];
+    u32 feature_count;
+    GfxShader variants[1 << GFX_SHADER_MAX_FEATURES];
+};
+
+extern GfxShader gfx_shader_permutation(GfxShaderPermutations* permutations, u32 feature_mask);
+
 // -- Texture ------------------------------------------------------------------
 
 typedef struct GfxTexture GfxTexture;
@@ -132,6 +208,13 @@ typedef enum GfxTextureFormat {
     GFX_TEXTURE_FORMAT_RG_F32,
     GFX_TEXTURE_FORMAT_RGB_F32,
     GFX_TEXTURE_FORMAT_RGBA_F32,
+
+    // Unnormalized integers, read through a 'usampler2D' in the shader.
+    // Integer textures can't be filtered so they're always sampled nearest.
+    GFX_TEXTURE_FORMAT_R_U16_INT,
+
+    // Only usable as a depth attachment.
+    GFX_TEXTURE_FORMAT_DEPTH_F32,
 } GfxTextureFormat;
 
 typedef enum GfxTextureSampler {
@@ -146,6 +229,12 @@ struct GfxTextureDesc {
     GfxTextureFormat format;
     GfxTextureSampler sampler;
     u8 alignment;
+    // 0 creates a regular 2D texture, anything else a 2D array texture with
+    // that many layers. A texture can't change between the two once created.
+    u32 layers;
+    // Every texel has full alpha. Lets the renderer draw the texture without
+    // blending. Formats without an alpha channel are always opaque.
+    b8 opaque;
 };
 
 typedef struct GfxTextureSubDataDesc GfxTextureSubDataDesc;
@@ -157,14 +246,45 @@ struct GfxTextureSubDataDesc {
     u8 alignment;
 };
 
+typedef struct GfxTextureCopyDesc GfxTextureCopyDesc;
+struct GfxTextureCopyDesc {
+    GfxTexture src;
+    u32 src_layer;
+    GfxTexture dst;
+    u32 dst_layer;
+    // Defaults to 1. The whole size of 'src' is copied.
+    u32 layer_count;
+};
+
 #define GFX_TEXTURE_NULL ((GfxTexture) { NULL })
 
+// Called by 'gfx_texture_destroy()' before the texture is deleted, e.g. so
+// copies of it can be dropped.
+typedef void (*GfxTextureDestroyCallback)(GfxTexture texture, void* user_data);
+
 extern GfxTexture gfx_texture_new(GfxTextureDesc desc);
 extern void       gfx_texture_bind(GfxTexture texture, u32 slot);
 extern void       gfx_texture_resize(GfxTexture texture, GfxTextureDesc desc);
 extern void       gfx_texture_subdata(GfxTexture texture, GfxTextureSubDataDesc desc);
+// GPU side copy, both textures need compatible formats.
+extern void       gfx_texture_copy(GfxTextureCopyDesc desc);
+extern void       gfx_texture_destroy(GfxTexture texture);
 extern WDL_Ivec2  gfx_texture_get_size(GfxTexture texture);
+// Small, unique, non-zero id assigned at creation. A NULL texture has id 0.
+extern u32        gfx_texture_get_id(GfxTexture texture);
+// Incremented every time the content of the texture changes through
+// 'gfx_texture_resize()', 'gfx_texture_subdata()' or by drawing into a
+// framebuffer it's attached to, in which case it's incremented once the
+// framebuffer is unbound.
+extern u32        gfx_texture_get_version(GfxTexture texture);
+extern GfxTextureFormat  gfx_texture_get_format(GfxTexture texture);
+extern GfxTextureSampler gfx_texture_get_sampler(GfxTexture texture);
+// 0 for a regular 2D texture.
+extern u32        gfx_texture_get_layers(GfxTexture texture);
+extern b8         gfx_texture_is_opaque(GfxTexture texture);
 extern b8         gfx_texture_is_null(GfxTexture texture);
+// Only one callback can be set, setting it again replaces it. NULL removes it.
+extern void       gfx_texture_set_destroy_callback(GfxTextureDestroyCallback callback, void* user_data);
 
 // -- Framebuffer --------------------------------------------------------------
 
@@ -173,16 +293,90 @@ struct GfxFramebuffer {
     void* handle;
 };
 
+#define GFX_FRAMEBUFFER_NULL ((GfxFramebuffer) { NULL })
+#define GFX_FRAMEBUFFER_MAX_COLOR_ATTACHMENTS 8
+
 extern GfxFramebuffer gfx_framebuffer_new(void);
 extern void           gfx_framebuffer_attach(GfxFramebuffer framebuffer, GfxTexture texture, u32 slot);
+// Texture needs to be of format GFX_TEXTURE_FORMAT_DEPTH_F32.
+extern void           gfx_framebuffer_attach_depth(GfxFramebuffer framebuffer, GfxTexture texture);
 extern void           gfx_framebuffer_bind(GfxFramebuffer framebuffer);
 extern void           gfx_framebuffer_unbind(void);
+// GFX_FRAMEBUFFER_NULL while the default framebuffer is bound.
+extern GfxFramebuffer gfx_framebuffer_get_bound(void);
+extern b8             gfx_framebuffer_is_null(GfxFramebuffer framebuffer);
+
+// -- Readback -----------------------------------------------------------------
+
+// Ring of persistently mapped pixel pack buffers framebuffers are copied into
+// without stalling the pipeline. Copies are issued with
+// 'gfx_framebuffer_read_async()' and picked up a few frames later with
+// 'gfx_readback_poll()' once their fence has signaled.
+typedef struct GfxReadback GfxReadback;
+struct GfxReadback {
+    void* handle;
+};
+
+// Finished copy, RGBA8 rows with the bottom row first. The pixels can be read
+// from any thread until the slot is released.
+typedef struct GfxReadbackPixels GfxReadbackPixels;
+struct GfxReadbackPixels {
+    u32 slot;
+    WDL_Ivec2 size;
+    const u8* data;
+};
+
+#define GFX_READBACK_NULL ((GfxReadback) { NULL })
+
+extern GfxReadback gfx_readback_new(u32 slot_count);
+extern void        gfx_readback_destroy(GfxReadback readback);
+extern b8          gfx_readback_is_null(GfxReadback readback);
+// Queues a copy of the first color attachment of 'framebuffer' within 'size',
+// or of the back buffer if the framebuffer is NULL. Returns the slot it's
+// copied into, or -1 without copying if no slot is released yet.
+extern i32         gfx_framebuffer_read_async(GfxFramebuffer framebuffer, WDL_Ivec2 size, GfxReadback readback);
+// Hands out the oldest copy if the GPU has finished it, never waits. Copies
+// finish in the order they were issued.
+extern b8          gfx_readback_poll(GfxReadback readback, GfxReadbackPixels* pixels);
+// Same as 'gfx_readback_poll()' but waits for the GPU to finish the oldest
+// copy. Returns false only if no copy is pending.
+extern b8          gfx_readback_wait(GfxReadback readback, GfxReadbackPixels* pixels);
+// Makes a slot handed out by 'gfx_readback_poll()' available for new copies.
+extern void        gfx_readback_release(GfxReadback readback, u32 slot);
 
 // -- Drawing ------------------------------------------------------------------
 
 extern void gfx_clear(Color color);
+// Clears the depth buffer to the far plane.
+extern void gfx_clear_depth(void);
+// Blending is enabled by default with premultiplied alpha.
+extern void gfx_blend(b8 enable);
+// Depth testing is disabled by default. Fragments pass if they're closer than
+// the stored depth.
+extern void gfx_depth_test(b8 enable, b8 write);
 extern void gfx_draw(GfxVertexArray vertex_array, u32 vertex_count, u32 first_vertex);
 extern void gfx_draw_indexed(GfxVertexArray vertex_array, u32 index_count, u32 first_index);
+// Draws 'vertex_count / 2' one pixel wide lines, every pair of vertices being
+// the end points of a line.
+extern void gfx_draw_lines(GfxVertexArray vertex_array, u32 vertex_count, u32 first_vertex);
+// Draws 'instance_count' instances of 'vertex_count' non-indexed vertices.
+// 'first_instance' is exposed to the shader as 'gl_BaseInstance'.
+extern void gfx_draw_instanced(GfxVertexArray vertex_array, u32 vertex_count, u32 instance_count, u32 first_instance);
+
+// Layout mandated by 'glMultiDrawArraysIndirect()'.
+typedef struct GfxDrawIndirectCommand GfxDrawIndirectCommand;
+struct GfxDrawIndirectCommand {
+    u32 vertex_count;
+    u32 instance_count;
+    u32 first_vertex;
+    u32 first_instance;
+};
+
+// Issues 'draw_count' instanced draws stored in 'indirect_buffer' starting at
+// byte 'offset' with a single call. 'gl_DrawID' is the index of the draw.
+extern void gfx_draw_instanced_indirect(GfxVertexArray vertex_array, GfxBuffer indirect_buffer, u64 offset, u32 draw_count);
 extern void gfx_viewport(WDL_Ivec2 size);
+// Size last passed to 'gfx_viewport()'.
+extern WDL_Ivec2 gfx_get_viewport(void);
 
 #endif // GRAPHICS_H
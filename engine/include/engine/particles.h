@@ -0,0 +1,76 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include "waddle.h"
+#include "graphics.h"
+
+// Look and motion shared by every particle of a system. Color and size are
+// interpolated over each particle's life on the GPU, so the CPU only
+// simulates positions.
+typedef struct ParticleSystemDesc ParticleSystemDesc;
+struct ParticleSystemDesc {
+    u32 capacity;
+    // Optional, particles are untextured squares when NULL.
+    GfxTexture texture;
+    // Not premultiplied, that's done after interpolating.
+    Color color_start;
+    Color color_end;
+    f32 size_start;
+    f32 size_end;
+    // Acceleration applied to every particle in units per second squared.
+    WDL_Vec2 gravity;
+    // Fraction of the velocity lost per second.
+    f32 drag;
+};
+
+typedef struct ParticleEmitDesc ParticleEmitDesc;
+struct ParticleEmitDesc {
+    u32 count;
+    WDL_Vec2 pos;
+    // Particles spawn uniformly within this distance of 'pos'.
+    f32 radius;
+    // Direction of the velocity in radians and the total angle around it
+    // directions are picked from.
+    f32 angle;
+    f32 spread;
+    f32 speed_min;
+    f32 speed_max;
+    // In seconds, must be above zero.
+    f32 lifetime_min;
+    f32 lifetime_max;
+};
+
+// Particles are stored as separate arrays so 'particle_system_update()' can
+// advance four of them at a time. Dead particles are compacted away at the
+// end of every update, so the first 'count' entries of every array are
+// alive. The arrays are read only outside of this module, the renderer copies
+// 'pos_x', 'pos_y' and 'life' straight into GPU memory.
+typedef struct ParticleSystem ParticleSystem;
+struct ParticleSystem {
+    ParticleSystemDesc desc;
+    // Rounded up to a multiple of four so the last group never reads past
+    // the end of the arrays.
+    u32 capacity;
+    u32 count;
+
+    f32* pos_x;
+    f32* pos_y;
+    f32* vel_x;
+    f32* vel_y;
+    // Fraction of the lifetime passed, the particle dies when it reaches 1.
+    f32* life;
+    // 1 / lifetime
+    f32* life_rate;
+
+    u32 rng;
+};
+
+extern ParticleSystem* particle_system_new(WDL_Arena* arena, ParticleSystemDesc desc);
+// Spawns up to 'desc.count' particles, fewer if the system is full. Returns
+// the number spawned.
+extern u32  particle_emit(ParticleSystem* ps, ParticleEmitDesc desc);
+// Advances every particle by 'dt' seconds and removes the dead ones.
+extern void particle_system_update(ParticleSystem* ps, f32 dt);
+extern void particle_system_clear(ParticleSystem* ps);
+
+#endif // PARTICLES_H
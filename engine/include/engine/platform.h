@@ -0,0 +1,36 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include "waddle.h"
+
+// Threads, locks and file system operations the engine needs beyond what
+// waddle provides. Objects are pushed onto the given arena and have to be
+// destroyed before it's cleared.
+
+typedef struct PlatformThread PlatformThread;
+typedef struct PlatformMutex PlatformMutex;
+typedef struct PlatformCond PlatformCond;
+
+typedef void (*PlatformThreadFunc)(void* user_data);
+
+// Returns NULL if the thread couldn't be started.
+extern PlatformThread* platform_thread_create(WDL_Arena* arena, PlatformThreadFunc func, void* user_data);
+extern void            platform_thread_join(PlatformThread* thread);
+
+extern PlatformMutex* platform_mutex_create(WDL_Arena* arena);
+extern void           platform_mutex_destroy(PlatformMutex* mutex);
+extern void           platform_mutex_lock(PlatformMutex* mutex);
+extern void           platform_mutex_unlock(PlatformMutex* mutex);
+
+extern PlatformCond* platform_cond_create(WDL_Arena* arena);
+extern void          platform_cond_destroy(PlatformCond* cond);
+// 'mutex' has to be locked, it's unlocked while waiting and locked again
+// before returning. Can wake up spuriously.
+extern void          platform_cond_wait(PlatformCond* cond, PlatformMutex* mutex);
+extern void          platform_cond_signal(PlatformCond* cond);
+
+// Returns true if the directory exists afterwards. Parent directories aren't
+// created.
+extern b8 platform_make_directory(WDL_Str path);
+
+#endif // PLATFORM_H
@@ -13,4 +13,9 @@ extern void profiler_dump_frame(void);
 extern void prof_begin(WDL_Str name);
 extern void prof_end(void);
 
+// Adds to a named counter. Counters are summed over the frame and listed after
+// the timings in 'profiler_dump_frame()'. Does nothing if the profiler isn't
+// initialized.
+extern void prof_counter(WDL_Str name, u64 value);
+
 #endif // PROFILER_H
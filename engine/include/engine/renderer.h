@@ -21,6 +21,10 @@ struct RenderPassDesc {
     // the swapchain.
     GfxTexture targets[8];
     u8 target_count;
+    // Optional, GFX_TEXTURE_FORMAT_DEPTH_F32. Lets the renderer reject hidden
+    // fragments of translucent quads behind opaque ones. The swapchain always
+    // has a depth buffer.
+    GfxTexture depth_target;
 
     GfxTexture inputs[8];
     u8 input_count;
@@ -84,11 +88,24 @@ extern void draw_quad_atlas(BatchRenderer* br, Quad quad, WDL_Vec2 uvs[2], Camer
 
 // -- Debug --------------------------------------------------------------------
 
-typedef struct DebugDrawCmd DebugDrawCmd;
-struct DebugDrawCmd {
-    DebugDrawCmd* next;
-    Quad quad;
-    Camera cam;
+// Vertices are stored already projected, in chunks of separate position and
+// color arrays allocated from the context arena.
+#define DEBUG_CHUNK_VERTEX_COUNT 2048
+
+typedef struct DebugVertexChunk DebugVertexChunk;
+struct DebugVertexChunk {
+    DebugVertexChunk* next;
+    u32 count;
+    f32 x[DEBUG_CHUNK_VERTEX_COUNT];
+    f32 y[DEBUG_CHUNK_VERTEX_COUNT];
+    u32 color[DEBUG_CHUNK_VERTEX_COUNT];
+};
+
+typedef struct DebugVertexList DebugVertexList;
+struct DebugVertexList {
+    DebugVertexChunk* first;
+    DebugVertexChunk* last;
+    u32 count;
 };
 
 typedef struct DebugCtx DebugCtx;
@@ -96,15 +113,31 @@ struct DebugCtx {
     WDL_Arena* arena;
 
     DebugCtx* _next;
-    DebugDrawCmd* _first_cmd;
-    DebugDrawCmd* _last_cmd;
+    // Two vertices per line.
+    DebugVertexList _lines;
+    // Six vertices per filled quad.
+    DebugVertexList _triangles;
+
+    // Matrices of the last camera drawn with so they're only rebuilt when the
+    // camera changes.
+    b8 _has_camera;
+    Camera _camera;
+    WDL_Mat4 _proj;
+    WDL_Mat4 _view;
 };
 
+// Draws everything recorded into a debug context, one draw call for the
+// filled quads and one for the lines unless 'max_vertex_count' is exceeded.
+typedef struct DebugRenderer DebugRenderer;
+
+extern DebugRenderer* debug_renderer_new(WDL_Arena* arena, u32 max_vertex_count);
+
 extern void debug_ctx_push(DebugCtx* ctx);
 extern void debug_ctx_pop(void);
-extern void debug_ctx_execute(const DebugCtx* ctx, BatchRenderer* br);
+extern void debug_ctx_execute(const DebugCtx* ctx, DebugRenderer* dr);
 extern void debug_ctx_reset(DebugCtx* ctx);
 
+// Debug quads are drawn untextured.
 extern void debug_draw_quad(Quad quad, Camera cam);
 extern void debug_draw_quad_outline(Quad quad, Camera cam);
 
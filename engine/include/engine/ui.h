@@ -0,0 +1,61 @@
+#ifndef UI_H
+#define UI_H
+
+#include "waddle.h"
+#include "engine.h"
+#include "font.h"
+
+// Immediate mode UI in window pixels with the origin in the top left corner.
+// Widgets are declared every frame between 'ui_begin()' and 'ui_end()' and
+// placed top to bottom within their panel.
+//
+// Panels and lists are keyed by their ID string, labels, buttons and list
+// items by their position within the panel or list they're in. Text is only
+// data: text layout and the content height of panels and lists are kept per
+// key between frames, and only widgets whose text, font size or font atlas
+// changed are laid out again.
+//
+// Geometry is clipped against its panel and list on the CPU and drawn by
+// 'ui_end()' panel by panel, backgrounds before text, so a panel costs at most
+// one batch split no matter how many widgets it holds.
+typedef struct UI UI;
+
+typedef struct UIStyle UIStyle;
+struct UIStyle {
+    u32 font_size;
+    f32 padding;
+    f32 spacing;
+    Color text;
+    Color panel;
+    Color list;
+    Color button;
+    Color button_hot;
+    Color button_active;
+    Color item_selected;
+};
+
+extern UI*      ui_new(WDL_Arena* arena, Font* font);
+// Changes apply to widgets declared afterwards.
+extern UIStyle* ui_style(UI* ui);
+extern void     ui_begin(UI* ui, WDL_Ivec2 screen_size);
+// Draws everything declared since 'ui_begin()' in the UI layer of its own
+// renderer pass.
+extern void     ui_end(UI* ui, Renderer* rend);
+
+// Panels can't be nested. A height of 0 fits the content of the previous
+// frame.
+extern void ui_panel_begin(UI* ui, WDL_Str id, WDL_Vec2 pos, WDL_Vec2 size);
+extern void ui_panel_end(UI* ui);
+
+extern void ui_label(UI* ui, WDL_Str text);
+// Returns true when clicked.
+extern b8   ui_button(UI* ui, WDL_Str label);
+
+// Region of 'height' pixels spanning the panel width, scrolled down by
+// '*scroll' which is clamped to the content height of the previous frame.
+extern void ui_list_begin(UI* ui, WDL_Str id, f32 height, f32* scroll);
+extern void ui_list_end(UI* ui);
+// Returns true when clicked.
+extern b8   ui_list_item(UI* ui, WDL_Str text, b8 selected);
+
+#endif // UI_H
@@ -5,4 +5,16 @@
 
 extern WDL_Str read_file(WDL_Arena* arena, WDL_Str filename);
 
+// 'index' refers to whatever is being sorted.
+typedef struct SortItem SortItem;
+struct SortItem {
+    u64 key;
+    u32 index;
+};
+
+// Stable LSD radix sort, one byte per pass. Passes where every key shares the
+// same byte are skipped. 'temp' has to hold 'count' items as well. Returns
+// whichever of the two buffers holds the result.
+extern SortItem* radix_sort(SortItem* items, SortItem* temp, u32 count);
+
 #endif // UTILS_H
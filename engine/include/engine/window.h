@@ -24,6 +24,9 @@ extern b8        window_is_open(const Window* window);
 extern void      window_swap_buffers(Window* window);
 extern void      window_make_current(Window* window);
 extern WDL_Ivec2 window_get_size(const Window* window);
+// Refresh rate in Hz of the monitor the window is on, the primary monitor
+// when windowed. 0 if unknown.
+extern u32       window_get_refresh_rate(const Window* window);
 extern void*     window_get_user_data(const Window* window);
 
 typedef enum Key {
@@ -0,0 +1,186 @@
+#include "engine/animation.h"
+#include "waddle.h"
+
+#include <string.h>
+
+// -- Animation ----------------------------------------------------------------
+
+i32 animation_find_tag(const Animation* animation, WDL_Str name) {
+    for (u32 i = 0; i < animation->tag_count; i++) {
+        WDL_Str tag = animation->tags[i].name;
+        if (tag.len == name.len && memcmp(tag.data, name.data, name.len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// -- Animator -----------------------------------------------------------------
+
+#define ANIMATOR_MAX_DT 0.25f
+
+struct Animator {
+    u32 capacity;
+    u32 count;
+
+    // Per slot, the first 'count' slots are alive.
+    const Animation** animations;
+    f32* time_left;
+    f32* speeds;
+    u32* frames;
+    u32* first_frames;
+    u32* last_frames;
+    // +1 or -1, flipped at the ends of pingpong tags.
+    i32* steps;
+    b8* pingpong;
+
+    // Instance handle -> slot and back.
+    u32* slot_of_instance;
+    u32* instance_of_slot;
+    // Free instance handles.
+    u32* free_instances;
+    u32 free_count;
+    u32 next_instance;
+};
+
+Animator* animator_new(WDL_Arena* arena, u32 capacity) {
+    Animator* animator = wdl_arena_push(arena, sizeof(Animator));
+    *animator = (Animator) {
+        .capacity = capacity,
+        .animations = wdl_arena_push_no_zero(arena, capacity * sizeof(const Animation*)),
+        .time_left = wdl_arena_push_no_zero(arena, capacity * sizeof(f32)),
+        .speeds = wdl_arena_push_no_zero(arena, capacity * sizeof(f32)),
+        .frames = wdl_arena_push_no_zero(arena, capacity * sizeof(u32)),
+        .first_frames = wdl_arena_push_no_zero(arena, capacity * sizeof(u32)),
+        .last_frames = wdl_arena_push_no_zero(arena, capacity * sizeof(u32)),
+        .steps = wdl_arena_push_no_zero(arena, capacity * sizeof(i32)),
+        .pingpong = wdl_arena_push_no_zero(arena, capacity * sizeof(b8)),
+        .slot_of_instance = wdl_arena_push_no_zero(arena, capacity * sizeof(u32)),
+        .instance_of_slot = wdl_arena_push_no_zero(arena, capacity * sizeof(u32)),
+        .free_instances = wdl_arena_push_no_zero(arena, capacity * sizeof(u32)),
+    };
+    return animator;
+}
+
+static void animator_start(Animator* animator, u32 slot, i32 tag) {
+    const Animation* animation = animator->animations[slot];
+    u32 first = 0;
+    u32 last = animation->frame_count - 1;
+    AnimationDirection direction = ANIMATION_DIRECTION_FORWARD;
+    if (tag >= 0) {
+        wdl_assert((u32) tag < animation->tag_count, "Animation tag out of range.");
+        first = animation->tags[tag].from;
+        last = animation->tags[tag].to;
+        direction = animation->tags[tag].direction;
+    }
+
+    u32 frame = direction == ANIMATION_DIRECTION_REVERSE ? last : first;
+    animator->first_frames[slot] = first;
+    animator->last_frames[slot] = last;
+    animator->steps[slot] = direction == ANIMATION_DIRECTION_REVERSE ? -1 : 1;
+    animator->pingpong[slot] = direction == ANIMATION_DIRECTION_PINGPONG;
+    animator->frames[slot] = frame;
+    animator->time_left[slot] = animation->durations[frame];
+}
+
+u32 animator_add(Animator* animator, const Animation* animation, i32 tag) {
+    wdl_assert(animator->count < animator->capacity, "Animator is full.");
+    wdl_assert(animation->frame_count > 0, "Animation has no frames.");
+
+    u32 instance;
+    if (animator->free_count > 0) {
+        instance = animator->free_instances[--animator->free_count];
+    } else {
+        instance = animator->next_instance++;
+    }
+
+    u32 slot = animator->count++;
+    animator->slot_of_instance[instance] = slot;
+    animator->instance_of_slot[slot] = instance;
+    animator->animations[slot] = animation;
+    animator->speeds[slot] = 1.0f;
+    animator_start(animator, slot, tag);
+    return instance;
+}
+
+void animator_remove(Animator* animator, u32 instance) {
+    u32 slot = animator->slot_of_instance[instance];
+    u32 last = --animator->count;
+    if (slot != last) {
+        animator->animations[slot] = animator->animations[last];
+        animator->time_left[slot] = animator->time_left[last];
+        animator->speeds[slot] = animator->speeds[last];
+        animator->frames[slot] = animator->frames[last];
+        animator->first_frames[slot] = animator->first_frames[last];
+        animator->last_frames[slot] = animator->last_frames[last];
+        animator->steps[slot] = animator->steps[last];
+        animator->pingpong[slot] = animator->pingpong[last];
+
+        u32 moved = animator->instance_of_slot[last];
+        animator->slot_of_instance[moved] = slot;
+        animator->instance_of_slot[slot] = moved;
+    }
+    animator->free_instances[animator->free_count++] = instance;
+}
+
+void animator_play(Animator* animator, u32 instance, i32 tag) {
+    animator_start(animator, animator->slot_of_instance[instance], tag);
+}
+
+void animator_set_speed(Animator* animator, u32 instance, f32 speed) {
+    animator->speeds[animator->slot_of_instance[instance]] = speed > 0.0f ? speed : 0.0f;
+}
+
+void animator_update(Animator* animator, f32 dt) {
+    // A hitch, e.g. the first frame or a debugger break, would otherwise step
+    // through many loops of every animation.
+    dt = wdl_clamp(dt, 0.0f, ANIMATOR_MAX_DT);
+
+    u32 count = animator->count;
+    f32* time_left = animator->time_left;
+    const f32* speeds = animator->speeds;
+    for (u32 i = 0; i < count; i++) {
+        time_left[i] -= dt * speeds[i];
+    }
+
+    // Frames last several updates, so few instances get this far.
+    for (u32 i = 0; i < count; i++) {
+        if (time_left[i] > 0.0f) {
+            continue;
+        }
+
+        const f32* durations = animator->animations[i]->durations;
+        u32 first = animator->first_frames[i];
+        u32 last = animator->last_frames[i];
+        i32 frame = animator->frames[i];
+        while (time_left[i] <= 0.0f) {
+            i32 next = frame + animator->steps[i];
+            if (next < (i32) first || next > (i32) last) {
+                if (animator->pingpong[i] && first != last) {
+                    animator->steps[i] = -animator->steps[i];
+                    next = frame + animator->steps[i];
+                } else {
+                    next = animator->steps[i] > 0 ? first : last;
+                }
+            }
+            frame = next;
+            time_left[i] += durations[frame];
+        }
+        animator->frames[i] = frame;
+    }
+}
+
+u32 animator_get_frame(const Animator* animator, u32 instance) {
+    return animator->frames[animator->slot_of_instance[instance]];
+}
+
+GfxTexture animator_get_texture(const Animator* animator, u32 instance) {
+    return animator->animations[animator->slot_of_instance[instance]]->texture;
+}
+
+void animator_get_uvs(const Animator* animator, u32 instance, WDL_Vec2 uvs[2]) {
+    u32 slot = animator->slot_of_instance[instance];
+    const WDL_Vec2* frame_uvs = &animator->animations[slot]->uvs[animator->frames[slot] * 2];
+    uvs[0] = frame_uvs[0];
+    uvs[1] = frame_uvs[1];
+}
@@ -1,4 +1,6 @@
 #include "engine/assman.h"
+#include "engine/animation.h"
+#include "engine/utils.h"
 #include "engine/graphics.h"
 #include "engine/font.h"
 #include "waddle.h"
@@ -10,6 +12,7 @@
 typedef enum AssetType {
     ASSET_TYPE_TEXTURE,
     ASSET_TYPE_FONT,
+    ASSET_TYPE_ANIMATION,
 } AssetType;
 
 static const char* asset_type_to_cstr(AssetType type) {
@@ -18,6 +21,8 @@ static const char* asset_type_to_cstr(AssetType type) {
             return "texture";
         case ASSET_TYPE_FONT:
             return "font";
+        case ASSET_TYPE_ANIMATION:
+            return "animation";
         default:
             return "Unknown";
     }
@@ -29,9 +34,17 @@ struct Asset {
     union {
         GfxTexture texture;
         Font* font;
+        Animation* animation;
     };
 };
 
+// Alpha channel of a translucent texture, kept for trimming.
+typedef struct TextureAlpha TextureAlpha;
+struct TextureAlpha {
+    WDL_Ivec2 size;
+    u8* alpha;
+};
+
 typedef struct AssetManager AssetManager;
 struct AssetManager {
     b8 inited;
@@ -39,6 +52,9 @@ struct AssetManager {
     // Key: WDL_Str
     // Value: Asset
     WDL_HashMap* asset_map;
+    // Key: u32, texture id
+    // Value: TextureAlpha
+    WDL_HashMap* alpha_map;
 };
 
 static AssetManager assman = {0};
@@ -52,6 +68,7 @@ void assman_init(void) {
         .inited = true,
         .arena = arena,
         .asset_map = wdl_hm_new(wdl_hm_desc_str(arena, 512, Asset)),
+        .alpha_map = wdl_hm_new(wdl_hm_desc_generic(arena, 64, u32, TextureAlpha)),
     };
 }
 
@@ -64,11 +81,14 @@ void assman_terminate(void) {
         // assman.loaders[asset->type].unload(asset->data);
         switch (asset->type) {
             case ASSET_TYPE_TEXTURE:
-                wdl_debug("Maybe implemented texture unloading.");
+                gfx_texture_destroy(asset->texture);
                 break;
             case ASSET_TYPE_FONT:
                 font_destroy(asset->font);
                 break;
+            case ASSET_TYPE_ANIMATION:
+                gfx_texture_destroy(asset->animation->texture);
+                break;
         }
         iter = wdl_hm_iter_next(iter);
     }
@@ -76,9 +96,7 @@ void assman_terminate(void) {
     wdl_arena_destroy(assman.arena);
 }
 
-GfxTexture asset_load_texture(WDL_Str name, WDL_Str filepath, GfxTextureSampler sampler) {
-    wdl_assert(assman.inited, "Asset manager not initialized.");
-
+static GfxTexture texture_load(WDL_Str filepath, GfxTextureSampler sampler) {
     WDL_Scratch scratch = wdl_scratch_begin(NULL, 0);
     const char* cstr = wdl_str_to_cstr(scratch.arena, filepath);
     WDL_Ivec2 size;
@@ -86,17 +104,52 @@ GfxTexture asset_load_texture(WDL_Str name, WDL_Str filepath, GfxTextureSampler
     u8* data = stbi_load(cstr, &size.x, &size.y, &channels, 0);
     if (data == NULL) {
         wdl_error("Texture %.*s not found!", filepath.len, filepath.data);
+        wdl_scratch_end(scratch);
         return GFX_TEXTURE_NULL;
     }
+    // Textures without any translucent texels can be drawn without blending.
+    b8 opaque = true;
+    if (channels == 4) {
+        for (i32 i = 0; i < size.x * size.y; i++) {
+            if (data[i * 4 + 3] != 255) {
+                opaque = false;
+                break;
+            }
+        }
+    }
+
     GfxTexture texture = gfx_texture_new((GfxTextureDesc) {
             .data = data,
             .format = channels,
             .size = size,
             .sampler = sampler,
+            .opaque = opaque,
         });
+    if (!opaque) {
+        TextureAlpha alpha = {
+            .size = size,
+            .alpha = wdl_arena_push_no_zero(assman.arena, size.x * size.y),
+        };
+        for (i32 i = 0; i < size.x * size.y; i++) {
+            alpha.alpha[i] = data[i * 4 + 3];
+        }
+        u32 id = gfx_texture_get_id(texture);
+        wdl_hm_insert(assman.alpha_map, id, alpha);
+    }
     stbi_image_free(data);
     wdl_scratch_end(scratch);
 
+    return texture;
+}
+
+GfxTexture asset_load_texture(WDL_Str name, WDL_Str filepath, GfxTextureSampler sampler) {
+    wdl_assert(assman.inited, "Asset manager not initialized.");
+
+    GfxTexture texture = texture_load(filepath, sampler);
+    if (gfx_texture_is_null(texture)) {
+        return GFX_TEXTURE_NULL;
+    }
+
     Asset asset = {
         .type = ASSET_TYPE_TEXTURE,
         .texture = texture,
@@ -127,6 +180,349 @@ Font* asset_load_font(WDL_Str name, WDL_Str filepath) {
     return font;
 }
 
+// -- Aseprite JSON --
+
+// Just enough JSON to read the sprite sheet data exported by Aseprite. Parsing
+// stops at the first error and strings are returned as slices of the input
+// with escapes left in place.
+typedef struct JsonParser JsonParser;
+struct JsonParser {
+    WDL_Str src;
+    u64 pos;
+    b8 error;
+};
+
+static void json_skip_whitespace(JsonParser* p) {
+    while (p->pos < p->src.len) {
+        u8 c = p->src.data[p->pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            break;
+        }
+        p->pos++;
+    }
+}
+
+static b8 json_accept(JsonParser* p, u8 c) {
+    json_skip_whitespace(p);
+    if (p->error || p->pos >= p->src.len || p->src.data[p->pos] != c) {
+        return false;
+    }
+    p->pos++;
+    return true;
+}
+
+static void json_expect(JsonParser* p, u8 c) {
+    if (!json_accept(p, c)) {
+        p->error = true;
+    }
+}
+
+static WDL_Str json_string(JsonParser* p) {
+    json_expect(p, '"');
+    u64 start = p->pos;
+    while (!p->error && p->pos < p->src.len && p->src.data[p->pos] != '"') {
+        p->pos += p->src.data[p->pos] == '\\' ? 2 : 1;
+    }
+    if (p->error || p->pos >= p->src.len) {
+        p->error = true;
+        return (WDL_Str) {0};
+    }
+    WDL_Str str = wdl_str(p->src.data + start, p->pos - start);
+    p->pos++;
+    return str;
+}
+
+static f64 json_number(JsonParser* p) {
+    json_skip_whitespace(p);
+    f64 sign = 1.0;
+    if (p->pos < p->src.len && p->src.data[p->pos] == '-') {
+        sign = -1.0;
+        p->pos++;
+    }
+
+    u64 start = p->pos;
+    f64 value = 0.0;
+    while (p->pos < p->src.len && p->src.data[p->pos] >= '0' && p->src.data[p->pos] <= '9') {
+        value = value * 10.0 + (p->src.data[p->pos++] - '0');
+    }
+    if (p->pos < p->src.len && p->src.data[p->pos] == '.') {
+        p->pos++;
+        f64 scale = 0.1;
+        while (p->pos < p->src.len && p->src.data[p->pos] >= '0' && p->src.data[p->pos] <= '9') {
+            value += (p->src.data[p->pos++] - '0') * scale;
+            scale *= 0.1;
+        }
+    }
+    if (p->pos == start) {
+        p->error = true;
+    }
+    return sign * value;
+}
+
+static b8 json_str_is(WDL_Str str, const char* cstr) {
+    u64 len = strlen(cstr);
+    return str.len == len && memcmp(str.data, cstr, len) == 0;
+}
+
+// Iterates the members of an object, the opening brace has to be consumed.
+static b8 json_next_member(JsonParser* p, b8* first, WDL_Str* key) {
+    if (p->error || json_accept(p, '}')) {
+        return false;
+    }
+    if (!*first) {
+        json_expect(p, ',');
+    }
+    *first = false;
+    *key = json_string(p);
+    json_expect(p, ':');
+    return !p->error;
+}
+
+// Iterates the elements of an array, the opening bracket has to be consumed.
+static b8 json_next_element(JsonParser* p, b8* first) {
+    if (p->error || json_accept(p, ']')) {
+        return false;
+    }
+    if (!*first) {
+        json_expect(p, ',');
+    }
+    *first = false;
+    return !p->error;
+}
+
+static void json_skip_value(JsonParser* p) {
+    json_skip_whitespace(p);
+    if (p->pos >= p->src.len) {
+        p->error = true;
+        return;
+    }
+
+    u8 c = p->src.data[p->pos];
+    b8 first = true;
+    WDL_Str key;
+    if (c == '{') {
+        p->pos++;
+        while (json_next_member(p, &first, &key)) {
+            json_skip_value(p);
+        }
+    } else if (c == '[') {
+        p->pos++;
+        while (json_next_element(p, &first)) {
+            json_skip_value(p);
+        }
+    } else if (c == '"') {
+        json_string(p);
+    } else if (c == '-' || (c >= '0' && c <= '9')) {
+        json_number(p);
+        // Exponents aren't used by Aseprite, skip them if present.
+        while (p->pos < p->src.len && (p->src.data[p->pos] == 'e' || p->src.data[p->pos] == 'E' ||
+                    p->src.data[p->pos] == '+' || p->src.data[p->pos] == '-' ||
+                    (p->src.data[p->pos] >= '0' && p->src.data[p->pos] <= '9'))) {
+            p->pos++;
+        }
+    } else {
+        // true, false or null
+        while (p->pos < p->src.len && p->src.data[p->pos] >= 'a' && p->src.data[p->pos] <= 'z') {
+            p->pos++;
+        }
+    }
+}
+
+#define ASEPRITE_MAX_FRAMES 1024
+#define ASEPRITE_MAX_TAGS 64
+
+typedef struct AsepriteFrame AsepriteFrame;
+struct AsepriteFrame {
+    WDL_Ivec2 pos;
+    WDL_Ivec2 size;
+    // In milliseconds.
+    f32 duration;
+};
+
+static AsepriteFrame aseprite_parse_frame(JsonParser* p) {
+    AsepriteFrame frame = {0};
+    json_expect(p, '{');
+    b8 first = true;
+    WDL_Str key;
+    while (json_next_member(p, &first, &key)) {
+        if (json_str_is(key, "frame")) {
+            json_expect(p, '{');
+            b8 rect_first = true;
+            WDL_Str rect_key;
+            while (json_next_member(p, &rect_first, &rect_key)) {
+                i32 value = json_number(p);
+                if (json_str_is(rect_key, "x")) {
+                    frame.pos.x = value;
+                } else if (json_str_is(rect_key, "y")) {
+                    frame.pos.y = value;
+                } else if (json_str_is(rect_key, "w")) {
+                    frame.size.x = value;
+                } else if (json_str_is(rect_key, "h")) {
+                    frame.size.y = value;
+                }
+            }
+        } else if (json_str_is(key, "duration")) {
+            frame.duration = json_number(p);
+        } else {
+            json_skip_value(p);
+        }
+    }
+    return frame;
+}
+
+static AnimationTag aseprite_parse_tag(JsonParser* p) {
+    AnimationTag tag = {0};
+    json_expect(p, '{');
+    b8 first = true;
+    WDL_Str key;
+    while (json_next_member(p, &first, &key)) {
+        if (json_str_is(key, "name")) {
+            tag.name = json_string(p);
+        } else if (json_str_is(key, "from")) {
+            tag.from = json_number(p);
+        } else if (json_str_is(key, "to")) {
+            tag.to = json_number(p);
+        } else if (json_str_is(key, "direction")) {
+            WDL_Str direction = json_string(p);
+            if (json_str_is(direction, "reverse")) {
+                tag.direction = ANIMATION_DIRECTION_REVERSE;
+            } else if (json_str_is(direction, "pingpong")) {
+                tag.direction = ANIMATION_DIRECTION_PINGPONG;
+            } else {
+                tag.direction = ANIMATION_DIRECTION_FORWARD;
+            }
+        } else {
+            json_skip_value(p);
+        }
+    }
+    return tag;
+}
+
+Animation* asset_load_animation(WDL_Str name, WDL_Str filepath, GfxTextureSampler sampler) {
+    wdl_assert(assman.inited, "Asset manager not initialized.");
+    // Checked before anything is loaded so nothing is left behind.
+    if (wdl_hm_getp(assman.asset_map, name) != NULL) {
+        wdl_warn("Asset %.*s already loaded!", name.len, name.data);
+        return NULL;
+    }
+
+    WDL_Scratch scratch = wdl_scratch_begin(NULL, 0);
+    JsonParser p = {
+        .src = read_file(scratch.arena, filepath),
+    };
+    if (p.src.len == 0) {
+        wdl_scratch_end(scratch);
+        return NULL;
+    }
+
+    AsepriteFrame* frames = wdl_arena_push_no_zero(scratch.arena, ASEPRITE_MAX_FRAMES * sizeof(AsepriteFrame));
+    u32 frame_count = 0;
+    AnimationTag* tags = wdl_arena_push_no_zero(scratch.arena, ASEPRITE_MAX_TAGS * sizeof(AnimationTag));
+    u32 tag_count = 0;
+    WDL_Str image = {0};
+
+    json_expect(&p, '{');
+    b8 first = true;
+    WDL_Str key;
+    while (json_next_member(&p, &first, &key)) {
+        if (json_str_is(key, "frames")) {
+            // Exported either as a hash keyed by frame name or as an array,
+            // frames are in order in both.
+            b8 is_hash = json_accept(&p, '{');
+            if (!is_hash) {
+                json_expect(&p, '[');
+            }
+            b8 frame_first = true;
+            WDL_Str frame_name;
+            while (is_hash ? json_next_member(&p, &frame_first, &frame_name) : json_next_element(&p, &frame_first)) {
+                AsepriteFrame frame = aseprite_parse_frame(&p);
+                if (frame_count < ASEPRITE_MAX_FRAMES) {
+                    frames[frame_count++] = frame;
+                }
+            }
+        } else if (json_str_is(key, "meta")) {
+            json_expect(&p, '{');
+            b8 meta_first = true;
+            WDL_Str meta_key;
+            while (json_next_member(&p, &meta_first, &meta_key)) {
+                if (json_str_is(meta_key, "image")) {
+                    image = json_string(&p);
+                } else if (json_str_is(meta_key, "frameTags")) {
+                    json_expect(&p, '[');
+                    b8 tag_first = true;
+                    while (json_next_element(&p, &tag_first)) {
+                        AnimationTag tag = aseprite_parse_tag(&p);
+                        if (tag_count < ASEPRITE_MAX_TAGS) {
+                            tags[tag_count++] = tag;
+                        }
+                    }
+                } else {
+                    json_skip_value(&p);
+                }
+            }
+        } else {
+            json_skip_value(&p);
+        }
+    }
+
+    if (p.error || frame_count == 0 || image.len == 0) {
+        wdl_error("Failed to parse animation %.*s.", filepath.len, filepath.data);
+        wdl_scratch_end(scratch);
+        return NULL;
+    }
+
+    // The image path is relative to the JSON file.
+    u64 dir_len = filepath.len;
+    while (dir_len > 0 && filepath.data[dir_len - 1] != '/') {
+        dir_len--;
+    }
+    WDL_Str image_path = wdl_str_pushf(scratch.arena, "%.*s%.*s", (i32) dir_len, filepath.data, (i32) image.len, image.data);
+    GfxTexture texture = texture_load(image_path, sampler);
+    if (gfx_texture_is_null(texture)) {
+        wdl_scratch_end(scratch);
+        return NULL;
+    }
+
+    // Everything is resolved up front so playback never touches the texture.
+    WDL_Vec2 sheet_size = wdl_iv2_to_v2(gfx_texture_get_size(texture));
+    Animation* animation = wdl_arena_push_no_zero(assman.arena, sizeof(Animation));
+    *animation = (Animation) {
+        .texture = texture,
+        .frame_count = frame_count,
+        .uvs = wdl_arena_push_no_zero(assman.arena, frame_count * 2 * sizeof(WDL_Vec2)),
+        .durations = wdl_arena_push_no_zero(assman.arena, frame_count * sizeof(f32)),
+        .frame_size = frames[0].size,
+        .tags = wdl_arena_push_no_zero(assman.arena, tag_count * sizeof(AnimationTag)),
+        .tag_count = tag_count,
+    };
+    for (u32 i = 0; i < frame_count; i++) {
+        WDL_Vec2 pos = wdl_iv2_to_v2(frames[i].pos);
+        WDL_Vec2 size = wdl_iv2_to_v2(frames[i].size);
+        animation->uvs[i * 2 + 0] = wdl_v2_div(pos, sheet_size);
+        animation->uvs[i * 2 + 1] = wdl_v2_div(wdl_v2_add(pos, size), sheet_size);
+        // Zero length frames would stall the animator.
+        animation->durations[i] = (frames[i].duration > 1.0f ? frames[i].duration : 1.0f) / 1000.0f;
+    }
+    for (u32 i = 0; i < tag_count; i++) {
+        AnimationTag tag = tags[i];
+        u8* name = wdl_arena_push_no_zero(assman.arena, tag.name.len);
+        memcpy(name, tag.name.data, tag.name.len);
+        tag.name = wdl_str(name, tag.name.len);
+        tag.from = tag.from < frame_count ? tag.from : frame_count - 1;
+        tag.to = tag.to < frame_count ? tag.to : frame_count - 1;
+        tag.to = tag.to > tag.from ? tag.to : tag.from;
+        animation->tags[i] = tag;
+    }
+    wdl_scratch_end(scratch);
+
+    Asset asset = {
+        .type = ASSET_TYPE_ANIMATION,
+        .animation = animation,
+    };
+    wdl_hm_insert(assman.asset_map, name, asset);
+    return animation;
+}
+
 GfxTexture asset_get_texture(WDL_Str name) {
     wdl_assert(assman.inited, "Asset manager not initialized.");
     Asset* asset = wdl_hm_getp(assman.asset_map, name);
@@ -143,6 +539,46 @@ GfxTexture asset_get_texture(WDL_Str name) {
     return asset->texture;
 }
 
+b8 asset_texture_trim(GfxTexture texture, WDL_Ivec2 pos, WDL_Ivec2 size, WDL_Ivec2* trim_pos, WDL_Ivec2* trim_size) {
+    wdl_assert(assman.inited, "Asset manager not initialized.");
+    *trim_pos = wdl_iv2s(0);
+    *trim_size = size;
+
+    u32 id = gfx_texture_get_id(texture);
+    TextureAlpha* alpha = wdl_hm_getp(assman.alpha_map, id);
+    if (alpha == NULL) {
+        return false;
+    }
+
+    WDL_Ivec2 min = size;
+    WDL_Ivec2 max = wdl_iv2s(0);
+    for (i32 y = 0; y < size.y; y++) {
+        i32 ty = pos.y + y;
+        if (ty < 0 || ty >= alpha->size.y) {
+            continue;
+        }
+        const u8* row = &alpha->alpha[ty * alpha->size.x];
+        for (i32 x = 0; x < size.x; x++) {
+            i32 tx = pos.x + x;
+            if (tx < 0 || tx >= alpha->size.x || row[tx] == 0) {
+                continue;
+            }
+            min.x = x < min.x ? x : min.x;
+            min.y = y < min.y ? y : min.y;
+            max.x = x + 1 > max.x ? x + 1 : max.x;
+            max.y = y + 1 > max.y ? y + 1 : max.y;
+        }
+    }
+
+    if (max.x <= min.x || max.y <= min.y) {
+        *trim_size = wdl_iv2s(0);
+        return true;
+    }
+    *trim_pos = min;
+    *trim_size = wdl_iv2(max.x - min.x, max.y - min.y);
+    return true;
+}
+
 Font* asset_get_font(WDL_Str name) {
     wdl_assert(assman.inited, "Asset manager not initialized.");
     Asset* asset = wdl_hm_getp(assman.asset_map, name);
@@ -158,3 +594,19 @@ Font* asset_get_font(WDL_Str name) {
 
     return asset->font;
 }
+
+Animation* asset_get_animation(WDL_Str name) {
+    wdl_assert(assman.inited, "Asset manager not initialized.");
+    Asset* asset = wdl_hm_getp(assman.asset_map, name);
+    if (asset == NULL) {
+        wdl_error("Asset %.*s not found!", name.len, name.data);
+        return NULL;
+    }
+
+    if (asset->type != ASSET_TYPE_ANIMATION) {
+        wdl_error("Asset %.*s is a %s not an animation.", name.len, name.data, asset_type_to_cstr(asset->type));
+        return NULL;
+    }
+
+    return asset->animation;
+}
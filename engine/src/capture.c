@@ -0,0 +1,349 @@
+#include "engine/capture.h"
+#include "engine/graphics.h"
+#include "engine/platform.h"
+#include "waddle.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Copies in flight on the GPU plus the ones being encoded.
+#define CAPTURE_SLOT_COUNT 4
+#define CAPTURE_MAX_PATH 512
+
+typedef struct CaptureJob CaptureJob;
+struct CaptureJob {
+    GfxReadbackPixels pixels;
+    CaptureFormat format;
+    char path[CAPTURE_MAX_PATH];
+};
+
+typedef struct CaptureState CaptureState;
+struct CaptureState {
+    b8 inited;
+    // Holds the thread and its locks.
+    WDL_Arena* arena;
+    GfxReadback readback;
+    // Output of the copy in each readback slot, decided when it's issued.
+    char slot_paths[CAPTURE_SLOT_COUNT][CAPTURE_MAX_PATH];
+    CaptureFormat slot_formats[CAPTURE_SLOT_COUNT];
+
+    b8 screenshot_requested;
+    char screenshot_path[CAPTURE_MAX_PATH];
+    CaptureFormat screenshot_format;
+
+    b8 recording;
+    char directory[CAPTURE_MAX_PATH];
+    CaptureFormat recording_format;
+    u32 frame_index;
+    u32 dropped_frames;
+
+    // Only used by the worker thread.
+    WDL_Arena* worker_arena;
+    u32 crc_table[256];
+
+    // Shared with the worker thread, guarded by 'mutex'.
+    PlatformThread* worker;
+    PlatformMutex* mutex;
+    PlatformCond* cond;
+    CaptureJob jobs[CAPTURE_SLOT_COUNT];
+    u32 job_head;
+    u32 job_count;
+    // Slots the worker is done reading from.
+    u32 done_slots[CAPTURE_SLOT_COUNT];
+    u32 done_count;
+    b8 quit;
+};
+
+static CaptureState capture = {0};
+
+// -- Encoding --
+
+static void write_u32_be(u8* out, u32 value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static u32 crc32_update(u32 crc, const u8* data, u64 len) {
+    for (u64 i = 0; i < len; i++) {
+        crc = capture.crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static void png_write_chunk(FILE* fp, const char* type, const u8* data, u32 len) {
+    u8 header[8];
+    write_u32_be(header, len);
+    memcpy(header + 4, type, 4);
+    fwrite(header, 1, sizeof(header), fp);
+    fwrite(data, 1, len, fp);
+
+    u32 crc = crc32_update(0xffffffff, header + 4, 4);
+    crc = crc32_update(crc, data, len) ^ 0xffffffff;
+    u8 footer[4];
+    write_u32_be(footer, crc);
+    fwrite(footer, 1, sizeof(footer), fp);
+}
+
+// Encoding has to keep up with the frame rate, so the image data is stored in
+// uncompressed deflate blocks. Files are large but cost little more than a
+// copy to produce.
+static void png_write(FILE* fp, WDL_Arena* arena, const GfxReadbackPixels* pixels) {
+    u32 width = pixels->size.x;
+    u32 height = pixels->size.y;
+    u64 stride = (u64) width * 4;
+
+    // Filter type 0 per row, rows flipped to top first.
+    u64 raw_size = (stride + 1) * height;
+    u8* raw = wdl_arena_push_no_zero(arena, raw_size);
+    for (u32 y = 0; y < height; y++) {
+        u8* row = raw + y * (stride + 1);
+        row[0] = 0;
+        memcpy(row + 1, pixels->data + (height - 1 - y) * stride, stride);
+    }
+
+    const u32 MAX_BLOCK_SIZE = 65535;
+    u64 block_count = (raw_size + MAX_BLOCK_SIZE - 1) / MAX_BLOCK_SIZE;
+    u64 zlib_size = 2 + raw_size + block_count * 5 + 4;
+    u8* zlib = wdl_arena_push_no_zero(arena, zlib_size);
+    u8* out = zlib;
+    // Deflate with a 32K window, no compression.
+    *out++ = 0x78;
+    *out++ = 0x01;
+    u32 adler_a = 1;
+    u32 adler_b = 0;
+    for (u64 offset = 0; offset < raw_size; offset += MAX_BLOCK_SIZE) {
+        u32 len = raw_size - offset < MAX_BLOCK_SIZE ? raw_size - offset : MAX_BLOCK_SIZE;
+        *out++ = offset + len == raw_size;
+        *out++ = len & 0xff;
+        *out++ = len >> 8;
+        *out++ = ~len & 0xff;
+        *out++ = (~len >> 8) & 0xff;
+        memcpy(out, raw + offset, len);
+        out += len;
+
+        for (u32 i = 0; i < len; i++) {
+            adler_a = (adler_a + raw[offset + i]) % 65521;
+            adler_b = (adler_b + adler_a) % 65521;
+        }
+    }
+    write_u32_be(out, (adler_b << 16) | adler_a);
+
+    const u8 SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    fwrite(SIGNATURE, 1, sizeof(SIGNATURE), fp);
+
+    u8 ihdr[13];
+    write_u32_be(ihdr, width);
+    write_u32_be(ihdr + 4, height);
+    ihdr[8] = 8; // Bit depth
+    ihdr[9] = 6; // RGBA
+    ihdr[10] = 0; // Deflate
+    ihdr[11] = 0; // Adaptive filtering
+    ihdr[12] = 0; // No interlacing
+    png_write_chunk(fp, "IHDR", ihdr, sizeof(ihdr));
+    png_write_chunk(fp, "IDAT", zlib, zlib_size);
+    png_write_chunk(fp, "IEND", NULL, 0);
+}
+
+static void raw_write(FILE* fp, const GfxReadbackPixels* pixels) {
+    u64 stride = (u64) pixels->size.x * 4;
+    for (i32 y = pixels->size.y - 1; y >= 0; y--) {
+        fwrite(pixels->data + y * stride, 1, stride, fp);
+    }
+}
+
+static void capture_write(const CaptureJob* job) {
+    FILE* fp = fopen(job->path, "wb");
+    if (fp == NULL) {
+        wdl_error("Failed to open capture file '%s'.", job->path);
+        return;
+    }
+
+    switch (job->format) {
+        case CAPTURE_FORMAT_PNG:
+            png_write(fp, capture.worker_arena, &job->pixels);
+            wdl_arena_clear(capture.worker_arena);
+            break;
+        case CAPTURE_FORMAT_RAW:
+            raw_write(fp, &job->pixels);
+            break;
+    }
+    fclose(fp);
+}
+
+static void capture_worker(void* user_data) {
+    (void) user_data;
+
+    platform_mutex_lock(capture.mutex);
+    while (true) {
+        while (capture.job_count == 0 && !capture.quit) {
+            platform_cond_wait(capture.cond, capture.mutex);
+        }
+        if (capture.job_count == 0) {
+            break;
+        }
+
+        CaptureJob job = capture.jobs[capture.job_head];
+        capture.job_head = (capture.job_head + 1) % CAPTURE_SLOT_COUNT;
+        capture.job_count--;
+
+        platform_mutex_unlock(capture.mutex);
+        capture_write(&job);
+        platform_mutex_lock(capture.mutex);
+
+        capture.done_slots[capture.done_count++] = job.pixels.slot;
+    }
+    platform_mutex_unlock(capture.mutex);
+}
+
+// Hands a finished copy to the worker. Every slot is in at most one job, so
+// the queue can't overflow.
+static void capture_push_job(const GfxReadbackPixels* pixels) {
+    platform_mutex_lock(capture.mutex);
+    CaptureJob* job = &capture.jobs[(capture.job_head + capture.job_count) % CAPTURE_SLOT_COUNT];
+    job->pixels = *pixels;
+    job->format = capture.slot_formats[pixels->slot];
+    memcpy(job->path, capture.slot_paths[pixels->slot], CAPTURE_MAX_PATH);
+    capture.job_count++;
+    platform_cond_signal(capture.cond);
+    platform_mutex_unlock(capture.mutex);
+}
+
+// -- API --
+
+void capture_init(void) {
+    wdl_assert(!capture.inited, "Capture already initialized.");
+
+    capture = (CaptureState) {
+        .arena = wdl_arena_create(),
+        .readback = gfx_readback_new(CAPTURE_SLOT_COUNT),
+        .worker_arena = wdl_arena_create(),
+    };
+    wdl_arena_tag(capture.arena, wdl_str_lit("capture"));
+    wdl_arena_tag(capture.worker_arena, wdl_str_lit("capture-worker"));
+
+    for (u32 i = 0; i < 256; i++) {
+        u32 crc = i;
+        for (u32 j = 0; j < 8; j++) {
+            crc = crc & 1 ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+        }
+        capture.crc_table[i] = crc;
+    }
+
+    capture.mutex = platform_mutex_create(capture.arena);
+    capture.cond = platform_cond_create(capture.arena);
+    capture.worker = platform_thread_create(capture.arena, capture_worker, NULL);
+    if (capture.worker == NULL) {
+        wdl_error("Failed to start the capture thread.");
+        platform_cond_destroy(capture.cond);
+        platform_mutex_destroy(capture.mutex);
+        gfx_readback_destroy(capture.readback);
+        wdl_arena_destroy(capture.worker_arena);
+        wdl_arena_destroy(capture.arena);
+        return;
+    }
+    capture.inited = true;
+}
+
+void capture_terminate(void) {
+    if (!capture.inited) {
+        return;
+    }
+
+    // Copies still on the GPU are handed to the worker first, it only quits
+    // once the queue is empty.
+    GfxReadbackPixels pixels;
+    while (gfx_readback_wait(capture.readback, &pixels)) {
+        capture_push_job(&pixels);
+    }
+
+    platform_mutex_lock(capture.mutex);
+    capture.quit = true;
+    platform_cond_signal(capture.cond);
+    platform_mutex_unlock(capture.mutex);
+    platform_thread_join(capture.worker);
+
+    platform_cond_destroy(capture.cond);
+    platform_mutex_destroy(capture.mutex);
+    gfx_readback_destroy(capture.readback);
+    wdl_arena_destroy(capture.worker_arena);
+    wdl_arena_destroy(capture.arena);
+    capture.inited = false;
+}
+
+void capture_update(WDL_Ivec2 screen_size) {
+    if (!capture.inited) {
+        return;
+    }
+
+    u32 done_slots[CAPTURE_SLOT_COUNT];
+    platform_mutex_lock(capture.mutex);
+    u32 done_count = capture.done_count;
+    memcpy(done_slots, capture.done_slots, done_count * sizeof(u32));
+    capture.done_count = 0;
+    platform_mutex_unlock(capture.mutex);
+    for (u32 i = 0; i < done_count; i++) {
+        gfx_readback_release(capture.readback, done_slots[i]);
+    }
+
+    GfxReadbackPixels pixels;
+    while (gfx_readback_poll(capture.readback, &pixels)) {
+        capture_push_job(&pixels);
+    }
+
+    if (!capture.screenshot_requested && !capture.recording) {
+        return;
+    }
+
+    i32 slot = gfx_framebuffer_read_async(GFX_FRAMEBUFFER_NULL, screen_size, capture.readback);
+    if (slot < 0) {
+        // Screenshots are retried next frame.
+        if (capture.recording) {
+            capture.dropped_frames++;
+        }
+        return;
+    }
+
+    // A screenshot takes the place of a recorded frame.
+    if (capture.screenshot_requested) {
+        capture.screenshot_requested = false;
+        memcpy(capture.slot_paths[slot], capture.screenshot_path, CAPTURE_MAX_PATH);
+        capture.slot_formats[slot] = capture.screenshot_format;
+    } else {
+        const char* extension = capture.recording_format == CAPTURE_FORMAT_PNG ? "png" : "raw";
+        snprintf(capture.slot_paths[slot], CAPTURE_MAX_PATH, "%s/frame_%05u.%s", capture.directory, capture.frame_index++, extension);
+        capture.slot_formats[slot] = capture.recording_format;
+    }
+}
+
+void capture_screenshot(WDL_Str filepath, CaptureFormat format) {
+    capture.screenshot_requested = true;
+    snprintf(capture.screenshot_path, CAPTURE_MAX_PATH, "%.*s", (i32) filepath.len, filepath.data);
+    capture.screenshot_format = format;
+}
+
+void capture_start(WDL_Str directory, CaptureFormat format) {
+    snprintf(capture.directory, CAPTURE_MAX_PATH, "%.*s", (i32) directory.len, directory.data);
+    if (!platform_make_directory(directory)) {
+        wdl_error("Failed to create capture directory '%s'.", capture.directory);
+        return;
+    }
+
+    capture.recording = true;
+    capture.recording_format = format;
+    capture.frame_index = 0;
+    capture.dropped_frames = 0;
+}
+
+void capture_stop(void) {
+    capture.recording = false;
+}
+
+b8 capture_is_recording(void) {
+    return capture.recording;
+}
+
+u32 capture_get_dropped_frames(void) {
+    return capture.dropped_frames;
+}
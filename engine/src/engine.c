@@ -5,12 +5,22 @@
 #include "engine/window.h"
 #include "engine/graphics.h"
 #include "engine/assman.h"
+#include "engine/capture.h"
 #include "engine/utils.h"
 #include "engine/font.h"
+#include "engine/profiler.h"
+
+#include <math.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define set_const(T, var, value) (*(T*) &(var)) = (value)
 
-static Renderer* renderer_init(WDL_Arena* arena, u32 max_quad_count);
+static Renderer* renderer_init(WDL_Arena* arena, RendererDesc desc);
+static void renderer_next_frame(Renderer* rend, f32 frame_time);
+static void renderer_terminate(Renderer* rend);
 
 typedef struct Engine Engine;
 struct Engine {
@@ -61,6 +71,16 @@ i32 engine_run(ApplicationDesc app_desc) {
     // Asset manager
     assman_init();
 
+    capture_init();
+
+    // A fixed default would be missed every frame by vsync alone on displays
+    // slower than it.
+    RendererDesc renderer_desc = app_desc.renderer;
+    u32 refresh_rate = window_get_refresh_rate(window);
+    if (renderer_desc.dynamic_resolution.target_frame_time <= 0.0f && refresh_rate > 0) {
+        renderer_desc.dynamic_resolution.target_frame_time = 1.0f / refresh_rate;
+    }
+
     // Engine context
     engine = (Engine) {
         .arenas = {
@@ -69,20 +89,27 @@ i32 engine_run(ApplicationDesc app_desc) {
             .curr_frame = 0,
         },
         .window = window,
-        .renderer = renderer_init(persistent, 4096),
+        .renderer = renderer_init(persistent, renderer_desc),
     };
 
     app_desc.startup();
 
+    f64 last_time = wdl_os_get_time();
     while (window_is_open(window)) {
         gfx_viewport(window_get_size(window));
 
         app_desc.update();
 
+        capture_update(window_get_size(window));
         window_swap_buffers(window);
         window_poll_events(window);
 
+        f64 time = wdl_os_get_time();
+        f32 frame_time = time - last_time;
+        last_time = time;
+
         // Update frame arena
+        renderer_next_frame(engine.renderer, frame_time);
         engine.arenas.curr_frame = (engine.arenas.curr_frame + 1) % 2;
         wdl_arena_clear(get_frame_arena());
     }
@@ -90,7 +117,9 @@ i32 engine_run(ApplicationDesc app_desc) {
     app_desc.shutdown();
 
     assman_terminate();
+    capture_terminate();
 
+    renderer_terminate(engine.renderer);
     gfx_termiante();
     window_destroy(window);
 
@@ -176,268 +205,2645 @@ WDL_Vec2 screen_to_world_space(WDL_Vec2 screen, Camera cam) {
 // Renderer
 //
 
-#define RENDERER_MAX_TEXTURE_COUNT 32
-
-typedef struct Vertex Vertex;
-struct Vertex {
+// Number of texture pages a single batch can bind. Each page is a 2D array
+// texture holding any number of same sized textures, so this is no longer a
+// limit on the number of distinct textures. The last texture unit is
+// reserved for the lightmap.
+#define RENDERER_MAX_TEXTURE_COUNT 31
+#define RENDERER_LIGHTMAP_SLOT RENDERER_MAX_TEXTURE_COUNT
+// Every flush, sprite batch, particle system, tilemap split and multi-draw
+// span takes a region of a stream ring, so a single frame uses many of them.
+// The rings are sized to hold the regions of the busiest frame measured for
+// every frame the GPU may lag behind, see 'renderer_next_frame()'.
+#define RENDERER_FRAMES_IN_FLIGHT 3
+#define RENDERER_MIN_STREAM_REGIONS 8
+// Regions a single multi-draw may span. Kept at half the ring so the next pass
+// doesn't have to wait on the one just submitted.
+#define RENDERER_MAX_MULTI_DRAWS (GFX_BUFFER_MAX_STREAM_REGIONS / 2)
+// Extra rings chained when every region of the current one is still being
+// read by the GPU, instead of waiting on it.
+#define RENDERER_MAX_INSTANCE_BUFFERS 4
+
+// Quad capacity of a batch. Grows to the next power of two as soon as a pass
+// doesn't fit and halves once a whole window of frames has used at most a
+// quarter of it.
+#define RENDERER_DEFAULT_QUAD_CAPACITY 4096
+#define RENDERER_MIN_QUAD_CAPACITY 1024
+#define RENDERER_MAX_QUAD_CAPACITY 65536
+#define RENDERER_CAPACITY_WINDOW 120
+// Frames averaged by 'renderer_get_average_stats()'.
+#define RENDERER_STATS_WINDOW 60
+// Particles a region of the particle ring holds at first. Grows to the next
+// power of two whenever a system doesn't fit.
+#define RENDERER_MIN_PARTICLE_CAPACITY 4096
+// Depth i, handed out in sorted order with one per sprite batch sprite, is
+// written as 1 - 2 * (i + 1) / RENDERER_MAX_DEPTH in NDC, see
+// 'batch.vert.glsl', so the
+// passes use the whole [-1, 1] range. Steps of 2^-21 in NDC are 2^-22 in the
+// depth buffer and stay distinct at 24 bits. Defined for the shaders too, see
+// 'renderer_init()'.
+#define RENDERER_MAX_DEPTH (1 << 22)
+
+// One record per quad. The corners are expanded in 'batch.vert.glsl' from
+// 'gl_VertexID', so 48 bytes per quad instead of four 36 byte vertices.
+// Must match the std430 layout of 'Instance' in the shader.
+typedef struct Instance Instance;
+struct Instance {
     WDL_Vec2 pos;
-    WDL_Vec2 uv;
-    Color color;
-    f32 texture_index;
+    WDL_Vec2 size;
+    WDL_Vec2 pivot;
+    // Packed as two 16-bit unsigned normalized values.
+    // uv_min = Top left
+    // uv_max = Bottom right
+    u32 uv_min;
+    u32 uv_max;
+    // Cosine and sine of the rotation packed as two 16-bit signed normalized
+    // values so the shader doesn't evaluate any trig per vertex.
+    u32 rotation;
+    u32 color;
+    // Slot of the texture page in the batch in the low 8 bits and the layer
+    // within the page in the next 16.
+    u32 texture;
+    // Position in the sorted draw order, see 'renderer_end()'.
+    u32 depth;
+};
+
+#define INSTANCE_TEXTURE(SLOT, LAYER) ((u32) (SLOT) | (u32) (LAYER) << 8)
+
+// -- Command queue --
+
+// Sort key layout, most significant bits first:
+// [63:60] Layer
+// [59:28] Depth, the submission index for layers drawn in painter's order
+// [27:20] Shader
+// [19: 0] Texture id
+#define SORT_KEY_LAYER_SHIFT 60
+#define SORT_KEY_DEPTH_SHIFT 28
+#define SORT_KEY_SHADER_SHIFT 20
+#define SORT_KEY_TEXTURE_MASK 0xfffff
+
+#define RENDER_CMD_CHUNK_SIZE 1024
+
+typedef struct RenderCmd RenderCmd;
+struct RenderCmd {
+    u64 key;
+    GfxTexture texture;
+    // Set for retained sprite batches, 'instance' is unused.
+    SpriteBatch* sprite_batch;
+    // Set for particle systems, 'instance' is unused.
+    ParticleSystem* particles;
+    // Set for tilemaps, 'instance' is unused.
+    Tilemap* tilemap;
+    // 'texture' and 'depth' are assigned when the batches are built.
+    Instance instance;
+};
+
+typedef struct RenderCmdChunk RenderCmdChunk;
+struct RenderCmdChunk {
+    RenderCmdChunk* next;
+    u32 count;
+    RenderCmd cmds[RENDER_CMD_CHUNK_SIZE];
+};
+
+// Variants of 'batch.frag.glsl', from cheapest to most expensive. Stored in
+// the shader bits of the sort key.
+typedef enum BatchShader {
+    // Vertex color only, no texture lookup.
+    BATCH_SHADER_COLOR,
+    // Plain lookup, used for nearest sampled textures.
+    BATCH_SHADER_TEXTURED,
+    // Pixel art filtering for linear sampled textures.
+    BATCH_SHADER_PIXEL_ART,
+    // Font atlases, the red channel is the coverage.
+    BATCH_SHADER_TEXT,
+
+    BATCH_SHADER_COUNT,
+} BatchShader;
+
+enum {
+    BATCH_FEATURE_TEXTURED = 1 << 0,
+    BATCH_FEATURE_IQ_FILTER = 1 << 1,
+    BATCH_FEATURE_TEXT = 1 << 2,
+};
+
+static const u32 BATCH_SHADER_FEATURES[BATCH_SHADER_COUNT] = {
+    [BATCH_SHADER_COLOR] = 0,
+    [BATCH_SHADER_TEXTURED] = BATCH_FEATURE_TEXTURED,
+    [BATCH_SHADER_PIXEL_ART] = BATCH_FEATURE_TEXTURED | BATCH_FEATURE_IQ_FILTER,
+    [BATCH_SHADER_TEXT] = BATCH_FEATURE_TEXTURED | BATCH_FEATURE_TEXT,
+};
+
+static BatchShader batch_shader_for_texture(GfxTexture texture) {
+    if (gfx_texture_is_null(texture)) {
+        return BATCH_SHADER_COLOR;
+    }
+    // Nearest sampling already gives crisp texels, the filter only matters
+    // when the texture is sampled linearly.
+    if (gfx_texture_get_sampler(texture) == GFX_TEXTURE_SAMPLER_NEAREST) {
+        return BATCH_SHADER_TEXTURED;
+    }
+    return BATCH_SHADER_PIXEL_ART;
+}
+
+static BatchShader render_cmd_shader(const RenderCmd* cmd) {
+    return (cmd->key >> SORT_KEY_SHADER_SHIFT) & 0xff;
+}
+
+static b8 render_layer_is_ordered(RenderLayer layer) {
+    return layer != RENDER_LAYER_TILES;
+}
+
+// -- Texture pages --
+//
+// The batch shader samples from an array of 'sampler2DArray' pages. Every
+// texture drawn is copied on the GPU into a layer of a page matching its size,
+// format and sampler. A copy is refreshed when the version of the texture
+// changes. This keeps the 32 binding limit per batch to pages instead of
+// textures.
+//
+// A layer is released when its texture is destroyed or changes size, and
+// pages left without any layer in use are destroyed at the end of the frame.
+//
+// Each copied texture is held twice in VRAM, once by its owner and once in its
+// page. 2D array textures already have the layout of a page so they're
+// borrowed as a page of their own instead, sampling their first layer without
+// any copy.
+//
+// NOTE: 'GL_ARB_bindless_texture' would avoid the copies but the GL loader is
+// generated without extensions.
+//
+
+#define RENDERER_MAX_TEXTURE_PAGES 256
+#define TEXTURE_PAGE_INITIAL_LAYERS 4
+// Minimum value of 'GL_MAX_ARRAY_TEXTURE_LAYERS' required by OpenGL 4.6.
+#define TEXTURE_PAGE_MAX_LAYERS 2048
+
+typedef struct TexturePage TexturePage;
+struct TexturePage {
+    // NULL if the page is unused and can be taken for any size.
+    GfxTexture array;
+    // 'array' is a texture drawn directly, it isn't owned by the page and only
+    // ever has layer 0 in use.
+    b8 borrowed;
+    WDL_Ivec2 size;
+    GfxTextureFormat format;
+    GfxTextureSampler sampler;
+    // Layers handed out so far, each one is either in use or released.
+    u32 layer_count;
+    u32 layer_capacity;
+    u32 used_count;
+    // Released layers, TEXTURE_PAGE_MAX_LAYERS long. The first
+    // 'reusable_count' can be handed out again. The rest were released this
+    // frame and may still be sampled by a batch that isn't flushed yet.
+    u16* free_layers;
+    u32 free_count;
+    u32 reusable_count;
+
+    // Batch this page was last bound in and the slot it got.
+    u32 batch;
+    u8 slot;
+};
+
+// Location of a texture inside the pages.
+typedef struct PageEntry PageEntry;
+struct PageEntry {
+    // Page index + 1, 0 if the texture isn't resident yet.
+    u16 page;
+    u16 layer;
+    u32 version;
+    // Last pass the texture was drawn in, for 'RendererStats.unique_textures'.
+    u32 pass;
+};
+
+// Entries are indexed by texture id through a two level table so lookups are
+// O(1) without having to know the number of textures up front.
+#define PAGE_ENTRY_BLOCK_SIZE 256
+#define PAGE_ENTRY_BLOCK_COUNT ((SORT_KEY_TEXTURE_MASK + 1) / PAGE_ENTRY_BLOCK_SIZE)
+
+// -- Text runs --
+
+// Frames a generation of cached runs lasts, see 'renderer_get_text_run()'.
+#define TEXT_RUN_GENERATION_FRAMES 120
+
+typedef struct TextRunGlyph TextRunGlyph;
+struct TextRunGlyph {
+    // Top left corner relative to the top left of the run, in font pixels.
+    WDL_Vec2 offset;
+    WDL_Vec2 size;
+    WDL_Vec2 uv[2];
+};
+
+typedef struct TextRunKey TextRunKey;
+struct TextRunKey {
+    u64 hash;
+    Font* font;
+    u32 size;
+    u32 _padding;
+};
+
+typedef struct TextRun TextRun;
+struct TextRun {
+    // Compared on lookup to rule out hash collisions.
+    WDL_Str text;
+    u32 atlas_generation;
+    // Same as 'font_measure_string()'.
+    WDL_Vec2 extent;
+    TextRunGlyph* glyphs;
+    u32 glyph_count;
+};
+
+// -- Render lists --
+
+// Commands recorded by one thread. The renderer records into its own list,
+// other threads into lists of their own which are spliced into it by
+// 'renderer_submit_list()'.
+struct RenderList {
+    // Chunks are allocated from here. Only touched by the recording thread.
+    WDL_Arena* arena;
+    RenderLayer layer;
+
+    // Copied from the renderer when the list is started.
+    WDL_Vec2 view_min;
+    WDL_Vec2 view_max;
+    f32 y_sign;
+
+    RenderCmdChunk* first_chunk;
+    RenderCmdChunk* last_chunk;
+    u32 cmd_count;
+    u32 drawn_count;
+    u32 culled_count;
+};
+
+// -- Dynamic resolution --
+
+// Used when the refresh rate of the monitor is unknown.
+#define DYNAMIC_RESOLUTION_DEFAULT_TARGET (1.0f / 60.0f)
+#define DYNAMIC_RESOLUTION_DEFAULT_MIN_SCALE 0.5f
+// Frames to wait after lowering the scale before raising it again, so a
+// frame rate capped by vsync doesn't bounce between two scales.
+#define DYNAMIC_RESOLUTION_COOLDOWN 60
+#define DYNAMIC_RESOLUTION_GROW_STEP 0.01f
+
+// Full screen quad sampling a single texture. Composites the dynamic
+// resolution target and cached layers without going through texture pages.
+typedef struct Blit Blit;
+struct Blit {
+    GfxShader shader;
+    GfxVertexArray vertex_array;
+};
+
+typedef struct DynamicResolution DynamicResolution;
+struct DynamicResolution {
+    b8 enabled;
+    f32 target_frame_time;
+    f32 min_scale;
+    f32 scale;
+    u32 cooldown;
+
+    // Allocated at the window size so changing the scale never reallocates,
+    // only the bottom left 'scaled_size' is drawn to.
+    WDL_Ivec2 size;
+    WDL_Ivec2 scaled_size;
+    GfxTexture color;
+    GfxTexture depth;
+    GfxFramebuffer framebuffer;
 };
 
+// -- Renderer --
+
 struct Renderer {
+    WDL_Arena* arena;
     u32 max_quad_count;
-    u32 curr_quad;
-
-    Vertex* vertices;
-    GfxBuffer vertex_buffer;
+    b8 multi_draw;
+
+    // Ring currently written to, one of 'instance_buffers'.
+    GfxBuffer instance_buffer;
+    GfxBuffer instance_buffers[RENDERER_MAX_INSTANCE_BUFFERS];
+    u32 instance_buffer_count;
+    u32 curr_instance_buffer;
+    // Most quads drawn in a single pass this window.
+    u32 quad_high_water;
+    u32 window_frame;
+    // Regions of every stream ring.
+    u32 stream_region_count;
+    // Regions taken from the instance and particle rings this frame.
+    u32 frame_instance_regions;
+    u32 frame_particle_regions;
+    // Most regions a ring took in a single frame this window.
+    u32 region_high_water;
+    // Stream ring of 'GfxDrawIndirectCommand's, only used with 'multi_draw'.
+    GfxBuffer indirect_buffer;
     GfxVertexArray vertex_array;
+    GfxShaderPermutations shader_permutations;
+    GfxShader shaders[BATCH_SHADER_COUNT];
+    // Currently bound variant.
+    BatchShader curr_shader;
     GfxShader shader;
+    GfxTexture white_texture;
+    Blit blit;
+    DynamicResolution dynres;
+
+    // 'particle.vert.glsl' paired with the variants of 'batch.frag.glsl'.
+    GfxShaderPermutations particle_permutations;
+    GfxShader particle_shaders[BATCH_SHADER_COUNT];
+    // Stream ring of particle arrays, created by the first particle draw.
+    GfxBuffer particle_buffer;
+    u32 particle_capacity;
+
+    // 'tilemap.vert.glsl' and 'tilemap.frag.glsl'.
+    GfxShader tilemap_shader;
     Camera cam;
-
-    GfxTexture textures[RENDERER_MAX_TEXTURE_COUNT];
+    // Reset by 'renderer_begin()', bound for the whole pass in
+    // 'renderer_end()'.
+    RendererLightmap lightmap;
+
+    // Visible area in the space quads are recorded in, i.e. with y flipped
+    // for 'Camera.invert_y'. Computed in 'renderer_begin()'.
+    WDL_Vec2 view_min;
+    WDL_Vec2 view_max;
+
+    // Recorded into the frame arena between 'renderer_begin()' and
+    // 'renderer_end()', submitted lists included.
+    RenderList list;
+
+    // Reset by 'renderer_begin()'. Pass 0 is never used so zeroed page
+    // entries don't count as seen.
+    u32 pass;
+    RendererStats stats;
+    RendererStats frame_stats;
+    RendererStats prev_frame_stats;
+    RendererStats stats_history[RENDERER_STATS_WINDOW];
+    u32 stats_frame;
+
+    TexturePage pages[RENDERER_MAX_TEXTURE_PAGES];
+    u32 page_count;
+    PageEntry* page_entries[PAGE_ENTRY_BLOCK_COUNT];
+    // Set once running out of pages has been reported.
+    b8 pages_exhausted;
+
+    // Key: TextRunKey
+    // Value: TextRun*
+    // The map and runs of the current generation live in
+    // 'text_run_arenas[text_run_generation]', the previous generation in the
+    // other arena.
+    WDL_Arena* text_run_arenas[2];
+    u8 text_run_generation;
+    u32 text_run_age;
+    WDL_HashMap* text_runs;
+    WDL_HashMap* prev_text_runs;
+
+    // Current batch
+    u32 batch;
+    u16 batch_pages[RENDERER_MAX_TEXTURE_COUNT];
     u8 curr_texture;
 };
 
-static Renderer* renderer_init(WDL_Arena* arena, u32 max_quad_count) {
-    u64 vertices_size = max_quad_count * 4 * sizeof(Vertex);
-    GfxBuffer vertex_buffer = gfx_buffer_new((GfxBufferDesc) {
-            .size = vertices_size,
+static void renderer_texture_destroyed(GfxTexture texture, void* user_data);
+
+static GfxBuffer renderer_instance_buffer_new(u32 max_quad_count, u32 region_count) {
+    return gfx_buffer_new((GfxBufferDesc) {
+            .size = max_quad_count * sizeof(Instance),
+            .data = NULL,
+            .usage = GFX_BUFFER_USAGE_STREAM_RING,
+            .region_count = region_count,
+        });
+}
+
+static GfxBuffer renderer_indirect_buffer_new(u32 region_count) {
+    return gfx_buffer_new((GfxBufferDesc) {
+            .size = RENDERER_MAX_MULTI_DRAWS * sizeof(GfxDrawIndirectCommand),
             .data = NULL,
-            .usage = GFX_BUFFER_USAGE_DYNAMIC,
+            .usage = GFX_BUFFER_USAGE_STREAM_RING,
+            .region_count = region_count,
         });
+}
 
-    // Index buffer
+static Blit blit_init(WDL_Arena* arena) {
+    Blit blit = {0};
     WDL_Scratch scratch = wdl_scratch_begin(&arena, 1);
-    u64 indices_size = max_quad_count * 6 * sizeof(u32);
-    u32* indices = wdl_arena_push_no_zero(scratch.arena, indices_size);
-    u32 j = 0;
-    for (u32 i = 0; i < max_quad_count * 6; i += 6) {
-        // First triangle
-        indices[i + 0] = j + 0;
-        indices[i + 1] = j + 1;
-        indices[i + 2] = j + 2;
-        // Second triangle
-        indices[i + 3] = j + 2;
-        indices[i + 4] = j + 3;
-        indices[i + 5] = j + 1;
-        j += 4;
-    }
-    GfxBuffer index_buffer = gfx_buffer_new((GfxBufferDesc) {
-            .size = indices_size,
-            .data = indices,
+    WDL_Str vert_src = read_file(scratch.arena, wdl_str_lit("assets/shaders/blit.vert.glsl"));
+    WDL_Str frag_src = read_file(scratch.arena, wdl_str_lit("assets/shaders/blit.frag.glsl"));
+    blit.shader = gfx_shader_new(vert_src, frag_src);
+    gfx_shader_uniform_i32(blit.shader, wdl_str_lit("tex"), 0);
+    wdl_scratch_end(scratch);
+
+    // Position and uv of two triangles covering the screen.
+    const f32 vertices[] = {
+        -1.0f, -1.0f, 0.0f, 0.0f,
+         1.0f, -1.0f, 1.0f, 0.0f,
+        -1.0f,  1.0f, 0.0f, 1.0f,
+        -1.0f,  1.0f, 0.0f, 1.0f,
+         1.0f,  1.0f, 1.0f, 1.0f,
+         1.0f, -1.0f, 1.0f, 0.0f,
+    };
+    GfxBuffer vertex_buffer = gfx_buffer_new((GfxBufferDesc) {
+            .size = sizeof(vertices),
+            .data = vertices,
             .usage = GFX_BUFFER_USAGE_STATIC,
         });
-    wdl_scratch_end(scratch);
+    blit.vertex_array = gfx_vertex_array_new((GfxVertexArrayDesc) {
+            .vertex_buffer = vertex_buffer,
+            .layout = {
+                .size = 4 * sizeof(f32),
+                .attribs = {
+                    {2, 0},
+                    {2, 2 * sizeof(f32)},
+                },
+                .attrib_count = 2,
+            },
+        });
+    return blit;
+}
+
+// Draws 'texture' over the whole viewport. 'uv_scale' is the part of the
+// texture that was drawn to.
+static void blit_draw(const Blit* blit, GfxTexture texture, WDL_Vec2 uv_scale) {
+    gfx_shader_uniform_v2(blit->shader, wdl_str_lit("uvScale"), uv_scale);
+    gfx_texture_bind(texture, 0);
+    gfx_draw(blit->vertex_array, 6, 0);
+}
+
+static DynamicResolution dynamic_resolution_init(RendererDesc desc) {
+    DynamicResolution dr = {
+        .enabled = desc.dynamic_resolution.enabled,
+        .target_frame_time = desc.dynamic_resolution.target_frame_time,
+        .min_scale = desc.dynamic_resolution.min_scale,
+        .scale = 1.0f,
+    };
+    if (!dr.enabled) {
+        return dr;
+    }
+    if (dr.target_frame_time <= 0.0f) {
+        dr.target_frame_time = DYNAMIC_RESOLUTION_DEFAULT_TARGET;
+    }
+    if (dr.min_scale <= 0.0f) {
+        dr.min_scale = DYNAMIC_RESOLUTION_DEFAULT_MIN_SCALE;
+    }
+
+    dr.size = wdl_iv2s(1);
+    dr.color = gfx_texture_new((GfxTextureDesc) {
+            .size = dr.size,
+            .format = GFX_TEXTURE_FORMAT_RGBA_U8,
+            .sampler = GFX_TEXTURE_SAMPLER_LINEAR,
+        });
+    dr.depth = gfx_texture_new((GfxTextureDesc) {
+            .size = dr.size,
+            .format = GFX_TEXTURE_FORMAT_DEPTH_F32,
+        });
+    dr.framebuffer = gfx_framebuffer_new();
+    gfx_framebuffer_attach(dr.framebuffer, dr.color, 0);
+    gfx_framebuffer_attach_depth(dr.framebuffer, dr.depth);
+    return dr;
+}
+
+static Renderer* renderer_init(WDL_Arena* arena, RendererDesc desc) {
+    u32 max_quad_count = desc.initial_quad_capacity;
+    b8 multi_draw = desc.multi_draw;
+    if (max_quad_count == 0) {
+        max_quad_count = RENDERER_DEFAULT_QUAD_CAPACITY;
+    }
+    max_quad_count = wdl_clamp(max_quad_count, RENDERER_MIN_QUAD_CAPACITY, RENDERER_MAX_QUAD_CAPACITY);
+    GfxBuffer instance_buffer = renderer_instance_buffer_new(max_quad_count, RENDERER_MIN_STREAM_REGIONS);
 
     // Shaders
-    scratch = wdl_scratch_begin(&arena, 1);
-    WDL_Str vert_src = read_file(scratch.arena, wdl_str_lit("assets/shaders/batch.vert.glsl"));
-    WDL_Str frag_src = read_file(scratch.arena, wdl_str_lit("assets/shaders/batch.frag.glsl"));
-    GfxShader shader = gfx_shader_new(vert_src, frag_src);
+    // The sources are kept around for variants compiled later on.
+    // Shared by every batch, particle and tilemap shader.
+    WDL_Str light_src = read_file(arena, wdl_str_lit("assets/shaders/light.glsl"));
+    WDL_Str prelude = wdl_str_pushf(arena, "#define RENDERER_MAX_DEPTH %d.0\n%.*s",
+            RENDERER_MAX_DEPTH, (i32) light_src.len, light_src.data);
+    GfxShaderPermutations shader_permutations = {
+        .vertex_source = read_file(arena, wdl_str_lit("assets/shaders/batch.vert.glsl")),
+        .fragment_source = read_file(arena, wdl_str_lit("assets/shaders/batch.frag.glsl")),
+        .prelude = prelude,
+        .features = {"TEXTURED", "IQ_FILTER", "TEXT"},
+        .feature_count = 3,
+    };
+    GfxShaderPermutations particle_permutations = shader_permutations;
+    particle_permutations.vertex_source = read_file(arena, wdl_str_lit("assets/shaders/particle.vert.glsl"));
     i32 samplers[RENDERER_MAX_TEXTURE_COUNT];
     for (u32 i = 0; i < RENDERER_MAX_TEXTURE_COUNT; i++) {
         samplers[i] = i;
     }
-    gfx_shader_uniform_i32_arr(shader, wdl_str_lit("textures"), samplers, RENDERER_MAX_TEXTURE_COUNT);
-    wdl_scratch_end(scratch);
 
     // Renderer
-    Renderer* rend = wdl_arena_push_no_zero(arena, sizeof(Renderer));
+    Renderer* rend = wdl_arena_push(arena, sizeof(Renderer));
     *rend = (Renderer) {
+        .arena = arena,
         .max_quad_count = max_quad_count,
-
-        .vertices = wdl_arena_push_no_zero(arena, vertices_size),
-        .vertex_buffer = vertex_buffer,
-        .vertex_array = gfx_vertex_array_new((GfxVertexArrayDesc) {
-                .layout = {
-                    .size = sizeof(Vertex),
-                    .attribs = {
-                        [0] = {
-                            .count = 2,
-                            .offset = wdl_offset(Vertex, pos),
-                        },
-                        [1] = {
-                            .count = 2,
-                            .offset = wdl_offset(Vertex, uv),
-                        },
-                        [2] = {
-                            .count = 4,
-                            .offset = wdl_offset(Vertex, color),
-                        },
-                        [3] = {
-                            .count = 1,
-                            .offset = wdl_offset(Vertex, texture_index),
-                        },
-                    },
-                    .attrib_count = 4,
-                },
-                .vertex_buffer = vertex_buffer,
-                .index_buffer = index_buffer,
-            }),
-        .shader = shader,
-        .textures[0] = gfx_texture_new((GfxTextureDesc) {
+        .multi_draw = multi_draw,
+
+        .instance_buffer = instance_buffer,
+        .instance_buffers = {instance_buffer},
+        .instance_buffer_count = 1,
+        .stream_region_count = RENDERER_MIN_STREAM_REGIONS,
+        // Instance data is pulled from the storage buffer so the vertex array
+        // has no attributes.
+        .vertex_array = gfx_vertex_array_new((GfxVertexArrayDesc) {0}),
+        .shader_permutations = shader_permutations,
+        .particle_permutations = particle_permutations,
+        .white_texture = gfx_texture_new((GfxTextureDesc) {
                 .data = (u8[]) { 255, 255, 255, 255 },
                 .size = wdl_iv2s(1),
                 .format = GFX_TEXTURE_FORMAT_RGBA_U8,
+                .opaque = true,
             }),
+        .blit = blit_init(arena),
+        .dynres = dynamic_resolution_init(desc),
+        .text_run_arenas = {wdl_arena_create(), wdl_arena_create()},
     };
+    wdl_arena_tag(rend->text_run_arenas[0], wdl_str_lit("text-runs-0"));
+    wdl_arena_tag(rend->text_run_arenas[1], wdl_str_lit("text-runs-1"));
+    // Every variant is compiled up front to avoid hitches mid-game.
+    for (u32 i = 0; i < BATCH_SHADER_COUNT; i++) {
+        GfxShader shader = gfx_shader_permutation(&rend->shader_permutations, BATCH_SHADER_FEATURES[i]);
+        gfx_shader_uniform_i32_arr(shader, wdl_str_lit("textures"), samplers, RENDERER_MAX_TEXTURE_COUNT);
+        gfx_shader_uniform_i32(shader, wdl_str_lit("lightmap"), RENDERER_LIGHTMAP_SLOT);
+        rend->shaders[i] = shader;
+    }
+    // Particle textures are never font atlases.
+    for (u32 i = 0; i < BATCH_SHADER_TEXT; i++) {
+        GfxShader shader = gfx_shader_permutation(&rend->particle_permutations, BATCH_SHADER_FEATURES[i]);
+        gfx_shader_uniform_i32_arr(shader, wdl_str_lit("textures"), samplers, RENDERER_MAX_TEXTURE_COUNT);
+        // Never enabled, but a sampler left on unit 0 would clash with
+        // 'textures[0]'.
+        gfx_shader_uniform_i32(shader, wdl_str_lit("lightmap"), RENDERER_LIGHTMAP_SLOT);
+        rend->particle_shaders[i] = shader;
+    }
+    rend->curr_shader = BATCH_SHADER_COUNT;
+    gfx_texture_set_destroy_callback(renderer_texture_destroyed, rend);
+
+    WDL_Scratch scratch = wdl_scratch_begin(&arena, 1);
+    rend->tilemap_shader = gfx_shader_new_defines(
+            read_file(scratch.arena, wdl_str_lit("assets/shaders/tilemap.vert.glsl")),
+            read_file(scratch.arena, wdl_str_lit("assets/shaders/tilemap.frag.glsl")),
+            prelude, NULL, 0);
+    gfx_shader_uniform_i32(rend->tilemap_shader, wdl_str_lit("sheet"), 0);
+    gfx_shader_uniform_i32(rend->tilemap_shader, wdl_str_lit("tileIndices"), 1);
+    gfx_shader_uniform_i32(rend->tilemap_shader, wdl_str_lit("lightmap"), RENDERER_LIGHTMAP_SLOT);
+    wdl_scratch_end(scratch);
+
+    if (multi_draw) {
+        rend->indirect_buffer = renderer_indirect_buffer_new(rend->stream_region_count);
+    }
     return rend;
 }
 
+static void render_list_init(RenderList* list, const Renderer* rend, WDL_Arena* arena) {
+    *list = (RenderList) {
+        .arena = arena,
+        .layer = RENDER_LAYER_ENTITIES,
+        .view_min = rend->view_min,
+        .view_max = rend->view_max,
+        .y_sign = rend->cam.invert_y ? -1.0f : 1.0f,
+    };
+}
+
 void renderer_begin(Renderer* rend, Camera cam) {
     rend->cam = cam;
-    rend->curr_quad = 0;
-    rend->curr_texture = 1;
+
+    f32 aspect = (f32) cam.screen_size.x / (f32) cam.screen_size.y;
+    WDL_Vec2 half_extent = wdl_v2(fabsf(aspect * cam.zoom) * 0.5f, fabsf(cam.zoom) * 0.5f);
+    WDL_Vec2 center = wdl_v2(cam.pos.x, cam.invert_y ? -cam.pos.y : cam.pos.y);
+    rend->view_min = wdl_v2_sub(center, half_extent);
+    rend->view_max = wdl_v2_add(center, half_extent);
+
+    render_list_init(&rend->list, rend, get_frame_arena());
+    rend->lightmap = (RendererLightmap) {0};
+
+    rend->pass++;
+    rend->stats = (RendererStats) {0};
 }
 
-void renderer_end(Renderer* rend) {
-    gfx_buffer_subdata(rend->vertex_buffer, rend->vertices, rend->curr_quad * 4 * sizeof(Vertex), 0);
-    for (u8 i = 0; i < rend->curr_texture; i++) {
-        gfx_texture_bind(rend->textures[i], i);
+void renderer_set_lightmap(Renderer* rend, RendererLightmap lightmap) {
+    wdl_assert(gfx_texture_is_null(lightmap.texture) || !rend->cam.invert_y, "Lightmaps can't be used with an inverted camera.");
+    if (lightmap.tile_size == 0.0f) {
+        lightmap.tile_size = 1.0f;
     }
-    gfx_shader_use(rend->shader);
-    WDL_Mat4 projection = camera_proj(rend->cam);
-    WDL_Mat4 view = camera_view(rend->cam);
-    gfx_shader_uniform_m4(rend->shader, wdl_str_lit("projection"), projection);
-    gfx_shader_uniform_m4(rend->shader, wdl_str_lit("view"), view);
-    gfx_draw_indexed(rend->vertex_array, rend->curr_quad * 6, 0);
+    rend->lightmap = lightmap;
 }
 
-void renderer_draw_quad(Renderer* rend, WDL_Vec2 pivot, WDL_Vec2 pos, WDL_Vec2 size, f32 rot, Color color) {
-    renderer_draw_quad_textured(rend, pivot, pos, size, rot, color, GFX_TEXTURE_NULL);
+void renderer_set_layer(Renderer* rend, RenderLayer layer) {
+    render_list_set_layer(&rend->list, layer);
 }
 
-void renderer_draw_quad_textured_uvs(Renderer* rend, WDL_Vec2 pivot, WDL_Vec2 pos, WDL_Vec2 size, f32 rot, Color color, GfxTexture texture, WDL_Vec2 uvs[2]) {
-    b8 texture_found = false;
-    f32 texture_index = 0;
-    if (gfx_texture_is_null(texture)) {
-        texture_found = true;
+RenderList* render_list_begin(Renderer* rend, WDL_Arena* arena) {
+    RenderList* list = wdl_arena_push_no_zero(arena, sizeof(RenderList));
+    render_list_init(list, rend, arena);
+    return list;
+}
+
+void render_list_set_layer(RenderList* list, RenderLayer layer) {
+    list->layer = layer;
+}
+
+void renderer_submit_list(Renderer* rend, RenderList* list) {
+    RenderList* dst = &rend->list;
+    dst->drawn_count += list->drawn_count;
+    dst->culled_count += list->culled_count;
+    if (list->first_chunk == NULL) {
+        return;
+    }
+
+    if (dst->last_chunk == NULL) {
+        dst->first_chunk = list->first_chunk;
     } else {
-        for (u8 i = 1; i < rend->curr_texture; i++) {
-            if (rend->textures[i].handle == texture.handle) {
-                texture_index = i;
-                texture_found = true;
-                break;
+        dst->last_chunk->next = list->first_chunk;
+    }
+    // Following commands may go into the free space of the list's last chunk
+    // but never allocate from the list's arena.
+    dst->last_chunk = list->last_chunk;
+    dst->cmd_count += list->cmd_count;
+
+    // The chunks belong to the renderer now.
+    list->first_chunk = NULL;
+    list->last_chunk = NULL;
+    list->cmd_count = 0;
+    list->drawn_count = 0;
+    list->culled_count = 0;
+}
+
+static RenderCmd* render_list_push_cmd(RenderList* list) {
+    RenderCmdChunk* chunk = list->last_chunk;
+    if (chunk == NULL || chunk->count == RENDER_CMD_CHUNK_SIZE) {
+        chunk = wdl_arena_push_no_zero(list->arena, sizeof(RenderCmdChunk));
+        chunk->next = NULL;
+        chunk->count = 0;
+        if (list->last_chunk == NULL) {
+            list->first_chunk = chunk;
+        } else {
+            list->last_chunk->next = chunk;
+        }
+        list->last_chunk = chunk;
+    }
+
+    list->cmd_count++;
+    return &chunk->cmds[chunk->count++];
+}
+
+static b8 texture_page_matches(const TexturePage* page, WDL_Ivec2 size, GfxTextureFormat format, GfxTextureSampler sampler) {
+    return page->size.x == size.x &&
+        page->size.y == size.y &&
+        page->format == format &&
+        page->sampler == sampler;
+}
+
+static GfxTexture texture_page_array_new(const TexturePage* page, u32 layer_capacity) {
+    return gfx_texture_new((GfxTextureDesc) {
+            .size = page->size,
+            .format = page->format,
+            .sampler = page->sampler,
+            .layers = layer_capacity,
+        });
+}
+
+// Returns the index of a page with a free layer, creating or growing a page if
+// needed. Returns -1 if every page is taken.
+static i32 renderer_page_alloc_layer(Renderer* rend, WDL_Ivec2 size, GfxTextureFormat format, GfxTextureSampler sampler, u16* layer) {
+    TexturePage* page = NULL;
+    TexturePage* unused = NULL;
+    for (u32 i = 0; i < rend->page_count; i++) {
+        TexturePage* curr = &rend->pages[i];
+        if (gfx_texture_is_null(curr->array)) {
+            if (unused == NULL) {
+                unused = curr;
             }
+            continue;
+        }
+        if (!curr->borrowed && texture_page_matches(curr, size, format, sampler) &&
+                (curr->reusable_count > 0 || curr->layer_count < TEXTURE_PAGE_MAX_LAYERS)) {
+            page = curr;
+            break;
         }
     }
 
-    if (rend->curr_quad == rend->max_quad_count ||
-            (rend->curr_texture == RENDERER_MAX_TEXTURE_COUNT && !texture_found)) {
-        renderer_end(rend);
-        renderer_begin(rend, rend->cam);
+    if (page == NULL) {
+        if (unused == NULL) {
+            if (rend->page_count == RENDERER_MAX_TEXTURE_PAGES) {
+                return -1;
+            }
+            unused = &rend->pages[rend->page_count++];
+            unused->free_layers = wdl_arena_push_no_zero(rend->arena, TEXTURE_PAGE_MAX_LAYERS * sizeof(u16));
+        }
+        page = unused;
+        *page = (TexturePage) {
+            .size = size,
+            .format = format,
+            .sampler = sampler,
+            .layer_capacity = TEXTURE_PAGE_INITIAL_LAYERS,
+            .free_layers = page->free_layers,
+        };
+        page->array = texture_page_array_new(page, page->layer_capacity);
     }
 
-    if (!texture_found) {
-        texture_index = rend->curr_texture;
-        rend->textures[rend->curr_texture++] = texture;
+    page->used_count++;
+    if (page->reusable_count > 0) {
+        // The last released layer takes the place of the one handed out so
+        // the reusable ones stay in front.
+        u32 i = --page->reusable_count;
+        *layer = page->free_layers[i];
+        page->free_layers[i] = page->free_layers[--page->free_count];
+        return page - rend->pages;
     }
 
-    const WDL_Vec2 vert_pos[4] = {
-        wdl_v2(-0.5f, -0.5f),
-        wdl_v2( 0.5f, -0.5f),
-        wdl_v2(-0.5f,  0.5f),
-        wdl_v2( 0.5f,  0.5f),
-    };
+    if (page->layer_count == page->layer_capacity) {
+        u32 capacity = page->layer_capacity * 2;
+        if (capacity > TEXTURE_PAGE_MAX_LAYERS) {
+            capacity = TEXTURE_PAGE_MAX_LAYERS;
+        }
+        GfxTexture array = texture_page_array_new(page, capacity);
+        gfx_texture_copy((GfxTextureCopyDesc) {
+                .src = page->array,
+                .dst = array,
+                .layer_count = page->layer_count,
+            });
+        gfx_texture_destroy(page->array);
+        page->array = array;
+        page->layer_capacity = capacity;
+    }
+
+    *layer = page->layer_count++;
+    return page - rend->pages;
+}
 
-    WDL_Vec2 nw = uvs[0];
-    WDL_Vec2 se = uvs[1];
-    const WDL_Vec2 uv[4] = {
-        wdl_v2(nw.x, se.y),
-        wdl_v2(se.x, se.y),
-        wdl_v2(nw.x, nw.y),
-        wdl_v2(se.x, nw.y),
+// Returns the index of a page borrowing 'texture' or -1 if every page is
+// taken.
+static i32 renderer_page_borrow(Renderer* rend, GfxTexture texture) {
+    TexturePage* page = NULL;
+    for (u32 i = 0; i < rend->page_count; i++) {
+        if (gfx_texture_is_null(rend->pages[i].array)) {
+            page = &rend->pages[i];
+            break;
+        }
+    }
+    if (page == NULL) {
+        if (rend->page_count == RENDERER_MAX_TEXTURE_PAGES) {
+            return -1;
+        }
+        page = &rend->pages[rend->page_count++];
+        page->free_layers = wdl_arena_push_no_zero(rend->arena, TEXTURE_PAGE_MAX_LAYERS * sizeof(u16));
+    }
+    *page = (TexturePage) {
+        .array = texture,
+        .borrowed = true,
+        .layer_count = 1,
+        .layer_capacity = 1,
+        .used_count = 1,
+        .free_layers = page->free_layers,
     };
+    return page - rend->pages;
+}
 
-    if (rend->cam.invert_y) {
-        pos.y = -pos.y;
-        pivot.y = -pivot.y;
+static void renderer_page_release_layer(Renderer* rend, u32 page_index, u16 layer) {
+    TexturePage* page = &rend->pages[page_index];
+    page->free_layers[page->free_count++] = layer;
+    page->used_count--;
+}
+
+// Makes the layers released this frame reusable and destroys the pages that
+// are no longer used.
+static void renderer_pages_next_frame(Renderer* rend) {
+    for (u32 i = 0; i < rend->page_count; i++) {
+        TexturePage* page = &rend->pages[i];
+        if (gfx_texture_is_null(page->array)) {
+            continue;
+        }
+        if (page->used_count == 0) {
+            GfxTexture array = page->array;
+            page->array = GFX_TEXTURE_NULL;
+            if (!page->borrowed) {
+                gfx_texture_destroy(array);
+            }
+            continue;
+        }
+        page->reusable_count = page->free_count;
     }
+}
 
-    pivot = wdl_v2_divs(pivot, 2.0f);
-    for (u8 i = 0; i < 4; i++) {
-        WDL_Vec2 vpos = vert_pos[i];
-        vpos = wdl_v2_sub(vpos, pivot);
-        vpos = wdl_v2_mul(vpos, size);
-        vpos = wdl_v2(vpos.x * cosf(rot) - vpos.y * sinf(rot),
-            vpos.x * sinf(rot) + vpos.y * cosf(rot));
-        vpos = wdl_v2_add(vpos, pos);
-
-        rend->vertices[rend->curr_quad * 4 + i] = (Vertex) {
-            .pos = vpos,
-            .uv = uv[i],
-            .color = color,
-            .texture_index = texture_index,
-        };
+static PageEntry* renderer_find_page_entry(Renderer* rend, u32 id) {
+    PageEntry* block = rend->page_entries[id / PAGE_ENTRY_BLOCK_SIZE];
+    if (block == NULL) {
+        return NULL;
     }
+    return &block[id % PAGE_ENTRY_BLOCK_SIZE];
+}
 
-    rend->curr_quad++;
+// Set as the texture destroy callback so the layer of a destroyed texture is
+// reused.
+static void renderer_texture_destroyed(GfxTexture texture, void* user_data) {
+    Renderer* rend = user_data;
+    u32 id = gfx_texture_get_id(texture);
+    if (id > SORT_KEY_TEXTURE_MASK) {
+        return;
+    }
+    PageEntry* entry = renderer_find_page_entry(rend, id);
+    if (entry == NULL) {
+        return;
+    }
+    if (entry->page != 0) {
+        renderer_page_release_layer(rend, entry->page - 1, entry->layer);
+    }
+    *entry = (PageEntry) {0};
 }
 
-void renderer_draw_quad_textured(Renderer* rend, WDL_Vec2 pivot, WDL_Vec2 pos, WDL_Vec2 size, f32 rot, Color color, GfxTexture texture) {
-    renderer_draw_quad_textured_uvs(rend, pivot, pos, size, rot, color, texture, (WDL_Vec2[2]) {wdl_v2s(0.0f), wdl_v2s(1.0f)});
+// Makes sure an up to date copy of 'texture' is resident in a page. O(1) unless
+// the texture is new or its content changed since it was last drawn. The
+// returned page is 0 if the texture couldn't be made resident, in which case
+// it isn't drawn.
+static PageEntry renderer_resolve_texture(Renderer* rend, GfxTexture texture) {
+    u32 id = gfx_texture_get_id(texture);
+    wdl_assert(id <= SORT_KEY_TEXTURE_MASK, "Texture id out of range.");
+    PageEntry** block = &rend->page_entries[id / PAGE_ENTRY_BLOCK_SIZE];
+    if (*block == NULL) {
+        *block = wdl_arena_push(rend->arena, PAGE_ENTRY_BLOCK_SIZE * sizeof(PageEntry));
+    }
+    PageEntry* entry = &(*block)[id % PAGE_ENTRY_BLOCK_SIZE];
+    if (entry->pass != rend->pass) {
+        entry->pass = rend->pass;
+        rend->stats.unique_textures++;
+    }
+
+    // Borrowed pages sample the texture itself so they're always up to date.
+    if (entry->page == 0 && gfx_texture_get_layers(texture) > 0) {
+        i32 page = renderer_page_borrow(rend, texture);
+        if (page == -1) {
+            if (!rend->pages_exhausted) {
+                wdl_error("Out of texture pages, textures that don't fit aren't drawn.");
+                rend->pages_exhausted = true;
+            }
+            return *entry;
+        }
+        entry->page = page + 1;
+        entry->layer = 0;
+    }
+    if (entry->page != 0 && rend->pages[entry->page - 1].borrowed) {
+        return *entry;
+    }
+
+    u32 version = gfx_texture_get_version(texture);
+    if (entry->page != 0 && entry->version == version) {
+        return *entry;
+    }
+
+    // Textures can be resized, e.g. font atlases, in which case they move to
+    // another page.
+    WDL_Ivec2 size = gfx_texture_get_size(texture);
+    GfxTextureFormat format = gfx_texture_get_format(texture);
+    GfxTextureSampler sampler = gfx_texture_get_sampler(texture);
+    if (entry->page == 0 || !texture_page_matches(&rend->pages[entry->page - 1], size, format, sampler)) {
+        if (entry->page != 0) {
+            renderer_page_release_layer(rend, entry->page - 1, entry->layer);
+            entry->page = 0;
+        }
+        i32 page = renderer_page_alloc_layer(rend, size, format, sampler, &entry->layer);
+        if (page == -1) {
+            if (!rend->pages_exhausted) {
+                wdl_error("Out of texture pages, textures that don't fit aren't drawn.");
+                rend->pages_exhausted = true;
+            }
+            return *entry;
+        }
+        entry->page = page + 1;
+    }
+
+    gfx_texture_copy((GfxTextureCopyDesc) {
+            .src = texture,
+            .dst = rend->pages[entry->page - 1].array,
+            .dst_layer = entry->layer,
+        });
+    entry->version = version;
+    rend->stats.texture_copies++;
+    return *entry;
 }
 
-void renderer_draw_sprite(Renderer* rend, WDL_Vec2 pivot, WDL_Vec2 pos, WDL_Vec2 size, f32 rot, Color color, Sprite sprite) {
-    WDL_Vec2 sheet_size = wdl_iv2_to_v2(gfx_texture_get_size(sprite.sheet));
-    WDL_Vec2 bl = wdl_iv2_to_v2(sprite.pos);
-    bl = wdl_v2_div(bl, sheet_size);
-    WDL_Vec2 tl = wdl_iv2_to_v2(wdl_iv2_add(sprite.pos, sprite.size));
-    tl = wdl_v2_div(tl, sheet_size);
-    renderer_draw_quad_textured_uvs(rend, pivot, pos, size, rot, color, sprite.sheet, (WDL_Vec2[2]) {bl, tl});
+// Returns the slot of 'page' in the current batch or -1 if the batch has run
+// out of texture slots.
+static i32 renderer_batch_page_slot(Renderer* rend, u32 page_index) {
+    TexturePage* page = &rend->pages[page_index];
+    if (page->batch == rend->batch) {
+        return page->slot;
+    }
+
+    if (rend->curr_texture == RENDERER_MAX_TEXTURE_COUNT) {
+        return -1;
+    }
+    page->batch = rend->batch;
+    page->slot = rend->curr_texture;
+    rend->batch_pages[rend->curr_texture] = page_index;
+    return rend->curr_texture++;
 }
 
-void renderer_draw_text(Renderer* rend, WDL_Str text, Font* font, WDL_Vec2 pivot, WDL_Vec2 pos, Color color) {
-    Camera cam = rend->cam;
-    f32 aspect = (f32) cam.screen_size.x / (f32) cam.screen_size.y;
+// Begins a region in the first instance ring that doesn't have to wait on the
+// GPU, chaining a new ring if all of them are busy. Only blocks once the chain
+// is full. The ring is bound to storage binding 0.
+static Instance* renderer_stream_begin(Renderer* rend, u64* region_offset) {
+    u32 index = rend->curr_instance_buffer;
+    b8 ready = false;
+    for (u32 i = 0; i < rend->instance_buffer_count; i++) {
+        index = (rend->curr_instance_buffer + i) % rend->instance_buffer_count;
+        if (gfx_buffer_stream_ready(rend->instance_buffers[index])) {
+            ready = true;
+            break;
+        }
+    }
+    if (!ready) {
+        if (rend->instance_buffer_count < RENDERER_MAX_INSTANCE_BUFFERS) {
+            index = rend->instance_buffer_count++;
+            rend->instance_buffers[index] = renderer_instance_buffer_new(rend->max_quad_count, rend->stream_region_count);
+        } else {
+            index = rend->curr_instance_buffer;
+        }
+    }
+
+    rend->curr_instance_buffer = index;
+    rend->instance_buffer = rend->instance_buffers[index];
+    rend->frame_instance_regions++;
+    gfx_buffer_bind_storage(rend->instance_buffer, 0);
+    return gfx_buffer_stream_begin(rend->instance_buffer, region_offset);
+}
 
-    WDL_Vec2 text_size = font_measure_string(font, text);
+static void renderer_particle_buffer_resize(Renderer* rend, u32 capacity);
 
-    FontMetrics metrics = font_get_metrics(font);
-    WDL_Vec2 _pos = wdl_v2(0.0f, metrics.ascent);
-    pivot = wdl_v2_divs(pivot, 2.0f);
-    if (!cam.invert_y) {
-        pivot.y = -pivot.y;
+// Replaces the instance rings with a single one of the new capacity, and
+// every other ring if the region count changed. Rings still read by the GPU
+// are kept alive by the driver until it's done.
+static void renderer_resize(Renderer* rend, u32 max_quad_count, u32 region_count) {
+    for (u32 i = 0; i < rend->instance_buffer_count; i++) {
+        gfx_buffer_destroy(rend->instance_buffers[i]);
+    }
+    b8 regions_changed = region_count != rend->stream_region_count;
+    rend->max_quad_count = max_quad_count;
+    rend->stream_region_count = region_count;
+    rend->instance_buffer = renderer_instance_buffer_new(max_quad_count, region_count);
+    rend->instance_buffers[0] = rend->instance_buffer;
+    rend->instance_buffer_count = 1;
+    rend->curr_instance_buffer = 0;
+
+    if (!regions_changed) {
+        return;
+    }
+    if (rend->multi_draw) {
+        gfx_buffer_destroy(rend->indirect_buffer);
+        rend->indirect_buffer = renderer_indirect_buffer_new(region_count);
+    }
+    if (!gfx_buffer_is_null(rend->particle_buffer)) {
+        renderer_particle_buffer_resize(rend, rend->particle_capacity);
     }
-    _pos.x -= text_size.x * (pivot.x + 0.5f);
-    _pos.y -= text_size.y * (pivot.y + 0.5f);
+}
 
-    GfxTexture atlas = font_get_atlas(font);
-    for (u64 i = 0; i < text.len; i++) {
-        Glyph glyph = font_get_glyph(font, text.data[i]);
-        WDL_Vec2 gpos = _pos;
-        gpos = wdl_v2_add(gpos, glyph.offset);
-        gpos.x /= cam.screen_size.x;
-        gpos.y /= cam.screen_size.y;
-        gpos.x *= cam.zoom * aspect;
-        gpos.y *= cam.zoom;
-
-        WDL_Vec2 gpivot = wdl_v2s(-1.0f);
-        if (!cam.invert_y) {
-            gpos.y = -gpos.y;
-            gpivot.y = -gpivot.y;
-        }
-
-        gpos = wdl_v2_add(gpos, pos);
-
-        WDL_Vec2 size = glyph.size;
-        size.x /= cam.screen_size.x;
-        size.y /= cam.screen_size.y;
-        size.x *= cam.zoom * aspect;
-        size.y *= cam.zoom;
-        renderer_draw_quad_textured_uvs(rend,
-            gpivot,
-            gpos,
-            size,
-            0.0f,
-            color,
-            atlas,
-            glyph.uv);
-        _pos.x += glyph.advance;
-        if (i > 0) {
-            pos.x += font_get_kerning(font, text.data[i - 1], text.data[i]);
+static void renderer_use_shader(Renderer* rend, BatchShader shader) {
+    rend->curr_shader = shader;
+    rend->shader = rend->shaders[shader];
+    gfx_shader_use(rend->shader);
+}
+
+static void renderer_flush_batch(Renderer* rend, u64 region_offset, u32 quad_count) {
+    for (u8 i = 0; i < rend->curr_texture; i++) {
+        gfx_texture_bind(rend->pages[rend->batch_pages[i]].array, i);
+    }
+    rend->stats.texture_binds += rend->curr_texture;
+    if (quad_count > 0) {
+        u32 first_instance = region_offset / sizeof(Instance);
+        gfx_draw_instanced(rend->vertex_array, 6, quad_count, first_instance);
+        rend->stats.batches++;
+        rend->stats.draw_calls++;
+        rend->stats.uploaded_bytes += quad_count * sizeof(Instance);
+    }
+    gfx_buffer_stream_end(rend->instance_buffer);
+
+    rend->batch++;
+    rend->curr_texture = 0;
+}
+
+// -- Sprite batch --
+//
+// Retained instances living in their own storage buffer. Sprites are kept
+// packed by swapping the last sprite into the slot of a removed one, and only
+// the slots touched since the last draw are uploaded.
+//
+
+#define SPRITE_BATCH_MAX_DIRTY_RANGES 8
+
+// Range of dirty sprite slots, 'end' is exclusive.
+typedef struct DirtyRange DirtyRange;
+struct DirtyRange {
+    u32 begin;
+    u32 end;
+};
+
+struct SpriteBatch {
+    GfxTexture texture;
+    GfxBuffer buffer;
+    u32 capacity;
+    u32 count;
+
+    Instance* instances;
+    // Sprite handle -> slot in 'instances' and back.
+    u32* slot_of_sprite;
+    u32* sprite_of_slot;
+    // Free sprite handles.
+    u32* free_sprites;
+    u32 free_count;
+    u32 next_sprite;
+
+    DirtyRange dirty[SPRITE_BATCH_MAX_DIRTY_RANGES];
+    u32 dirty_count;
+
+    // Sprites with a color alpha below 1. The batch is only drawn in the
+    // opaque pass if there's none.
+    u32 translucent_count;
+
+    // Location the instances were last written with. Rewritten when the
+    // texture moves to another page layer.
+    PageEntry entry;
+};
+
+static void sprite_batch_mark_dirty(SpriteBatch* batch, u32 slot) {
+    for (u32 i = 0; i < batch->dirty_count; i++) {
+        DirtyRange* range = &batch->dirty[i];
+        if (slot + 1 >= range->begin && slot <= range->end) {
+            if (slot < range->begin) {
+                range->begin = slot;
+            }
+            if (slot + 1 > range->end) {
+                range->end = slot + 1;
+            }
+            return;
         }
     }
+
+    if (batch->dirty_count < SPRITE_BATCH_MAX_DIRTY_RANGES) {
+        batch->dirty[batch->dirty_count++] = (DirtyRange) { slot, slot + 1 };
+        return;
+    }
+
+    // Out of ranges, merge everything into one.
+    DirtyRange merged = { slot, slot + 1 };
+    for (u32 i = 0; i < batch->dirty_count; i++) {
+        if (batch->dirty[i].begin < merged.begin) {
+            merged.begin = batch->dirty[i].begin;
+        }
+        if (batch->dirty[i].end > merged.end) {
+            merged.end = batch->dirty[i].end;
+        }
+    }
+    batch->dirty[0] = merged;
+    batch->dirty_count = 1;
+}
+
+// Uploads the dirty ranges. O(changes) unless the texture moved. Returns false
+// if the texture couldn't be made resident.
+static b8 sprite_batch_sync(Renderer* rend, SpriteBatch* batch) {
+    GfxTexture texture = batch->texture;
+    if (gfx_texture_is_null(texture)) {
+        texture = rend->white_texture;
+    }
+    PageEntry entry = renderer_resolve_texture(rend, texture);
+    if (entry.page == 0) {
+        return false;
+    }
+    if (entry.page != batch->entry.page || entry.layer != batch->entry.layer) {
+        for (u32 i = 0; i < batch->count; i++) {
+            batch->instances[i].texture = INSTANCE_TEXTURE(0, entry.layer);
+        }
+        batch->entry = entry;
+        batch->dirty[0] = (DirtyRange) { 0, batch->count };
+        batch->dirty_count = 1;
+    }
+
+    for (u32 i = 0; i < batch->dirty_count; i++) {
+        DirtyRange range = batch->dirty[i];
+        if (range.end > batch->count) {
+            range.end = batch->count;
+        }
+        if (range.begin >= range.end) {
+            continue;
+        }
+        gfx_buffer_subdata(batch->buffer,
+                &batch->instances[range.begin],
+                (range.end - range.begin) * sizeof(Instance),
+                range.begin * sizeof(Instance));
+        rend->stats.uploaded_bytes += (range.end - range.begin) * sizeof(Instance);
+    }
+    batch->dirty_count = 0;
+    return true;
+}
+
+// Draws the whole batch with a single instanced draw. The instances are
+// stored with the depth of their slot so the depth of the batch is passed as
+// an offset.
+static void renderer_draw_sprite_batch_now(Renderer* rend, SpriteBatch* batch, u32 depth) {
+    if (!sprite_batch_sync(rend, batch) || batch->count == 0) {
+        return;
+    }
+
+    renderer_use_shader(rend, batch_shader_for_texture(batch->texture));
+    gfx_texture_bind(rend->pages[batch->entry.page - 1].array, 0);
+    gfx_buffer_bind_storage(batch->buffer, 0);
+    gfx_shader_uniform_i32(rend->shader, wdl_str_lit("depthOffset"), depth);
+    gfx_draw_instanced(rend->vertex_array, 6, batch->count, 0);
+    gfx_shader_uniform_i32(rend->shader, wdl_str_lit("depthOffset"), 0);
+    rend->stats.sprite_batches++;
+    rend->stats.draw_calls++;
+    rend->stats.texture_binds++;
+}
+
+// -- Particles --
+//
+// The live range of 'pos_x', 'pos_y' and 'life' is copied back to back into
+// a region of the particle ring, so a region holds 'particle_capacity'
+// particles.
+//
+
+static void renderer_particle_buffer_resize(Renderer* rend, u32 capacity) {
+    if (!gfx_buffer_is_null(rend->particle_buffer)) {
+        gfx_buffer_destroy(rend->particle_buffer);
+    }
+    rend->particle_capacity = capacity;
+    rend->particle_buffer = gfx_buffer_new((GfxBufferDesc) {
+            .size = capacity * 3 * sizeof(f32),
+            .data = NULL,
+            .usage = GFX_BUFFER_USAGE_STREAM_RING,
+            .region_count = rend->stream_region_count,
+        });
+}
+
+// Draws the whole system with a single instanced draw at 'depth'.
+static void renderer_draw_particles_now(Renderer* rend, ParticleSystem* particles, u32 depth) {
+    u32 count = particles->count;
+    if (count == 0) {
+        return;
+    }
+
+    if (count > rend->particle_capacity) {
+        u32 capacity = rend->particle_capacity;
+        if (capacity == 0) {
+            capacity = RENDERER_MIN_PARTICLE_CAPACITY;
+        }
+        while (capacity < count) {
+            capacity *= 2;
+        }
+        renderer_particle_buffer_resize(rend, capacity);
+    }
+
+    const ParticleSystemDesc* desc = &particles->desc;
+    BatchShader variant = batch_shader_for_texture(desc->texture);
+    GfxShader shader = rend->particle_shaders[variant];
+    if (variant != BATCH_SHADER_COLOR) {
+        PageEntry entry = renderer_resolve_texture(rend, desc->texture);
+        if (entry.page == 0) {
+            return;
+        }
+        gfx_texture_bind(rend->pages[entry.page - 1].array, 0);
+        gfx_shader_uniform_i32(shader, wdl_str_lit("layer"), entry.layer);
+        rend->stats.texture_binds++;
+    }
+
+    u64 region_offset;
+    u8* region = gfx_buffer_stream_begin(rend->particle_buffer, &region_offset);
+    rend->frame_particle_regions++;
+    memcpy(region, particles->pos_x, count * sizeof(f32));
+    memcpy(region + count * sizeof(f32), particles->pos_y, count * sizeof(f32));
+    memcpy(region + 2 * count * sizeof(f32), particles->life, count * sizeof(f32));
+    gfx_buffer_bind_storage(rend->particle_buffer, 0);
+
+    gfx_shader_uniform_i32(shader, wdl_str_lit("depthOffset"), depth);
+    gfx_shader_uniform_i32(shader, wdl_str_lit("particleBase"), region_offset / sizeof(f32));
+    gfx_shader_uniform_i32(shader, wdl_str_lit("particleCount"), count);
+    gfx_shader_uniform_f32(shader, wdl_str_lit("ySign"), rend->cam.invert_y ? -1.0f : 1.0f);
+    gfx_shader_uniform_v2(shader, wdl_str_lit("sizes"), wdl_v2(desc->size_start, desc->size_end));
+    gfx_shader_uniform_color(shader, wdl_str_lit("colorStart"), desc->color_start);
+    gfx_shader_uniform_color(shader, wdl_str_lit("colorEnd"), desc->color_end);
+    gfx_draw_instanced(rend->vertex_array, 6, count, 0);
+    gfx_buffer_stream_end(rend->particle_buffer);
+
+    // Setting the uniforms bound the particle program.
+    rend->curr_shader = BATCH_SHADER_COUNT;
+    rend->stats.particles += count;
+    rend->stats.draw_calls++;
+    rend->stats.uploaded_bytes += count * 3 * sizeof(f32);
+}
+
+// -- Tilemap --
+//
+// The tile indices are kept on the CPU as well so edits can be read back and
+// uploaded per chunk. Every chunk tracks the tiles changed since the last
+// draw and how many of its tiles aren't empty, empty chunks are never drawn.
+//
+
+typedef struct TilemapChunk TilemapChunk;
+struct TilemapChunk {
+    u32 tile_count;
+    b8 dirty;
+    // Changed tiles in map coordinates, max is exclusive.
+    WDL_Ivec2 dirty_min;
+    WDL_Ivec2 dirty_max;
+};
+
+struct Tilemap {
+    WDL_Ivec2 size;
+    WDL_Vec2 origin;
+    f32 tile_size;
+    GfxTexture sheet;
+
+    u16* indices;
+    // GFX_TEXTURE_FORMAT_R_U16_INT copy of 'indices'.
+    GfxTexture index_texture;
+    // Pixel region of every tile as four floats, see 'tilemap.frag.glsl'.
+    GfxBuffer tile_buffer;
+
+    WDL_Ivec2 chunk_count;
+    TilemapChunk* chunks;
+};
+
+// Uploads the changed tiles of every dirty chunk.
+static void tilemap_sync(Renderer* rend, Tilemap* tilemap) {
+    u32 chunk_count = tilemap->chunk_count.x * tilemap->chunk_count.y;
+    for (u32 i = 0; i < chunk_count; i++) {
+        TilemapChunk* chunk = &tilemap->chunks[i];
+        if (!chunk->dirty) {
+            continue;
+        }
+        chunk->dirty = false;
+
+        // Rows of the region are packed since the texture is uploaded with
+        // the row length of the region.
+        WDL_Ivec2 size = wdl_iv2(chunk->dirty_max.x - chunk->dirty_min.x, chunk->dirty_max.y - chunk->dirty_min.y);
+        WDL_Scratch scratch = wdl_scratch_begin(NULL, 0);
+        u16* region = wdl_arena_push_no_zero(scratch.arena, size.x * size.y * sizeof(u16));
+        for (i32 y = 0; y < size.y; y++) {
+            const u16* row = &tilemap->indices[chunk->dirty_min.x + (chunk->dirty_min.y + y) * tilemap->size.x];
+            memcpy(&region[y * size.x], row, size.x * sizeof(u16));
+        }
+        gfx_texture_subdata(tilemap->index_texture, (GfxTextureSubDataDesc) {
+                .data = region,
+                .size = size,
+                .pos = chunk->dirty_min,
+                .format = GFX_TEXTURE_FORMAT_R_U16_INT,
+                .alignment = 2,
+            });
+        rend->stats.uploaded_bytes += size.x * size.y * sizeof(u16);
+        wdl_scratch_end(scratch);
+    }
+}
+
+// Draws every visible, non-empty chunk as one quad at 'depth'.
+static void renderer_draw_tilemap_now(Renderer* rend, Tilemap* tilemap, u32 depth) {
+    tilemap_sync(rend, tilemap);
+
+    // Tilemaps ignore 'Camera.invert_y' so the view is flipped back.
+    WDL_Vec2 view_min = rend->view_min;
+    WDL_Vec2 view_max = rend->view_max;
+    if (rend->cam.invert_y) {
+        view_min.y = -rend->view_max.y;
+        view_max.y = -rend->view_min.y;
+    }
+    f32 chunk_world_size = TILEMAP_CHUNK_SIZE * tilemap->tile_size;
+    WDL_Vec2 first = wdl_v2_divs(wdl_v2_sub(view_min, tilemap->origin), chunk_world_size);
+    WDL_Vec2 last = wdl_v2_divs(wdl_v2_sub(view_max, tilemap->origin), chunk_world_size);
+    i32 min_x = wdl_clamp((i32) floorf(first.x), 0, tilemap->chunk_count.x);
+    i32 min_y = wdl_clamp((i32) floorf(first.y), 0, tilemap->chunk_count.y);
+    i32 max_x = wdl_clamp((i32) floorf(last.x) + 1, 0, tilemap->chunk_count.x);
+    i32 max_y = wdl_clamp((i32) floorf(last.y) + 1, 0, tilemap->chunk_count.y);
+    if (min_x >= max_x || min_y >= max_y) {
+        return;
+    }
+
+    GfxShader shader = rend->tilemap_shader;
+    gfx_texture_bind(tilemap->sheet, 0);
+    gfx_texture_bind(tilemap->index_texture, 1);
+    gfx_buffer_bind_storage(tilemap->tile_buffer, 0);
+    gfx_shader_uniform_i32(shader, wdl_str_lit("depthOffset"), depth);
+    gfx_shader_uniform_v2(shader, wdl_str_lit("origin"), tilemap->origin);
+    gfx_shader_uniform_f32(shader, wdl_str_lit("tileSize"), tilemap->tile_size);
+    rend->stats.texture_binds += 2;
+
+    for (i32 y = min_y; y < max_y; y++) {
+        for (i32 x = min_x; x < max_x; x++) {
+            if (tilemap->chunks[x + y * tilemap->chunk_count.x].tile_count == 0) {
+                continue;
+            }
+
+            WDL_Ivec2 chunk_min = wdl_iv2(x * TILEMAP_CHUNK_SIZE, y * TILEMAP_CHUNK_SIZE);
+            WDL_Ivec2 chunk_max = wdl_iv2_add(chunk_min, wdl_iv2s(TILEMAP_CHUNK_SIZE));
+            chunk_max.x = wdl_clamp(chunk_max.x, 0, tilemap->size.x);
+            chunk_max.y = wdl_clamp(chunk_max.y, 0, tilemap->size.y);
+            gfx_shader_uniform_v2(shader, wdl_str_lit("chunkMin"), wdl_iv2_to_v2(chunk_min));
+            gfx_shader_uniform_v2(shader, wdl_str_lit("chunkMax"), wdl_iv2_to_v2(chunk_max));
+            gfx_draw(rend->vertex_array, 6, 0);
+            rend->stats.tilemap_chunks++;
+            rend->stats.draw_calls++;
+        }
+    }
+
+    // Setting the uniforms bound the tilemap program.
+    rend->curr_shader = BATCH_SHADER_COUNT;
+}
+
+// -- Multi-draw --
+//
+// Batches are only split when a ring region is full. Each full region becomes
+// one indirect draw and the next region is opened without fencing the
+// previous one, so the whole run goes out with a single
+// 'glMultiDrawArraysIndirect()'. Texture slots are shared by every draw of the
+// run so no per-draw texture table is needed.
+//
+
+typedef struct MultiDraw MultiDraw;
+struct MultiDraw {
+    Instance* instances;
+    u64 region_offset;
+    u32 quad_count;
+    // Quads in the closed regions.
+    u32 total_quad_count;
+
+    GfxDrawIndirectCommand* draws;
+    u64 draws_offset;
+    u32 draw_count;
+};
+
+static void multi_draw_begin(Renderer* rend, MultiDraw* md) {
+    md->instances = renderer_stream_begin(rend, &md->region_offset);
+    md->quad_count = 0;
+    md->total_quad_count = 0;
+    md->draws = gfx_buffer_stream_begin(rend->indirect_buffer, &md->draws_offset);
+    md->draw_count = 0;
+    rend->batch++;
+    rend->curr_texture = 0;
+}
+
+static void multi_draw_close_region(MultiDraw* md) {
+    if (md->quad_count == 0) {
+        return;
+    }
+    md->draws[md->draw_count++] = (GfxDrawIndirectCommand) {
+        .vertex_count = 6,
+        .instance_count = md->quad_count,
+        .first_vertex = 0,
+        .first_instance = md->region_offset / sizeof(Instance),
+    };
+    md->total_quad_count += md->quad_count;
+}
+
+static void multi_draw_submit(Renderer* rend, MultiDraw* md) {
+    multi_draw_close_region(md);
+    for (u8 i = 0; i < rend->curr_texture; i++) {
+        gfx_texture_bind(rend->pages[rend->batch_pages[i]].array, i);
+    }
+    rend->stats.texture_binds += rend->curr_texture;
+    if (md->draw_count > 0) {
+        gfx_draw_instanced_indirect(rend->vertex_array, rend->indirect_buffer, md->draws_offset, md->draw_count);
+        rend->stats.batches += md->draw_count;
+        rend->stats.draw_calls++;
+        rend->stats.uploaded_bytes += md->total_quad_count * sizeof(Instance) +
+            md->draw_count * sizeof(GfxDrawIndirectCommand);
+    }
+    gfx_buffer_stream_end(rend->instance_buffer);
+    gfx_buffer_stream_end(rend->indirect_buffer);
+}
+
+// Same as 'renderer_draw_cmds()' but with a single draw call per run.
+static void renderer_multi_draw_cmds(Renderer* rend, RenderCmd** cmds, const SortItem* items, const u32* depths, const u32* order, u32 count) {
+    if (count == 0) {
+        return;
+    }
+
+    MultiDraw md;
+    multi_draw_begin(rend, &md);
+    for (u32 i = 0; i < count; i++) {
+        u32 depth = depths[order[i]];
+        RenderCmd* cmd = cmds[items[order[i]].index];
+        if (cmd->sprite_batch != NULL) {
+            rend->stats.flushes.sprite_batch++;
+            multi_draw_submit(rend, &md);
+            renderer_draw_sprite_batch_now(rend, cmd->sprite_batch, depth);
+            multi_draw_begin(rend, &md);
+            continue;
+        }
+        if (cmd->particles != NULL) {
+            rend->stats.flushes.particles++;
+            multi_draw_submit(rend, &md);
+            renderer_draw_particles_now(rend, cmd->particles, depth);
+            multi_draw_begin(rend, &md);
+            continue;
+        }
+        if (cmd->tilemap != NULL) {
+            rend->stats.flushes.tilemap++;
+            multi_draw_submit(rend, &md);
+            renderer_draw_tilemap_now(rend, cmd->tilemap, depth);
+            multi_draw_begin(rend, &md);
+            continue;
+        }
+
+        BatchShader shader = render_cmd_shader(cmd);
+        if (shader != rend->curr_shader) {
+            if (md.quad_count > 0 || md.draw_count > 0) {
+                rend->stats.flushes.shader++;
+                multi_draw_submit(rend, &md);
+                multi_draw_begin(rend, &md);
+            }
+            renderer_use_shader(rend, shader);
+        }
+
+        // Untextured quads don't take up a texture slot.
+        PageEntry entry = {0};
+        i32 slot = 0;
+        if (shader != BATCH_SHADER_COLOR) {
+            entry = renderer_resolve_texture(rend, cmd->texture);
+            if (entry.page == 0) {
+                continue;
+            }
+            slot = renderer_batch_page_slot(rend, entry.page - 1);
+        }
+        if (slot == -1) {
+            rend->stats.flushes.texture_slots++;
+            multi_draw_submit(rend, &md);
+            multi_draw_begin(rend, &md);
+            slot = renderer_batch_page_slot(rend, entry.page - 1);
+        } else if (md.quad_count == rend->max_quad_count) {
+            if (md.draw_count + 1 == rend->stream_region_count / 2) {
+                rend->stats.flushes.full++;
+                multi_draw_submit(rend, &md);
+                multi_draw_begin(rend, &md);
+                if (shader != BATCH_SHADER_COLOR) {
+                    slot = renderer_batch_page_slot(rend, entry.page - 1);
+                }
+            } else {
+                multi_draw_close_region(&md);
+                md.instances = gfx_buffer_stream_next(rend->instance_buffer, &md.region_offset);
+                md.quad_count = 0;
+                rend->frame_instance_regions++;
+            }
+        }
+
+        md.instances[md.quad_count] = cmd->instance;
+        md.instances[md.quad_count].texture = INSTANCE_TEXTURE(slot, entry.layer);
+        md.instances[md.quad_count].depth = depth;
+        md.quad_count++;
+    }
+    multi_draw_submit(rend, &md);
+}
+
+static b8 renderer_cmd_is_opaque(const RenderCmd* cmd) {
+    // Particles usually fade out, so they're always blended.
+    if (cmd->particles != NULL) {
+        return false;
+    }
+    GfxTexture texture = cmd->texture;
+    b8 texture_opaque = gfx_texture_is_null(texture) || gfx_texture_is_opaque(texture);
+    if (cmd->sprite_batch != NULL) {
+        return texture_opaque && cmd->sprite_batch->translucent_count == 0;
+    }
+    // Empty tiles are discarded, so only the sheet matters.
+    if (cmd->tilemap != NULL) {
+        return texture_opaque;
+    }
+    return texture_opaque && (cmd->instance.color >> 24) == 0xff;
+}
+
+// Draws the commands at the sorted positions in 'order', in that order, at
+// the depths of those positions in 'depths'.
+// Batches are only split when the region is full or the batch runs out of
+// texture slots.
+static void renderer_draw_cmds(Renderer* rend, RenderCmd** cmds, const SortItem* items, const u32* depths, const u32* order, u32 count) {
+    if (count == 0) {
+        return;
+    }
+
+    u64 region_offset;
+    Instance* instances = renderer_stream_begin(rend, &region_offset);
+    u32 quad_count = 0;
+    rend->batch++;
+    rend->curr_texture = 0;
+    for (u32 i = 0; i < count; i++) {
+        u32 depth = depths[order[i]];
+        RenderCmd* cmd = cmds[items[order[i]].index];
+        if (cmd->sprite_batch != NULL) {
+            rend->stats.flushes.sprite_batch++;
+            renderer_flush_batch(rend, region_offset, quad_count);
+            renderer_draw_sprite_batch_now(rend, cmd->sprite_batch, depth);
+            instances = renderer_stream_begin(rend, &region_offset);
+            quad_count = 0;
+            continue;
+        }
+        if (cmd->particles != NULL) {
+            rend->stats.flushes.particles++;
+            renderer_flush_batch(rend, region_offset, quad_count);
+            renderer_draw_particles_now(rend, cmd->particles, depth);
+            instances = renderer_stream_begin(rend, &region_offset);
+            quad_count = 0;
+            continue;
+        }
+        if (cmd->tilemap != NULL) {
+            rend->stats.flushes.tilemap++;
+            renderer_flush_batch(rend, region_offset, quad_count);
+            renderer_draw_tilemap_now(rend, cmd->tilemap, depth);
+            instances = renderer_stream_begin(rend, &region_offset);
+            quad_count = 0;
+            continue;
+        }
+
+        BatchShader shader = render_cmd_shader(cmd);
+        if (shader != rend->curr_shader) {
+            if (quad_count > 0) {
+                rend->stats.flushes.shader++;
+                renderer_flush_batch(rend, region_offset, quad_count);
+                instances = renderer_stream_begin(rend, &region_offset);
+                quad_count = 0;
+            }
+            renderer_use_shader(rend, shader);
+        }
+
+        // Untextured quads don't take up a texture slot.
+        PageEntry entry = {0};
+        i32 slot = 0;
+        if (shader != BATCH_SHADER_COLOR) {
+            entry = renderer_resolve_texture(rend, cmd->texture);
+            if (entry.page == 0) {
+                continue;
+            }
+            slot = renderer_batch_page_slot(rend, entry.page - 1);
+        }
+        if (slot == -1 || quad_count == rend->max_quad_count) {
+            if (slot == -1) {
+                rend->stats.flushes.texture_slots++;
+            } else {
+                rend->stats.flushes.full++;
+            }
+            renderer_flush_batch(rend, region_offset, quad_count);
+            instances = renderer_stream_begin(rend, &region_offset);
+            quad_count = 0;
+            if (shader != BATCH_SHADER_COLOR) {
+                slot = renderer_batch_page_slot(rend, entry.page - 1);
+            }
+        }
+
+        instances[quad_count] = cmd->instance;
+        instances[quad_count].texture = INSTANCE_TEXTURE(slot, entry.layer);
+        instances[quad_count].depth = depth;
+        quad_count++;
+    }
+    renderer_flush_batch(rend, region_offset, quad_count);
+}
+
+static void renderer_stats_add(RendererStats* dst, const RendererStats* src) {
+    dst->quads += src->quads;
+    dst->culled_quads += src->culled_quads;
+    dst->text_glyphs += src->text_glyphs;
+    dst->sprite_batches += src->sprite_batches;
+    dst->particles += src->particles;
+    dst->tilemap_chunks += src->tilemap_chunks;
+    dst->batches += src->batches;
+    dst->draw_calls += src->draw_calls;
+    dst->flushes.full += src->flushes.full;
+    dst->flushes.texture_slots += src->flushes.texture_slots;
+    dst->flushes.sprite_batch += src->flushes.sprite_batch;
+    dst->flushes.particles += src->flushes.particles;
+    dst->flushes.tilemap += src->flushes.tilemap;
+    dst->flushes.shader += src->flushes.shader;
+    dst->uploaded_bytes += src->uploaded_bytes;
+    dst->unique_textures += src->unique_textures;
+    dst->texture_binds += src->texture_binds;
+    dst->texture_copies += src->texture_copies;
+}
+
+static void renderer_end_stats(Renderer* rend) {
+    RendererStats* stats = &rend->stats;
+    stats->quads = rend->list.drawn_count;
+    stats->culled_quads = rend->list.culled_count;
+    renderer_stats_add(&rend->frame_stats, stats);
+
+    prof_counter(wdl_str_lit("Renderer quads"), stats->quads);
+    prof_counter(wdl_str_lit("Renderer culled quads"), stats->culled_quads);
+    prof_counter(wdl_str_lit("Renderer text glyphs"), stats->text_glyphs);
+    prof_counter(wdl_str_lit("Renderer particles"), stats->particles);
+    prof_counter(wdl_str_lit("Renderer tilemap chunks"), stats->tilemap_chunks);
+    prof_counter(wdl_str_lit("Renderer batches"), stats->batches);
+    prof_counter(wdl_str_lit("Renderer draw calls"), stats->draw_calls);
+    prof_counter(wdl_str_lit("Renderer full flushes"), stats->flushes.full);
+    prof_counter(wdl_str_lit("Renderer texture slot flushes"), stats->flushes.texture_slots);
+    prof_counter(wdl_str_lit("Renderer sprite batch flushes"), stats->flushes.sprite_batch);
+    prof_counter(wdl_str_lit("Renderer particle flushes"), stats->flushes.particles);
+    prof_counter(wdl_str_lit("Renderer tilemap flushes"), stats->flushes.tilemap);
+    prof_counter(wdl_str_lit("Renderer shader flushes"), stats->flushes.shader);
+    prof_counter(wdl_str_lit("Renderer uploaded bytes"), stats->uploaded_bytes);
+    prof_counter(wdl_str_lit("Renderer unique textures"), stats->unique_textures);
+    prof_counter(wdl_str_lit("Renderer texture binds"), stats->texture_binds);
+    prof_counter(wdl_str_lit("Renderer texture copies"), stats->texture_copies);
+}
+
+void renderer_end(Renderer* rend) {
+    if (rend->list.cmd_count == 0) {
+        renderer_end_stats(rend);
+        return;
+    }
+
+    WDL_Scratch scratch = wdl_scratch_begin(NULL, 0);
+
+    // Flatten the queue. The flat index is the submission order which becomes
+    // the depth of layers drawn in painter's order.
+    u32 count = rend->list.cmd_count;
+    RenderCmd** cmds = wdl_arena_push_no_zero(scratch.arena, count * sizeof(RenderCmd*));
+    SortItem* items = wdl_arena_push_no_zero(scratch.arena, count * sizeof(SortItem));
+    SortItem* temp = wdl_arena_push_no_zero(scratch.arena, count * sizeof(SortItem));
+    u32 index = 0;
+    for (RenderCmdChunk* chunk = rend->list.first_chunk; chunk != NULL; chunk = chunk->next) {
+        for (u32 i = 0; i < chunk->count; i++) {
+            RenderCmd* cmd = &chunk->cmds[i];
+            u64 key = cmd->key;
+            RenderLayer layer = key >> SORT_KEY_LAYER_SHIFT;
+            if (render_layer_is_ordered(layer)) {
+                key |= (u64) index << SORT_KEY_DEPTH_SHIFT;
+            }
+            cmds[index] = cmd;
+            items[index] = (SortItem) {
+                .key = key,
+                .index = index,
+            };
+            index++;
+        }
+    }
+    items = radix_sort(items, temp, count);
+
+    // Every command gets the depth of its sorted position, except sprite
+    // batches which get one per sprite so sprites overlapping within a batch
+    // keep their slot order in the opaque pass too. Tilemap chunks never
+    // overlap and particles are always blended, so they take a single depth.
+    u32* depths = wdl_arena_push_no_zero(scratch.arena, count * sizeof(u32));
+    u32 depth_count = 0;
+    for (u32 i = 0; i < count; i++) {
+        depths[i] = depth_count;
+        SpriteBatch* batch = cmds[items[i].index]->sprite_batch;
+        depth_count += batch != NULL && batch->count > 0 ? batch->count : 1;
+    }
+    wdl_assert(depth_count < RENDERER_MAX_DEPTH, "Too many draws in a single renderer pass.");
+
+    // Split the sorted commands into opaque ones, front to back, followed by
+    // translucent ones, back to front.
+    u32* order = wdl_arena_push_no_zero(scratch.arena, count * sizeof(u32));
+    b8* opaque = wdl_arena_push_no_zero(scratch.arena, count * sizeof(b8));
+    u32 opaque_count = 0;
+    for (u32 i = count; i-- > 0;) {
+        opaque[i] = renderer_cmd_is_opaque(cmds[items[i].index]);
+        if (opaque[i]) {
+            order[opaque_count++] = i;
+        }
+    }
+    u32 translucent_count = opaque_count;
+    for (u32 i = 0; i < count; i++) {
+        if (!opaque[i]) {
+            order[translucent_count++] = i;
+        }
+    }
+    translucent_count -= opaque_count;
+
+    u32 pass_quads[2] = {0};
+    for (u32 i = 0; i < count; i++) {
+        RenderCmd* cmd = cmds[items[i].index];
+        if (cmd->sprite_batch == NULL && cmd->particles == NULL && cmd->tilemap == NULL) {
+            pass_quads[opaque[i]]++;
+        }
+    }
+    u32 quad_count = pass_quads[0] > pass_quads[1] ? pass_quads[0] : pass_quads[1];
+    if (quad_count > rend->quad_high_water) {
+        rend->quad_high_water = quad_count;
+    }
+
+    WDL_Mat4 projection = camera_proj(rend->cam);
+    WDL_Mat4 view = camera_view(rend->cam);
+    for (u32 i = 0; i < BATCH_SHADER_COUNT; i++) {
+        gfx_shader_uniform_m4(rend->shaders[i], wdl_str_lit("projection"), projection);
+        gfx_shader_uniform_m4(rend->shaders[i], wdl_str_lit("view"), view);
+        gfx_shader_uniform_i32(rend->shaders[i], wdl_str_lit("depthOffset"), 0);
+    }
+    for (u32 i = 0; i < BATCH_SHADER_TEXT; i++) {
+        gfx_shader_uniform_m4(rend->particle_shaders[i], wdl_str_lit("projection"), projection);
+        gfx_shader_uniform_m4(rend->particle_shaders[i], wdl_str_lit("view"), view);
+    }
+    gfx_shader_uniform_m4(rend->tilemap_shader, wdl_str_lit("projection"), projection);
+    gfx_shader_uniform_m4(rend->tilemap_shader, wdl_str_lit("view"), view);
+
+    // Particles keep 'lightmapEnabled' at its default of 0.
+    RendererLightmap lightmap = rend->lightmap;
+    b8 lit = !gfx_texture_is_null(lightmap.texture);
+    WDL_Vec2 lightmap_scale = wdl_v2s(0.0f);
+    if (lit) {
+        WDL_Ivec2 lightmap_size = gfx_texture_get_size(lightmap.texture);
+        lightmap_scale = wdl_v2(1.0f / (lightmap_size.x * lightmap.tile_size), 1.0f / (lightmap_size.y * lightmap.tile_size));
+        gfx_texture_bind(lightmap.texture, RENDERER_LIGHTMAP_SLOT);
+        rend->stats.texture_binds++;
+    }
+    for (u32 i = 0; i <= BATCH_SHADER_COUNT; i++) {
+        GfxShader shader = i < BATCH_SHADER_COUNT ? rend->shaders[i] : rend->tilemap_shader;
+        gfx_shader_uniform_i32(shader, wdl_str_lit("lightmapEnabled"), lit);
+        if (lit) {
+            gfx_shader_uniform_v2(shader, wdl_str_lit("lightmapOrigin"), lightmap.origin);
+            gfx_shader_uniform_v2(shader, wdl_str_lit("lightmapScale"), lightmap_scale);
+            gfx_shader_uniform_f32(shader, wdl_str_lit("lightmapAmbient"), lightmap.ambient);
+        }
+    }
+    // Setting the uniforms binds the programs, the passes bind the variant
+    // of their first command.
+    rend->curr_shader = BATCH_SHADER_COUNT;
+
+    void (*pass)(Renderer*, RenderCmd**, const SortItem*, const u32*, const u32*, u32) = renderer_draw_cmds;
+    if (rend->multi_draw) {
+        pass = renderer_multi_draw_cmds;
+    }
+
+    // Opaque quads are drawn without blending and closest first, so the depth
+    // test rejects everything hidden behind them before it's shaded.
+    gfx_clear_depth();
+    gfx_blend(false);
+    gfx_depth_test(true, true);
+    pass(rend, cmds, items, depths, order, opaque_count);
+
+    // Translucent quads are blended in painter's order on top, still tested
+    // against the opaque depth.
+    gfx_blend(true);
+    gfx_depth_test(true, false);
+    pass(rend, cmds, items, depths, order + opaque_count, translucent_count);
+
+    gfx_depth_test(false, true);
+
+    renderer_end_stats(rend);
+    wdl_scratch_end(scratch);
+}
+
+// cos(0) = 1, sin(0) = 0 packed as snorm16x2.
+#define ROTATION_IDENTITY 0x00007fff
+
+static u32 pack_rotation(f32 rot) {
+    if (rot == 0.0f) {
+        return ROTATION_IDENTITY;
+    }
+    i16 c = (i16) lroundf(cosf(rot) * 32767.0f);
+    i16 s = (i16) lroundf(sinf(rot) * 32767.0f);
+    return (u16) c | (u32) (u16) s << 16;
+}
+
+#ifdef __SSE2__
+// Scales four values in [0, 1] to [0, max] and rounds them to integers.
+static __m128i quantize_unorm_x4(__m128 v, f32 max) {
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    v = _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(max)), _mm_set1_ps(0.5f));
+    return _mm_cvttps_epi32(v);
+}
+#endif
+
+static void pack_uvs(const WDL_Vec2 uvs[2], u32* uv_min, u32* uv_max) {
+#ifdef __SSE2__
+    __m128i q = quantize_unorm_x4(_mm_setr_ps(uvs[0].x, uvs[0].y, uvs[1].x, uvs[1].y), 65535.0f);
+    // SSE2 only has a signed 32 -> 16 bit pack so bias into the signed range
+    // and back.
+    q = _mm_sub_epi32(q, _mm_set1_epi32(32768));
+    q = _mm_packs_epi32(q, q);
+    q = _mm_add_epi16(q, _mm_set1_epi16((i16) 0x8000));
+    *uv_min = _mm_cvtsi128_si32(q);
+    *uv_max = _mm_cvtsi128_si32(_mm_srli_si128(q, 4));
+#else
+    *uv_min = (u32) (wdl_clamp(uvs[0].x, 0.0f, 1.0f) * 65535.0f + 0.5f) |
+        (u32) (wdl_clamp(uvs[0].y, 0.0f, 1.0f) * 65535.0f + 0.5f) << 16;
+    *uv_max = (u32) (wdl_clamp(uvs[1].x, 0.0f, 1.0f) * 65535.0f + 0.5f) |
+        (u32) (wdl_clamp(uvs[1].y, 0.0f, 1.0f) * 65535.0f + 0.5f) << 16;
+#endif
+}
+
+static u32 pack_color(Color color) {
+#ifdef __SSE2__
+    __m128i q = quantize_unorm_x4(_mm_loadu_ps(&color.r), 255.0f);
+    q = _mm_packs_epi32(q, q);
+    q = _mm_packus_epi16(q, q);
+    return _mm_cvtsi128_si32(q);
+#else
+    return color_pack_rgba8(color);
+#endif
+}
+
+static Instance instance_from_quad(const QuadInstance* quad, f32 y_sign) {
+    Instance inst = {
+        .pos = wdl_v2(quad->pos.x, quad->pos.y * y_sign),
+        .size = quad->size,
+        .pivot = wdl_v2(quad->pivot.x * 0.5f, quad->pivot.y * 0.5f * y_sign),
+        .rotation = pack_rotation(quad->rotation),
+        .color = pack_color(quad->color),
+    };
+    pack_uvs(quad->uvs, &inst.uv_min, &inst.uv_max);
+    return inst;
+}
+
+// Conservative test against the camera. Axis aligned quads are tested with
+// their exact bounds, rotated quads with the circle around the rotation origin
+// enclosing every corner.
+static b8 render_list_quad_visible(const RenderList* list, const QuadInstance* quad) {
+    f32 y_sign = list->y_sign;
+    WDL_Vec2 pos = wdl_v2(quad->pos.x, quad->pos.y * y_sign);
+    WDL_Vec2 pivot = wdl_v2(quad->pivot.x * 0.5f, quad->pivot.y * 0.5f * y_sign);
+    WDL_Vec2 size = quad->size;
+
+    WDL_Vec2 center;
+    WDL_Vec2 half_extent;
+    if (quad->rotation == 0.0f) {
+        center = wdl_v2(pos.x - pivot.x * size.x, pos.y - pivot.y * size.y);
+        half_extent = wdl_v2(fabsf(size.x) * 0.5f, fabsf(size.y) * 0.5f);
+    } else {
+        f32 rx = (fabsf(pivot.x) + 0.5f) * fabsf(size.x);
+        f32 ry = (fabsf(pivot.y) + 0.5f) * fabsf(size.y);
+        f32 radius = sqrtf(rx * rx + ry * ry);
+        center = pos;
+        half_extent = wdl_v2s(radius);
+    }
+
+    return center.x + half_extent.x >= list->view_min.x &&
+        center.x - half_extent.x <= list->view_max.x &&
+        center.y + half_extent.y >= list->view_min.y &&
+        center.y - half_extent.y <= list->view_max.y;
+}
+
+// 'shader' is picked from the texture of each quad when BATCH_SHADER_COUNT.
+static void render_list_record_quads(RenderList* list, const QuadInstance* quads, u32 count, BatchShader shader) {
+    u64 layer_key = (u64) list->layer << SORT_KEY_LAYER_SHIFT;
+    b8 shader_from_texture = shader == BATCH_SHADER_COUNT;
+    if (shader_from_texture) {
+        shader = batch_shader_for_texture(GFX_TEXTURE_NULL);
+    }
+
+    // Runs of quads usually share a texture, e.g. glyphs and tiles.
+    GfxTexture last_texture = GFX_TEXTURE_NULL;
+    u64 texture_key = 0;
+    u64 shader_key = (u64) shader << SORT_KEY_SHADER_SHIFT;
+
+    for (u32 i = 0; i < count; i++) {
+        const QuadInstance* quad = &quads[i];
+        if (!render_list_quad_visible(list, quad)) {
+            list->culled_count++;
+            continue;
+        }
+        list->drawn_count++;
+
+        if (quad->texture.handle != last_texture.handle) {
+            last_texture = quad->texture;
+            texture_key = gfx_texture_get_id(last_texture) & SORT_KEY_TEXTURE_MASK;
+            if (shader_from_texture) {
+                shader_key = (u64) batch_shader_for_texture(last_texture) << SORT_KEY_SHADER_SHIFT;
+            }
+        }
+
+        RenderCmd* cmd = render_list_push_cmd(list);
+        cmd->key = layer_key | shader_key | texture_key;
+        cmd->texture = quad->texture;
+        cmd->sprite_batch = NULL;
+        cmd->particles = NULL;
+        cmd->tilemap = NULL;
+        cmd->instance = instance_from_quad(quad, list->y_sign);
+    }
+}
+
+void render_list_draw_quads(RenderList* list, const QuadInstance* quads, u32 count) {
+    render_list_record_quads(list, quads, count, BATCH_SHADER_COUNT);
+}
+
+void renderer_draw_quads(Renderer* rend, const QuadInstance* quads, u32 count) {
+    render_list_draw_quads(&rend->list, quads, count);
+}
+
+void renderer_draw_quad(Renderer* rend, WDL_Vec2 pivot, WDL_Vec2 pos, WDL_Vec2 size, f32 rot, Color color) {
+    renderer_draw_quad_textured(rend, pivot, pos, size, rot, color, GFX_TEXTURE_NULL);
+}
+
+void renderer_draw_quad_textured_uvs(Renderer* rend, WDL_Vec2 pivot, WDL_Vec2 pos, WDL_Vec2 size, f32 rot, Color color, GfxTexture texture, WDL_Vec2 uvs[2]) {
+    QuadInstance quad = {
+        .pos = pos,
+        .size = size,
+        .pivot = pivot,
+        .rotation = rot,
+        .color = color,
+        .texture = texture,
+        .uvs = {uvs[0], uvs[1]},
+    };
+    renderer_draw_quads(rend, &quad, 1);
+}
+
+void renderer_draw_quad_textured(Renderer* rend, WDL_Vec2 pivot, WDL_Vec2 pos, WDL_Vec2 size, f32 rot, Color color, GfxTexture texture) {
+    renderer_draw_quad_textured_uvs(rend, pivot, pos, size, rot, color, texture, (WDL_Vec2[2]) {wdl_v2s(0.0f), wdl_v2s(1.0f)});
+}
+
+void sprite_get_uvs(Sprite sprite, WDL_Vec2 uvs[2]) {
+    WDL_Vec2 sheet_size = wdl_iv2_to_v2(gfx_texture_get_size(sprite.sheet));
+    WDL_Vec2 bl = wdl_iv2_to_v2(sprite.pos);
+    uvs[0] = wdl_v2_div(bl, sheet_size);
+    WDL_Vec2 tl = wdl_iv2_to_v2(wdl_iv2_add(sprite.pos, sprite.size));
+    uvs[1] = wdl_v2_div(tl, sheet_size);
+}
+
+Sprite sprite_from_texture(GfxTexture texture) {
+    return (Sprite) {
+        .sheet = texture,
+        .pos = wdl_iv2s(0),
+        .size = gfx_texture_get_size(texture),
+    };
+}
+
+Sprite sprite_trim(Sprite sprite) {
+    sprite.trimmed = asset_texture_trim(sprite.sheet, sprite.pos, sprite.size, &sprite.trim_pos, &sprite.trim_size);
+    return sprite;
+}
+
+void renderer_draw_sprite(Renderer* rend, WDL_Vec2 pivot, WDL_Vec2 pos, WDL_Vec2 size, f32 rot, Color color, Sprite sprite) {
+    if (!sprite.trimmed) {
+        WDL_Vec2 uvs[2];
+        sprite_get_uvs(sprite, uvs);
+        renderer_draw_quad_textured_uvs(rend, pivot, pos, size, rot, color, sprite.sheet, uvs);
+        return;
+    }
+    if (sprite.trim_size.x == 0 || sprite.trim_size.y == 0) {
+        return;
+    }
+
+    // Fraction of the region covered by the trimmed rect, with v pointing
+    // down like the texture rows.
+    WDL_Vec2 u = wdl_v2((f32) sprite.trim_pos.x / sprite.size.x, (f32) (sprite.trim_pos.x + sprite.trim_size.x) / sprite.size.x);
+    WDL_Vec2 v = wdl_v2((f32) sprite.trim_pos.y / sprite.size.y, (f32) (sprite.trim_pos.y + sprite.trim_size.y) / sprite.size.y);
+    WDL_Vec2 trimmed_size = wdl_v2(size.x * (u.y - u.x), size.y * (v.y - v.x));
+
+    // Left and bottom edge of the trimmed rect relative to 'pos', then the
+    // pivot putting the smaller quad in the same spot so rotation still
+    // happens around 'pos'.
+    f32 left = (u.x - (pivot.x + 1.0f) * 0.5f) * size.x;
+    f32 bottom = ((1.0f - v.y) - (pivot.y + 1.0f) * 0.5f) * size.y;
+    WDL_Vec2 trimmed_pivot = wdl_v2(-2.0f * left / trimmed_size.x - 1.0f, -2.0f * bottom / trimmed_size.y - 1.0f);
+
+    Sprite region = {
+        .sheet = sprite.sheet,
+        .pos = wdl_iv2_add(sprite.pos, sprite.trim_pos),
+        .size = sprite.trim_size,
+    };
+    WDL_Vec2 uvs[2];
+    sprite_get_uvs(region, uvs);
+    renderer_draw_quad_textured_uvs(rend, trimmed_pivot, pos, trimmed_size, rot, color, sprite.sheet, uvs);
+}
+
+// -- Text runs --
+//
+// Laid out strings are cached in a hashmap living in the arena of the current
+// generation, which lasts TEXT_RUN_GENERATION_FRAMES frames. A hit in the
+// current generation returns the cached run as is. Runs of the previous
+// generation are copied over the first time they're drawn in the current
+// one, everything else is dropped when the arena of the previous generation
+// is reused. So a string drawn every frame is copied once per generation and
+// the cache only holds the strings drawn in the last two generations.
+//
+
+static u64 hash_str(WDL_Str str) {
+    // FNV-1a
+    u64 hash = 0xcbf29ce484222325;
+    for (u64 i = 0; i < str.len; i++) {
+        hash ^= (u8) str.data[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+static b8 str_equal(WDL_Str a, WDL_Str b) {
+    return a.len == b.len && memcmp(a.data, b.data, a.len) == 0;
+}
+
+static WDL_Str str_copy(WDL_Arena* arena, WDL_Str str) {
+    u8* data = wdl_arena_push_no_zero(arena, str.len);
+    memcpy(data, str.data, str.len);
+    return (WDL_Str) {
+        .data = data,
+        .len = str.len,
+    };
+}
+
+static TextRun* text_run_copy(WDL_Arena* arena, const TextRun* run) {
+    TextRun* copy = wdl_arena_push_no_zero(arena, sizeof(TextRun));
+    *copy = *run;
+    copy->text = str_copy(arena, run->text);
+    copy->glyphs = wdl_arena_push_no_zero(arena, run->glyph_count * sizeof(TextRunGlyph));
+    memcpy(copy->glyphs, run->glyphs, run->glyph_count * sizeof(TextRunGlyph));
+    return copy;
+}
+
+// Lays out 'text' in font pixels with the origin in the top left corner.
+static TextRun* text_run_layout(WDL_Arena* arena, Font* font, WDL_Str text) {
+    TextRun* run = wdl_arena_push_no_zero(arena, sizeof(TextRun));
+    // Captured before any glyph is added so an atlas expansion caused by this
+    // layout invalidates it.
+    u32 generation = font_get_atlas_generation(font);
+    FontMetrics metrics = font_get_metrics(font);
+    *run = (TextRun) {
+        .text = str_copy(arena, text),
+        .atlas_generation = generation,
+        .extent = wdl_v2(0.0f, metrics.ascent - metrics.descent),
+        .glyph_count = text.len,
+        .glyphs = wdl_arena_push_no_zero(arena, text.len * sizeof(TextRunGlyph)),
+    };
+
+    f32 pen = 0.0f;
+    for (u64 i = 0; i < text.len; i++) {
+        if (i > 0) {
+            pen += font_get_kerning(font, text.data[i - 1], text.data[i]);
+        }
+
+        Glyph glyph = font_get_glyph(font, text.data[i]);
+        run->glyphs[i] = (TextRunGlyph) {
+            .offset = wdl_v2(pen + glyph.offset.x, metrics.ascent + glyph.offset.y),
+            .size = glyph.size,
+            .uv = {glyph.uv[0], glyph.uv[1]},
+        };
+
+        if (i < text.len - 1) {
+            pen += glyph.advance;
+        } else {
+            pen += glyph.size.x;
+        }
+    }
+    run->extent.x = pen;
+
+    return run;
+}
+
+static const TextRun* renderer_get_text_run(Renderer* rend, Font* font, WDL_Str text) {
+    WDL_Arena* arena = rend->text_run_arenas[rend->text_run_generation];
+    if (rend->text_runs == NULL) {
+        rend->text_runs = wdl_hm_new(wdl_hm_desc_generic(arena, 64, TextRunKey, TextRun*));
+    }
+
+    TextRunKey key = {
+        .hash = hash_str(text),
+        .font = font,
+        .size = font_get_size(font),
+    };
+    u32 generation = font_get_atlas_generation(font);
+
+    TextRun** cached = wdl_hm_getp(rend->text_runs, key);
+    if (cached != NULL && (*cached)->atlas_generation == generation && str_equal((*cached)->text, text)) {
+        return *cached;
+    }
+
+    TextRun* run = NULL;
+    if (rend->prev_text_runs != NULL) {
+        TextRun** prev = wdl_hm_getp(rend->prev_text_runs, key);
+        if (prev != NULL && (*prev)->atlas_generation == generation && str_equal((*prev)->text, text)) {
+            run = text_run_copy(arena, *prev);
+        }
+    }
+    if (run == NULL) {
+        run = text_run_layout(arena, font, text);
+    }
+
+    if (cached != NULL) {
+        *cached = run;
+    } else {
+        wdl_hm_insert(rend->text_runs, key, run);
+    }
+    return run;
+}
+
+// -- Dynamic resolution --
+
+// Frame time grows roughly with the pixel count, i.e. the square of the
+// scale. Over budget frames lower the scale right away, it's only raised
+// again in small steps once the frame time has stayed within budget for a
+// while. With vsync the frame time never drops below the refresh interval, so
+// staying within budget is all that can be measured.
+static void dynamic_resolution_update(DynamicResolution* dr, f32 frame_time) {
+    if (!dr->enabled || frame_time <= 0.0f) {
+        return;
+    }
+
+    if (frame_time > dr->target_frame_time * 1.1f) {
+        f32 factor = sqrtf(dr->target_frame_time / frame_time);
+        if (factor < 0.85f) {
+            factor = 0.85f;
+        }
+        dr->scale *= factor;
+        dr->cooldown = DYNAMIC_RESOLUTION_COOLDOWN;
+    } else if (dr->cooldown > 0) {
+        dr->cooldown--;
+    } else {
+        dr->scale += DYNAMIC_RESOLUTION_GROW_STEP;
+    }
+    dr->scale = wdl_clamp(dr->scale, dr->min_scale, 1.0f);
+}
+
+void renderer_begin_scaled(Renderer* rend) {
+    DynamicResolution* dr = &rend->dynres;
+    if (!dr->enabled) {
+        return;
+    }
+
+    WDL_Ivec2 screen_size = get_screen_size();
+    if (screen_size.x < 1) {
+        screen_size.x = 1;
+    }
+    if (screen_size.y < 1) {
+        screen_size.y = 1;
+    }
+    if (screen_size.x != dr->size.x || screen_size.y != dr->size.y) {
+        dr->size = screen_size;
+        gfx_texture_resize(dr->color, (GfxTextureDesc) {
+                .size = dr->size,
+                .format = GFX_TEXTURE_FORMAT_RGBA_U8,
+                .sampler = GFX_TEXTURE_SAMPLER_LINEAR,
+            });
+        gfx_texture_resize(dr->depth, (GfxTextureDesc) {
+                .size = dr->size,
+                .format = GFX_TEXTURE_FORMAT_DEPTH_F32,
+            });
+    }
+
+    dr->scaled_size = wdl_iv2(dr->size.x * dr->scale + 0.5f, dr->size.y * dr->scale + 0.5f);
+    if (dr->scaled_size.x < 1) {
+        dr->scaled_size.x = 1;
+    }
+    if (dr->scaled_size.y < 1) {
+        dr->scaled_size.y = 1;
+    }
+    gfx_framebuffer_bind(dr->framebuffer);
+    gfx_viewport(dr->scaled_size);
+}
+
+void renderer_end_scaled(Renderer* rend) {
+    DynamicResolution* dr = &rend->dynres;
+    if (!dr->enabled) {
+        return;
+    }
+
+    gfx_framebuffer_unbind();
+    gfx_viewport(dr->size);
+
+    WDL_Vec2 uv_scale = wdl_v2((f32) dr->scaled_size.x / dr->size.x, (f32) dr->scaled_size.y / dr->size.y);
+    gfx_blend(false);
+    blit_draw(&rend->blit, dr->color, uv_scale);
+    gfx_blend(true);
+}
+
+f32 renderer_get_resolution_scale(const Renderer* rend) {
+    return rend->dynres.scale;
+}
+
+// -- Cached layers --
+
+struct CachedLayer {
+    b8 dirty;
+    WDL_Ivec2 size;
+    GfxTexture color;
+    // The renderer relies on depth testing for opaque quads.
+    GfxTexture depth;
+    GfxFramebuffer framebuffer;
+    // Restored by 'cached_layer_end()'.
+    GfxFramebuffer prev_framebuffer;
+    WDL_Ivec2 prev_viewport;
+};
+
+CachedLayer* cached_layer_new(WDL_Arena* arena) {
+    CachedLayer* layer = wdl_arena_push(arena, sizeof(CachedLayer));
+    *layer = (CachedLayer) {
+        .dirty = true,
+        .size = wdl_iv2s(1),
+        // Drawn 1:1 so nearest sampling is enough.
+        .color = gfx_texture_new((GfxTextureDesc) {
+                .size = wdl_iv2s(1),
+                .format = GFX_TEXTURE_FORMAT_RGBA_U8,
+                .sampler = GFX_TEXTURE_SAMPLER_NEAREST,
+            }),
+        .depth = gfx_texture_new((GfxTextureDesc) {
+                .size = wdl_iv2s(1),
+                .format = GFX_TEXTURE_FORMAT_DEPTH_F32,
+            }),
+        .framebuffer = gfx_framebuffer_new(),
+    };
+    gfx_framebuffer_attach(layer->framebuffer, layer->color, 0);
+    gfx_framebuffer_attach_depth(layer->framebuffer, layer->depth);
+    return layer;
+}
+
+void cached_layer_mark_dirty(CachedLayer* layer) {
+    layer->dirty = true;
+}
+
+b8 cached_layer_begin(CachedLayer* layer, WDL_Ivec2 size) {
+    if (size.x < 1 || size.y < 1) {
+        return false;
+    }
+    if (size.x != layer->size.x || size.y != layer->size.y) {
+        layer->size = size;
+        gfx_texture_resize(layer->color, (GfxTextureDesc) {
+                .size = size,
+                .format = GFX_TEXTURE_FORMAT_RGBA_U8,
+                .sampler = GFX_TEXTURE_SAMPLER_NEAREST,
+            });
+        gfx_texture_resize(layer->depth, (GfxTextureDesc) {
+                .size = size,
+                .format = GFX_TEXTURE_FORMAT_DEPTH_F32,
+            });
+        layer->dirty = true;
+    }
+    if (!layer->dirty) {
+        return false;
+    }
+
+    layer->prev_framebuffer = gfx_framebuffer_get_bound();
+    layer->prev_viewport = gfx_get_viewport();
+    gfx_framebuffer_bind(layer->framebuffer);
+    gfx_viewport(size);
+    gfx_clear(COLOR_TRANSPARENT);
+    return true;
+}
+
+void cached_layer_end(CachedLayer* layer) {
+    if (gfx_framebuffer_is_null(layer->prev_framebuffer)) {
+        gfx_framebuffer_unbind();
+    } else {
+        gfx_framebuffer_bind(layer->prev_framebuffer);
+    }
+    gfx_viewport(layer->prev_viewport);
+    layer->dirty = false;
+}
+
+GfxTexture cached_layer_get_texture(const CachedLayer* layer) {
+    return layer->color;
+}
+
+void renderer_draw_cached_layer(Renderer* rend, const CachedLayer* layer) {
+    // The layer holds premultiplied colors, the blending set up by
+    // 'gfx_init()' composites it as is.
+    blit_draw(&rend->blit, layer->color, wdl_v2s(1.0f));
+}
+
+// -- Frame --
+
+static void renderer_next_frame(Renderer* rend, f32 frame_time) {
+    dynamic_resolution_update(&rend->dynres, frame_time);
+    renderer_pages_next_frame(rend);
+
+    rend->text_run_age++;
+    if (rend->text_run_age == TEXT_RUN_GENERATION_FRAMES) {
+        // The arena of the generation before the previous one is reused.
+        rend->text_run_age = 0;
+        rend->text_run_generation ^= 1;
+        wdl_arena_clear(rend->text_run_arenas[rend->text_run_generation]);
+        rend->prev_text_runs = rend->text_runs;
+        rend->text_runs = NULL;
+    }
+
+    rend->prev_frame_stats = rend->frame_stats;
+    rend->stats_history[rend->stats_frame % RENDERER_STATS_WINDOW] = rend->frame_stats;
+    rend->stats_frame++;
+    rend->frame_stats = (RendererStats) {0};
+
+    u32 frame_regions = rend->frame_instance_regions;
+    if (rend->frame_particle_regions > frame_regions) {
+        frame_regions = rend->frame_particle_regions;
+    }
+    if (frame_regions > rend->region_high_water) {
+        rend->region_high_water = frame_regions;
+    }
+    rend->frame_instance_regions = 0;
+    rend->frame_particle_regions = 0;
+
+    // Smallest power of two holding the busiest frame for every frame in
+    // flight.
+    u32 needed_regions = RENDERER_MIN_STREAM_REGIONS;
+    while (needed_regions < rend->region_high_water * RENDERER_FRAMES_IN_FLIGHT &&
+            needed_regions < GFX_BUFFER_MAX_STREAM_REGIONS) {
+        needed_regions *= 2;
+    }
+
+    // Grow right away so the next frame isn't split into extra batches or
+    // waits on the GPU, but only shrink after a whole window of light frames.
+    rend->window_frame++;
+    u32 capacity = rend->max_quad_count;
+    u32 region_count = rend->stream_region_count;
+    if (rend->quad_high_water > capacity || needed_regions > region_count) {
+        while (capacity < rend->quad_high_water && capacity < RENDERER_MAX_QUAD_CAPACITY) {
+            capacity *= 2;
+        }
+        if (needed_regions > region_count) {
+            region_count = needed_regions;
+        }
+    } else if (rend->window_frame >= RENDERER_CAPACITY_WINDOW) {
+        while (capacity > RENDERER_MIN_QUAD_CAPACITY && rend->quad_high_water <= capacity / 4) {
+            capacity /= 2;
+        }
+        region_count = needed_regions;
+    } else {
+        return;
+    }
+
+    rend->quad_high_water = 0;
+    rend->region_high_water = 0;
+    rend->window_frame = 0;
+    if (capacity != rend->max_quad_count || region_count != rend->stream_region_count) {
+        renderer_resize(rend, capacity, region_count);
+    }
+}
+
+static void renderer_terminate(Renderer* rend) {
+    wdl_arena_destroy(rend->text_run_arenas[0]);
+    wdl_arena_destroy(rend->text_run_arenas[1]);
+}
+
+void renderer_draw_text(Renderer* rend, WDL_Str text, Font* font, WDL_Vec2 pivot, WDL_Vec2 pos, Color color) {
+    if (text.len == 0) {
+        return;
+    }
+
+    Camera cam = rend->cam;
+    f32 aspect = (f32) cam.screen_size.x / (f32) cam.screen_size.y;
+    // Font pixels to camera units.
+    WDL_Vec2 scale = wdl_v2(cam.zoom * aspect / cam.screen_size.x, cam.zoom / cam.screen_size.y);
+
+    const TextRun* run = renderer_get_text_run(rend, font, text);
+
+    pivot = wdl_v2_divs(pivot, 2.0f);
+    if (!cam.invert_y) {
+        pivot.y = -pivot.y;
+    }
+    WDL_Vec2 origin = wdl_v2(-run->extent.x * (pivot.x + 0.5f), -run->extent.y * (pivot.y + 0.5f));
+
+    WDL_Vec2 gpivot = wdl_v2s(-1.0f);
+    f32 y_sign = 1.0f;
+    if (!cam.invert_y) {
+        gpivot.y = -gpivot.y;
+        y_sign = -1.0f;
+    }
+
+    WDL_Arena* frame_arena = get_frame_arena();
+    WDL_Scratch scratch = wdl_scratch_begin(&frame_arena, 1);
+    QuadInstance* quads = wdl_arena_push_no_zero(scratch.arena, run->glyph_count * sizeof(QuadInstance));
+
+    GfxTexture atlas = font_get_atlas(font);
+    for (u32 i = 0; i < run->glyph_count; i++) {
+        const TextRunGlyph* glyph = &run->glyphs[i];
+        WDL_Vec2 gpos = wdl_v2_add(origin, glyph->offset);
+        quads[i] = (QuadInstance) {
+            .pos = wdl_v2(pos.x + gpos.x * scale.x, pos.y + gpos.y * scale.y * y_sign),
+            .size = wdl_v2_mul(glyph->size, scale),
+            .pivot = gpivot,
+            .color = color,
+            .texture = atlas,
+            .uvs = {glyph->uv[0], glyph->uv[1]},
+        };
+    }
+    render_list_record_quads(&rend->list, quads, run->glyph_count, BATCH_SHADER_TEXT);
+    rend->stats.text_glyphs += run->glyph_count;
+
+    wdl_scratch_end(scratch);
+}
+
+void renderer_draw_glyphs(Renderer* rend, const QuadInstance* quads, u32 count) {
+    render_list_record_quads(&rend->list, quads, count, BATCH_SHADER_TEXT);
+    rend->stats.text_glyphs += count;
+}
+
+// -- Sprite batch --
+
+SpriteBatch* sprite_batch_new(WDL_Arena* arena, GfxTexture texture, u32 capacity) {
+    SpriteBatch* batch = wdl_arena_push(arena, sizeof(SpriteBatch));
+    *batch = (SpriteBatch) {
+        .texture = texture,
+        .buffer = gfx_buffer_new((GfxBufferDesc) {
+                .size = capacity * sizeof(Instance),
+                .data = NULL,
+                .usage = GFX_BUFFER_USAGE_DYNAMIC,
+            }),
+        .capacity = capacity,
+        .instances = wdl_arena_push_no_zero(arena, capacity * sizeof(Instance)),
+        .slot_of_sprite = wdl_arena_push_no_zero(arena, capacity * sizeof(u32)),
+        .sprite_of_slot = wdl_arena_push_no_zero(arena, capacity * sizeof(u32)),
+        .free_sprites = wdl_arena_push_no_zero(arena, capacity * sizeof(u32)),
+    };
+    return batch;
+}
+
+u32 sprite_batch_add(SpriteBatch* batch, QuadInstance quad) {
+    wdl_assert(batch->count < batch->capacity, "Sprite batch is full.");
+
+    u32 sprite;
+    if (batch->free_count > 0) {
+        sprite = batch->free_sprites[--batch->free_count];
+    } else {
+        sprite = batch->next_sprite++;
+    }
+
+    u32 slot = batch->count++;
+    batch->slot_of_sprite[sprite] = slot;
+    batch->sprite_of_slot[slot] = sprite;
+    // Opaque placeholder so 'sprite_batch_set()' can track translucency.
+    batch->instances[slot].color = 0xff000000;
+    sprite_batch_set(batch, sprite, quad);
+    return sprite;
+}
+
+void sprite_batch_set(SpriteBatch* batch, u32 sprite, QuadInstance quad) {
+    u32 slot = batch->slot_of_sprite[sprite];
+    Instance inst = instance_from_quad(&quad, 1.0f);
+    inst.texture = INSTANCE_TEXTURE(0, batch->entry.layer);
+    inst.depth = slot;
+    batch->translucent_count -= (batch->instances[slot].color >> 24) != 0xff;
+    batch->translucent_count += (inst.color >> 24) != 0xff;
+    batch->instances[slot] = inst;
+    sprite_batch_mark_dirty(batch, slot);
+}
+
+void sprite_batch_remove(SpriteBatch* batch, u32 sprite) {
+    u32 slot = batch->slot_of_sprite[sprite];
+    batch->translucent_count -= (batch->instances[slot].color >> 24) != 0xff;
+    u32 last = --batch->count;
+    if (slot != last) {
+        u32 moved = batch->sprite_of_slot[last];
+        batch->instances[slot] = batch->instances[last];
+        batch->instances[slot].depth = slot;
+        batch->slot_of_sprite[moved] = slot;
+        batch->sprite_of_slot[slot] = moved;
+        sprite_batch_mark_dirty(batch, slot);
+    }
+    batch->free_sprites[batch->free_count++] = sprite;
+}
+
+u32 sprite_batch_get_count(const SpriteBatch* batch) {
+    return batch->count;
+}
+
+void render_list_draw_sprite_batch(RenderList* list, SpriteBatch* batch) {
+    RenderCmd* cmd = render_list_push_cmd(list);
+    cmd->key = (u64) list->layer << SORT_KEY_LAYER_SHIFT |
+        (u64) batch_shader_for_texture(batch->texture) << SORT_KEY_SHADER_SHIFT |
+        (gfx_texture_get_id(batch->texture) & SORT_KEY_TEXTURE_MASK);
+    cmd->texture = batch->texture;
+    cmd->sprite_batch = batch;
+    cmd->particles = NULL;
+    cmd->tilemap = NULL;
+}
+
+void renderer_draw_sprite_batch(Renderer* rend, SpriteBatch* batch) {
+    render_list_draw_sprite_batch(&rend->list, batch);
+}
+
+// -- Particles --
+
+void render_list_draw_particles(RenderList* list, ParticleSystem* particles) {
+    GfxTexture texture = particles->desc.texture;
+    RenderCmd* cmd = render_list_push_cmd(list);
+    cmd->key = (u64) list->layer << SORT_KEY_LAYER_SHIFT |
+        (u64) batch_shader_for_texture(texture) << SORT_KEY_SHADER_SHIFT |
+        (gfx_texture_get_id(texture) & SORT_KEY_TEXTURE_MASK);
+    cmd->texture = texture;
+    cmd->sprite_batch = NULL;
+    cmd->particles = particles;
+    cmd->tilemap = NULL;
+}
+
+void renderer_draw_particles(Renderer* rend, ParticleSystem* particles) {
+    render_list_draw_particles(&rend->list, particles);
+}
+
+// -- Tilemap --
+
+Tilemap* tilemap_new(WDL_Arena* arena, TilemapDesc desc) {
+    wdl_assert(!gfx_texture_is_null(desc.sheet), "Tilemap needs a sheet.");
+    wdl_assert(desc.tile_count < 0xffff, "Too many tiles for a 16-bit tile index.");
+    if (desc.tile_size == 0.0f) {
+        desc.tile_size = 1.0f;
+    }
+
+    WDL_Ivec2 chunk_count = wdl_iv2(
+            (desc.size.x + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE,
+            (desc.size.y + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE);
+    u16* indices = wdl_arena_push(arena, desc.size.x * desc.size.y * sizeof(u16));
+
+    WDL_Scratch scratch = wdl_scratch_begin(&arena, 1);
+    // Storage buffers can't be empty.
+    u32 rect_count = desc.tile_count > 0 ? desc.tile_count : 1;
+    f32* rects = wdl_arena_push(scratch.arena, rect_count * 4 * sizeof(f32));
+    for (u32 i = 0; i < desc.tile_count; i++) {
+        // Empty regions sample the texel at their position, like a zero
+        // sized sprite would, instead of dividing by zero in the shader.
+        WDL_Ivec2 size = desc.tiles[i].size;
+        rects[i * 4 + 0] = desc.tiles[i].pos.x;
+        rects[i * 4 + 1] = desc.tiles[i].pos.y;
+        rects[i * 4 + 2] = size.x > 0 ? size.x : 1;
+        rects[i * 4 + 3] = size.y > 0 ? size.y : 1;
+    }
+    GfxBuffer tile_buffer = gfx_buffer_new((GfxBufferDesc) {
+            .size = rect_count * 4 * sizeof(f32),
+            .data = rects,
+            .usage = GFX_BUFFER_USAGE_STATIC,
+        });
+    wdl_scratch_end(scratch);
+
+    Tilemap* tilemap = wdl_arena_push(arena, sizeof(Tilemap));
+    *tilemap = (Tilemap) {
+        .size = desc.size,
+        .origin = desc.origin,
+        .tile_size = desc.tile_size,
+        .sheet = desc.sheet,
+        .indices = indices,
+        .index_texture = gfx_texture_new((GfxTextureDesc) {
+                .data = indices,
+                .size = desc.size,
+                .format = GFX_TEXTURE_FORMAT_R_U16_INT,
+                .sampler = GFX_TEXTURE_SAMPLER_NEAREST,
+                .alignment = 2,
+            }),
+        .tile_buffer = tile_buffer,
+        .chunk_count = chunk_count,
+        .chunks = wdl_arena_push(arena, chunk_count.x * chunk_count.y * sizeof(TilemapChunk)),
+    };
+    return tilemap;
+}
+
+void tilemap_set(Tilemap* tilemap, i32 x, i32 y, u16 tile) {
+    if (x < 0 || x >= tilemap->size.x || y < 0 || y >= tilemap->size.y) {
+        return;
+    }
+    u16* index = &tilemap->indices[x + y * tilemap->size.x];
+    if (*index == tile) {
+        return;
+    }
+
+    TilemapChunk* chunk = &tilemap->chunks[x / TILEMAP_CHUNK_SIZE + y / TILEMAP_CHUNK_SIZE * tilemap->chunk_count.x];
+    chunk->tile_count += (tile != 0) - (*index != 0);
+    *index = tile;
+
+    if (!chunk->dirty) {
+        chunk->dirty = true;
+        chunk->dirty_min = wdl_iv2(x, y);
+        chunk->dirty_max = wdl_iv2(x + 1, y + 1);
+        return;
+    }
+    chunk->dirty_min.x = x < chunk->dirty_min.x ? x : chunk->dirty_min.x;
+    chunk->dirty_min.y = y < chunk->dirty_min.y ? y : chunk->dirty_min.y;
+    chunk->dirty_max.x = x + 1 > chunk->dirty_max.x ? x + 1 : chunk->dirty_max.x;
+    chunk->dirty_max.y = y + 1 > chunk->dirty_max.y ? y + 1 : chunk->dirty_max.y;
+}
+
+u16 tilemap_get(const Tilemap* tilemap, i32 x, i32 y) {
+    if (x < 0 || x >= tilemap->size.x || y < 0 || y >= tilemap->size.y) {
+        return 0;
+    }
+    return tilemap->indices[x + y * tilemap->size.x];
+}
+
+void render_list_draw_tilemap(RenderList* list, Tilemap* tilemap) {
+    RenderCmd* cmd = render_list_push_cmd(list);
+    cmd->key = (u64) list->layer << SORT_KEY_LAYER_SHIFT |
+        (u64) batch_shader_for_texture(tilemap->sheet) << SORT_KEY_SHADER_SHIFT |
+        (gfx_texture_get_id(tilemap->sheet) & SORT_KEY_TEXTURE_MASK);
+    cmd->texture = tilemap->sheet;
+    cmd->sprite_batch = NULL;
+    cmd->particles = NULL;
+    cmd->tilemap = tilemap;
+}
+
+void renderer_draw_tilemap(Renderer* rend, Tilemap* tilemap) {
+    render_list_draw_tilemap(&rend->list, tilemap);
+}
+
+RendererStats renderer_get_stats(const Renderer* rend) {
+    return rend->stats;
+}
+
+RendererStats renderer_get_frame_stats(const Renderer* rend) {
+    return rend->prev_frame_stats;
+}
+
+RendererStats renderer_get_average_stats(const Renderer* rend) {
+    RendererStats sum = {0};
+    u32 frame_count = rend->stats_frame;
+    if (frame_count > RENDERER_STATS_WINDOW) {
+        frame_count = RENDERER_STATS_WINDOW;
+    }
+    if (frame_count == 0) {
+        return sum;
+    }
+    for (u32 i = 0; i < frame_count; i++) {
+        renderer_stats_add(&sum, &rend->stats_history[i]);
+    }
+
+    return (RendererStats) {
+        .quads = sum.quads / frame_count,
+        .culled_quads = sum.culled_quads / frame_count,
+        .text_glyphs = sum.text_glyphs / frame_count,
+        .sprite_batches = sum.sprite_batches / frame_count,
+        .particles = sum.particles / frame_count,
+        .tilemap_chunks = sum.tilemap_chunks / frame_count,
+        .batches = sum.batches / frame_count,
+        .draw_calls = sum.draw_calls / frame_count,
+        .flushes = {
+            .full = sum.flushes.full / frame_count,
+            .texture_slots = sum.flushes.texture_slots / frame_count,
+            .sprite_batch = sum.flushes.sprite_batch / frame_count,
+            .particles = sum.flushes.particles / frame_count,
+            .tilemap = sum.flushes.tilemap / frame_count,
+            .shader = sum.flushes.shader / frame_count,
+        },
+        .uploaded_bytes = sum.uploaded_bytes / frame_count,
+        .unique_textures = sum.unique_textures / frame_count,
+        .texture_binds = sum.texture_binds / frame_count,
+        .texture_copies = sum.texture_copies / frame_count,
+    };
 }
@@ -397,6 +397,8 @@ struct SizedFont {
     QuadtreeAtlas atlas_packer;
     GfxTexture atlas_texture;
     FontMetrics metrics;
+    // Incremented every time glyphs move in the atlas.
+    u32 atlas_generation;
     // Key: u32 (glyph index)
     // Value: GlyphInternal
     WDL_HashMap* glyph_map;
@@ -503,6 +505,7 @@ static void expand_atlas(Font* font, SizedFont* sized) {
     wdl_scratch_end(scratch);
 
     sized->atlas_packer = packer;
+    sized->atlas_generation++;
 }
 
 Glyph font_get_glyph(Font* font, u32 codepoint) {
@@ -575,6 +578,20 @@ GfxTexture font_get_atlas(const Font* font) {
     return sized->atlas_texture;
 }
 
+u32 font_get_size(const Font* font) {
+    return font->curr_size;
+}
+
+u32 font_get_atlas_generation(const Font* font) {
+    SizedFont* sized = wdl_hm_getp(font->map, font->curr_size);
+    if (sized == NULL) {
+        wdl_error("Font of size %u hasn't been created.", font->curr_size);
+        return 0;
+    }
+
+    return sized->atlas_generation;
+}
+
 FontMetrics font_get_metrics(const Font* font) {
     SizedFont* sized = wdl_hm_getp(font->map, font->curr_size);
     if (sized == NULL) {
@@ -2,6 +2,7 @@
 #include "waddle.h"
 
 #include <math.h>
+#include <string.h>
 
 #include <glad/gl.h>
 
@@ -24,6 +25,7 @@
 typedef struct PoolNode PoolNode;
 struct PoolNode {
     PoolNode* next;
+    PoolNode* prev;
     void* data;
 };
 
@@ -31,7 +33,10 @@ typedef struct ResourcePool ResourcePool;
 struct ResourcePool {
     WDL_Arena* arena;
     u32 resource_size;
+    // Live resources.
     PoolNode* nodes;
+    // Released nodes, reused before pushing new ones onto the arena.
+    PoolNode* free_nodes;
 };
 
 #define POOL_ITER(POOL, NAME) for (PoolNode* NAME = (POOL).nodes; NAME != NULL; NAME = NAME->next)
@@ -45,13 +50,41 @@ static ResourcePool resource_pool_init(WDL_Arena* arena, u32 resource_size) {
 }
 
 static PoolNode* resource_pool_aquire(ResourcePool* pool) {
-    PoolNode* node = wdl_arena_push_no_zero(pool->arena, sizeof(PoolNode));
-    *node = (PoolNode) {
-        .data = wdl_arena_push(pool->arena, pool->resource_size),
-    };
+    PoolNode* node = pool->free_nodes;
+    if (node != NULL) {
+        pool->free_nodes = node->next;
+        memset(node->data, 0, pool->resource_size);
+    } else {
+        node = wdl_arena_push_no_zero(pool->arena, sizeof(PoolNode));
+        node->data = wdl_arena_push(pool->arena, pool->resource_size);
+    }
+
+    node->prev = NULL;
+    node->next = pool->nodes;
+    if (pool->nodes != NULL) {
+        pool->nodes->prev = node;
+    }
+    pool->nodes = node;
     return node;
 }
 
+// The node goes back on the free list, so handles to it must not be used
+// afterwards.
+static void resource_pool_release(ResourcePool* pool, PoolNode* node) {
+    if (node->prev != NULL) {
+        node->prev->next = node->next;
+    } else {
+        pool->nodes = node->next;
+    }
+    if (node->next != NULL) {
+        node->next->prev = node->prev;
+    }
+
+    node->prev = NULL;
+    node->next = pool->free_nodes;
+    pool->free_nodes = node;
+}
+
 static inline void* resource_pool_get_data(PoolNode* node) { return node->data; }
 
 // -- State --------------------------------------------------------------------
@@ -60,6 +93,17 @@ typedef struct InternalBuffer InternalBuffer;
 struct InternalBuffer {
     u32 gl_handle;
     u64 size;
+    GfxBufferUsage usage;
+
+    // Stream ring
+    u8* mapped;
+    u64 region_size;
+    u32 region_count;
+    u32 curr_region;
+    // Regions before 'curr_region' opened through 'gfx_buffer_stream_next()'
+    // and not yet fenced.
+    u32 open_count;
+    GLsync fences[GFX_BUFFER_MAX_STREAM_REGIONS];
 };
 
 typedef struct InternalVertexArray InternalVertexArray;
@@ -76,12 +120,48 @@ struct InternalShader {
 typedef struct InternalTexture InternalTexture;
 struct InternalTexture {
     u32 gl_handle;
+    u32 gl_target;
     WDL_Ivec2 size;
+    u32 layers;
+    GfxTextureFormat format;
+    GfxTextureSampler sampler;
+    u32 id;
+    u32 version;
+    b8 opaque;
 };
 
 typedef struct InternalFramebuffer InternalFramebuffer;
 struct InternalFramebuffer {
     u32 gl_handle;
+    // Versions of these are bumped once drawing into the framebuffer is done,
+    // i.e. when it's unbound or another one is bound.
+    GfxTexture color_attachments[GFX_FRAMEBUFFER_MAX_COLOR_ATTACHMENTS];
+};
+
+typedef enum ReadbackSlotState {
+    READBACK_SLOT_FREE,
+    READBACK_SLOT_PENDING,
+    READBACK_SLOT_HELD,
+} ReadbackSlotState;
+
+typedef struct ReadbackSlot ReadbackSlot;
+struct ReadbackSlot {
+    u32 gl_handle;
+    u64 capacity;
+    u8* mapped;
+    WDL_Ivec2 size;
+    GLsync fence;
+    ReadbackSlotState state;
+};
+
+typedef struct InternalReadback InternalReadback;
+struct InternalReadback {
+    ReadbackSlot* slots;
+    u32 slot_count;
+    // Slot the next copy goes into.
+    u32 head;
+    // Oldest copy not yet handed out.
+    u32 tail;
 };
 
 typedef struct GraphicsState GraphicsState;
@@ -94,6 +174,14 @@ struct GraphicsState {
     ResourcePool shader_pool;
     ResourcePool texture_pool;
     ResourcePool framebuffer_pool;
+    ResourcePool readback_pool;
+
+    u32 texture_count;
+    // NULL while the default framebuffer is bound.
+    PoolNode* bound_framebuffer;
+    WDL_Ivec2 viewport;
+    GfxTextureDestroyCallback texture_destroy_callback;
+    void* texture_destroy_user_data;
 };
 
 static GraphicsState state = {0};
@@ -110,6 +198,7 @@ b8 gfx_init(void) {
         .shader_pool = resource_pool_init(arena, sizeof(InternalShader)),
         .texture_pool = resource_pool_init(arena, sizeof(InternalTexture)),
         .framebuffer_pool = resource_pool_init(arena, sizeof(InternalFramebuffer)),
+        .readback_pool = resource_pool_init(arena, sizeof(InternalReadback)),
     };
 
     if (!gladLoadGLUserPtr((GLADuserptrloadfunc) wdl_lib_func, state.lib_gl)) {
@@ -119,6 +208,7 @@ b8 gfx_init(void) {
     // TODO: Let the user control blending at some stage of the rendering process.
     glEnable(GL_BLEND);
     glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthFunc(GL_LESS);
 
     return true;
 }
@@ -144,6 +234,11 @@ void gfx_termiante(void) {
         glDeleteTextures(1, &texture->gl_handle);
     }
 
+    // Destroying releases the node, so the list is consumed from the front.
+    while (state.readback_pool.nodes != NULL) {
+        gfx_readback_destroy((GfxReadback) { .handle = state.readback_pool.nodes });
+    }
+
     wdl_lib_unload(state.lib_gl);
     wdl_arena_destroy(state.arena);
 }
@@ -222,6 +317,14 @@ Color color_hsv(f32 hue, f32 saturation, f32 value) {
     return color;
 }
 
+u32 color_pack_rgba8(Color color) {
+    u32 r = (u32) (wdl_clamp(color.r, 0.0f, 1.0f) * 255.0f + 0.5f);
+    u32 g = (u32) (wdl_clamp(color.g, 0.0f, 1.0f) * 255.0f + 0.5f);
+    u32 b = (u32) (wdl_clamp(color.b, 0.0f, 1.0f) * 255.0f + 0.5f);
+    u32 a = (u32) (wdl_clamp(color.a, 0.0f, 1.0f) * 255.0f + 0.5f);
+    return r | g << 8 | b << 16 | a << 24;
+}
+
 // -- Buffer -------------------------------------------------------------------
 
 #define BUFFER_OP_TARGET GL_ARRAY_BUFFER
@@ -235,10 +338,42 @@ GfxBuffer gfx_buffer_new(GfxBufferDesc desc) {
     return buffer;
 }
 
+static void _buffer_create_stream_ring(InternalBuffer* internal, GfxBufferDesc desc) {
+    ASSERT(desc.region_count > 0, "A stream ring buffer needs at least one region!");
+    ASSERT(desc.region_count <= GFX_BUFFER_MAX_STREAM_REGIONS, "Too many stream ring regions!");
+
+    internal->region_size = desc.size;
+    internal->region_count = desc.region_count;
+    internal->curr_region = 0;
+    internal->open_count = 0;
+    internal->size = desc.size * desc.region_count;
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBindBuffer(BUFFER_OP_TARGET, internal->gl_handle);
+    glBufferStorage(BUFFER_OP_TARGET, internal->size, NULL, flags);
+    internal->mapped = glMapBufferRange(BUFFER_OP_TARGET, 0, internal->size, flags);
+    glBindBuffer(BUFFER_OP_TARGET, 0);
+
+    if (desc.data != NULL) {
+        for (u32 i = 0; i < desc.region_count; i++) {
+            memcpy(internal->mapped + i * desc.size, desc.data, desc.size);
+        }
+    }
+}
+
 void gfx_buffer_resize(GfxBuffer buffer, GfxBufferDesc desc) {
     ASSERT(!gfx_buffer_is_null(buffer), "Cannot resize a NULL buffer!");
 
     InternalBuffer* internal = resource_pool_get_data(buffer.handle);
+    // Storage created with 'glBufferStorage()' is immutable.
+    ASSERT(internal->usage != GFX_BUFFER_USAGE_STREAM_RING, "Cannot resize a stream ring buffer!");
+    internal->usage = desc.usage;
+
+    if (desc.usage == GFX_BUFFER_USAGE_STREAM_RING) {
+        _buffer_create_stream_ring(internal, desc);
+        return;
+    }
+
     internal->size = desc.size;
 
     GLenum gl_usage;
@@ -252,6 +387,8 @@ void gfx_buffer_resize(GfxBuffer buffer, GfxBufferDesc desc) {
         case GFX_BUFFER_USAGE_STREAM:
             gl_usage = GL_STREAM_DRAW;
             break;
+        case GFX_BUFFER_USAGE_STREAM_RING:
+            return;
     }
 
     glBindBuffer(BUFFER_OP_TARGET, internal->gl_handle);
@@ -263,38 +400,165 @@ void gfx_buffer_subdata(GfxBuffer buffer, const void* data, u32 size, u32 offset
     ASSERT(!gfx_buffer_is_null(buffer), "Cannot enter subdata into a NULL buffer!");
 
     InternalBuffer* internal = resource_pool_get_data(buffer.handle);
+    ASSERT(internal->usage != GFX_BUFFER_USAGE_STREAM_RING, "Stream ring buffers are written through 'gfx_buffer_stream_begin()'.");
     ASSERT(offset + size <= internal->size, "Buffer overflow. Trying to write outside of the buffers capacity. Run 'gfx_buffer_resize()' to change the size.");
 
     glBindBuffer(BUFFER_OP_TARGET, internal->gl_handle);
     glBufferSubData(BUFFER_OP_TARGET, offset, size, data);
 }
 
+void gfx_buffer_destroy(GfxBuffer buffer) {
+    ASSERT(!gfx_buffer_is_null(buffer), "Cannot destroy a NULL buffer!");
+    InternalBuffer* internal = resource_pool_get_data(buffer.handle);
+    if (internal->usage == GFX_BUFFER_USAGE_STREAM_RING) {
+        for (u32 i = 0; i < internal->region_count; i++) {
+            if (internal->fences[i] != NULL) {
+                glDeleteSync(internal->fences[i]);
+                internal->fences[i] = NULL;
+            }
+        }
+        internal->mapped = NULL;
+    }
+    // Deleting a buffer the GPU is still reading from is deferred by the
+    // driver and implicitly unmaps it.
+    glDeleteBuffers(1, &internal->gl_handle);
+    internal->gl_handle = 0;
+    resource_pool_release(&state.buffer_pool, buffer.handle);
+}
+
 b8 gfx_buffer_is_null(GfxBuffer buffer) {
     return buffer.handle == NULL;
 }
 
+void gfx_buffer_bind_storage(GfxBuffer buffer, u32 binding) {
+    ASSERT(!gfx_buffer_is_null(buffer), "Cannot bind a NULL buffer as storage!");
+    InternalBuffer* internal = resource_pool_get_data(buffer.handle);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, internal->gl_handle);
+}
+
+void* gfx_buffer_stream_begin(GfxBuffer buffer, u64* offset) {
+    ASSERT(!gfx_buffer_is_null(buffer), "Cannot stream into a NULL buffer!");
+    InternalBuffer* internal = resource_pool_get_data(buffer.handle);
+    ASSERT(internal->usage == GFX_BUFFER_USAGE_STREAM_RING, "Buffer isn't a stream ring buffer!");
+
+    GLsync fence = internal->fences[internal->curr_region];
+    if (fence != NULL) {
+        // Only stalls if the GPU is more than 'region_count' flushes behind.
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        while (result == GL_TIMEOUT_EXPIRED) {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        }
+        if (result == GL_WAIT_FAILED) {
+            wdl_error("Waiting on stream ring fence failed.");
+        }
+        glDeleteSync(fence);
+        internal->fences[internal->curr_region] = NULL;
+    }
+
+    u64 region_offset = internal->curr_region * internal->region_size;
+    if (offset != NULL) {
+        *offset = region_offset;
+    }
+    return internal->mapped + region_offset;
+}
+
+b8 gfx_buffer_stream_ready(GfxBuffer buffer) {
+    ASSERT(!gfx_buffer_is_null(buffer), "Cannot stream into a NULL buffer!");
+    InternalBuffer* internal = resource_pool_get_data(buffer.handle);
+    ASSERT(internal->usage == GFX_BUFFER_USAGE_STREAM_RING, "Buffer isn't a stream ring buffer!");
+
+    GLsync fence = internal->fences[internal->curr_region];
+    if (fence == NULL) {
+        return true;
+    }
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
+
+void* gfx_buffer_stream_next(GfxBuffer buffer, u64* offset) {
+    ASSERT(!gfx_buffer_is_null(buffer), "Cannot stream into a NULL buffer!");
+    InternalBuffer* internal = resource_pool_get_data(buffer.handle);
+    ASSERT(internal->usage == GFX_BUFFER_USAGE_STREAM_RING, "Buffer isn't a stream ring buffer!");
+    ASSERT(internal->open_count + 1 < internal->region_count, "Too many stream ring regions open at once!");
+
+    internal->open_count++;
+    internal->curr_region = (internal->curr_region + 1) % internal->region_count;
+    return gfx_buffer_stream_begin(buffer, offset);
+}
+
+void gfx_buffer_stream_end(GfxBuffer buffer) {
+    ASSERT(!gfx_buffer_is_null(buffer), "Cannot stream into a NULL buffer!");
+    InternalBuffer* internal = resource_pool_get_data(buffer.handle);
+    ASSERT(internal->usage == GFX_BUFFER_USAGE_STREAM_RING, "Buffer isn't a stream ring buffer!");
+
+    for (u32 i = 0; i <= internal->open_count; i++) {
+        u32 region = (internal->curr_region + internal->region_count - i) % internal->region_count;
+        internal->fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    internal->open_count = 0;
+    internal->curr_region = (internal->curr_region + 1) % internal->region_count;
+}
+
 // -- Vertex array -------------------------------------------------------------
 
+static u32 _vertex_attrib_type_to_gl_type(GfxVertexAttribType type) {
+    switch (type) {
+        case GFX_VERTEX_ATTRIB_TYPE_F32:
+            return GL_FLOAT;
+        case GFX_VERTEX_ATTRIB_TYPE_F16:
+            return GL_HALF_FLOAT;
+        case GFX_VERTEX_ATTRIB_TYPE_U8:
+            return GL_UNSIGNED_BYTE;
+        case GFX_VERTEX_ATTRIB_TYPE_I8:
+            return GL_BYTE;
+        case GFX_VERTEX_ATTRIB_TYPE_U16:
+            return GL_UNSIGNED_SHORT;
+        case GFX_VERTEX_ATTRIB_TYPE_I16:
+            return GL_SHORT;
+        case GFX_VERTEX_ATTRIB_TYPE_U32:
+            return GL_UNSIGNED_INT;
+        case GFX_VERTEX_ATTRIB_TYPE_I32:
+            return GL_INT;
+    }
+    return GL_FLOAT;
+}
+
+static b8 _vertex_attrib_type_is_float(GfxVertexAttribType type) {
+    return type == GFX_VERTEX_ATTRIB_TYPE_F32 || type == GFX_VERTEX_ATTRIB_TYPE_F16;
+}
+
 GfxVertexArray gfx_vertex_array_new(GfxVertexArrayDesc desc) {
-    ASSERT(!gfx_buffer_is_null(desc.vertex_buffer), "Vertex array must have a vertex buffer!");
+    ASSERT(!gfx_buffer_is_null(desc.vertex_buffer) || desc.layout.attrib_count == 0, "Vertex array must have a vertex buffer!");
 
     PoolNode* node = resource_pool_aquire(&state.vertex_array_pool);
     InternalVertexArray* internal = node->data;
     glGenVertexArrays(1, &internal->gl_handle);
     internal->index_buffer = desc.index_buffer;
-    InternalBuffer* buf_node = resource_pool_get_data(desc.vertex_buffer.handle);
 
     glBindVertexArray(internal->gl_handle);
-    glBindBuffer(GL_ARRAY_BUFFER, buf_node->gl_handle);
+    if (!gfx_buffer_is_null(desc.vertex_buffer)) {
+        InternalBuffer* buf_node = resource_pool_get_data(desc.vertex_buffer.handle);
+        glBindBuffer(GL_ARRAY_BUFFER, buf_node->gl_handle);
+    }
 
     GfxVertexLayout layout = desc.layout;
     for (u32 i = 0; i < layout.attrib_count; i++) {
-        glVertexAttribPointer(i,
-                layout.attribs[i].count,
-                GL_FLOAT,
-                false,
-                layout.size,
-                (const void*) (layout.attribs[i].offset));
+        GfxVertexAttrib attrib = layout.attribs[i];
+        u32 gl_type = _vertex_attrib_type_to_gl_type(attrib.type);
+        if (_vertex_attrib_type_is_float(attrib.type) || attrib.normalized) {
+            glVertexAttribPointer(i,
+                    attrib.count,
+                    gl_type,
+                    attrib.normalized,
+                    layout.size,
+                    (const void*) (attrib.offset));
+        } else {
+            glVertexAttribIPointer(i,
+                    attrib.count,
+                    gl_type,
+                    layout.size,
+                    (const void*) (attrib.offset));
+        }
         glEnableVertexAttribArray(i);
     }
 
@@ -309,29 +573,70 @@ b8 gfx_vertex_array_is_null(GfxVertexArray vertex_array) {
 
 // -- Shader -------------------------------------------------------------------
 
+// Compiles 'source' with 'defines' inserted after the '#version' line. The
+// '#line' directive keeps line numbers in error messages matching the file.
+static u32 shader_compile(GLenum type, WDL_Str source, WDL_Str defines) {
+    WDL_Str version = wdl_str_lit("");
+    WDL_Str body = source;
+    if (source.len >= 8 && memcmp(source.data, "#version", 8) == 0) {
+        u32 line_end = 0;
+        while (line_end < source.len && source.data[line_end] != '\n') {
+            line_end++;
+        }
+        if (line_end < source.len) {
+            line_end++;
+        }
+        version = (WDL_Str) { .data = source.data, .len = line_end };
+        body = (WDL_Str) { .data = source.data + line_end, .len = source.len - line_end };
+    }
+
+    const char* strings[3] = {
+        (const char*) version.data,
+        (const char*) defines.data,
+        (const char*) body.data,
+    };
+    const int lengths[3] = { version.len, defines.len, body.len };
+    u32 shader = glCreateShader(type);
+    glShaderSource(shader, 3, strings, lengths);
+    glCompileShader(shader);
+    return shader;
+}
+
 GfxShader gfx_shader_new(WDL_Str vertex_source, WDL_Str fragment_source) {
+    return gfx_shader_new_defines(vertex_source, fragment_source, wdl_str_lit(""), NULL, 0);
+}
+
+GfxShader gfx_shader_new_defines(WDL_Str vertex_source, WDL_Str fragment_source, WDL_Str prelude, const char* const* defines, u32 define_count) {
     i32 success = 0;
     char info_log[512] = {0};
 
-    u32 v_shader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(v_shader, 1, (const char* const*) &vertex_source.data, (const int*) &vertex_source.len);
-    glCompileShader(v_shader);
+    WDL_Scratch scratch = wdl_scratch_begin(NULL, 0);
+    WDL_Str define_str = wdl_str_lit("");
+    if (define_count > 0 || prelude.len > 0) {
+        for (u32 i = 0; i < define_count; i++) {
+            define_str = wdl_str_pushf(scratch.arena, "%.*s#define %s\n", define_str.len, define_str.data, defines[i]);
+        }
+        define_str = wdl_str_pushf(scratch.arena, "%.*s%.*s\n#line 2\n", define_str.len, define_str.data, prelude.len, prelude.data);
+    }
+
+    u32 v_shader = shader_compile(GL_VERTEX_SHADER, vertex_source, define_str);
     glGetShaderiv(v_shader, GL_COMPILE_STATUS, &success);
     if (!success) {
         glGetShaderInfoLog(v_shader, sizeof(info_log), NULL, info_log);
         wdl_error("Vertex shader compilation error: %s", info_log);
+        wdl_scratch_end(scratch);
         return GFX_SHADER_NULL;
     }
 
-    u32 f_shader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(f_shader, 1, (const char* const*) &fragment_source.data, (const int*) &fragment_source.len);
-    glCompileShader(f_shader);
+    u32 f_shader = shader_compile(GL_FRAGMENT_SHADER, fragment_source, define_str);
     glGetShaderiv(f_shader, GL_COMPILE_STATUS, &success);
     if (!success) {
         glGetShaderInfoLog(f_shader, sizeof(info_log), NULL, info_log);
         wdl_error("Fragment shader compilation error: %s\n", info_log);
+        wdl_scratch_end(scratch);
         return GFX_SHADER_NULL;
     }
+    wdl_scratch_end(scratch);
 
     u32 program = glCreateProgram();
     glAttachShader(program, v_shader);
@@ -353,6 +658,25 @@ GfxShader gfx_shader_new(WDL_Str vertex_source, WDL_Str fragment_source) {
     return (GfxShader) { .handle = node };
 }
 
+GfxShader gfx_shader_permutation(GfxShaderPermutations* permutations, u32 feature_mask) {
+    ASSERT(permutations->feature_count <= GFX_SHADER_MAX_FEATURES, "Too many shader features!");
+    ASSERT(feature_mask < (1u << permutations->feature_count), "Unknown shader feature in mask!");
+    GfxShader* variant = &permutations->variants[feature_mask];
+    if (!gfx_shader_is_null(*variant)) {
+        return *variant;
+    }
+
+    const char* defines[GFX_SHADER_MAX_FEATURES];
+    u32 define_count = 0;
+    for (u32 i = 0; i < permutations->feature_count; i++) {
+        if (feature_mask & (1u << i)) {
+            defines[define_count++] = permutations->features[i];
+        }
+    }
+    *variant = gfx_shader_new_defines(permutations->vertex_source, permutations->fragment_source, permutations->prelude, defines, define_count);
+    return *variant;
+}
+
 void gfx_shader_use(GfxShader shader) {
     ASSERT(!gfx_shader_is_null(shader), "Can't use a NULL shader!");
     InternalShader* internal = resource_pool_get_data(shader.handle);
@@ -382,6 +706,21 @@ void gfx_shader_uniform_i32_arr(GfxShader shader, WDL_Str name, const i32* arr,
     glUniform1iv(loc, count, arr);
 }
 
+void gfx_shader_uniform_f32(GfxShader shader, WDL_Str name, f32 value) {
+    uniform_body(shader, name);
+    glUniform1f(loc, value);
+}
+
+void gfx_shader_uniform_v2(GfxShader shader, WDL_Str name, WDL_Vec2 value) {
+    uniform_body(shader, name);
+    glUniform2f(loc, value.x, value.y);
+}
+
+void gfx_shader_uniform_color(GfxShader shader, WDL_Str name, Color value) {
+    uniform_body(shader, name);
+    glUniform4f(loc, value.r, value.g, value.b, value.a);
+}
+
 void gfx_shader_uniform_m4(GfxShader shader, WDL_Str name, WDL_Mat4 value) {
     uniform_body(shader, name);
     glUniformMatrix4fv(loc, 1, false, &value.a.x);
@@ -400,6 +739,8 @@ GfxTexture gfx_texture_new(GfxTextureDesc desc) {
     PoolNode* node = resource_pool_aquire(&state.texture_pool);
     InternalTexture* internal = node->data;
     glGenTextures(1, &internal->gl_handle);
+    internal->id = ++state.texture_count;
+    internal->gl_target = desc.layers > 0 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
     GfxTexture texture = { .handle = node };
     gfx_texture_resize(texture, desc);
     return texture;
@@ -462,6 +803,16 @@ static void _texture_format_to_gl_format(GfxTextureFormat format, u32* gl_intern
             *gl_internal_format = GL_RGBA32F;
             *gl_format = GL_RGBA;
             break;
+
+        case GFX_TEXTURE_FORMAT_R_U16_INT:
+            *gl_internal_format = GL_R16UI;
+            *gl_format = GL_RED_INTEGER;
+            break;
+
+        case GFX_TEXTURE_FORMAT_DEPTH_F32:
+            *gl_internal_format = GL_DEPTH_COMPONENT32F;
+            *gl_format = GL_DEPTH_COMPONENT;
+            break;
     }
 
     switch (format) {
@@ -479,10 +830,15 @@ static void _texture_format_to_gl_format(GfxTextureFormat format, u32* gl_intern
             *gl_type = GL_HALF_FLOAT;
             break;
 
+        case GFX_TEXTURE_FORMAT_R_U16_INT:
+            *gl_type = GL_UNSIGNED_SHORT;
+            break;
+
         case GFX_TEXTURE_FORMAT_R_F32:
         case GFX_TEXTURE_FORMAT_RG_F32:
         case GFX_TEXTURE_FORMAT_RGB_F32:
         case GFX_TEXTURE_FORMAT_RGBA_F32:
+        case GFX_TEXTURE_FORMAT_DEPTH_F32:
             *gl_type = GL_FLOAT;
             break;
     }
@@ -490,12 +846,22 @@ static void _texture_format_to_gl_format(GfxTextureFormat format, u32* gl_intern
 
 void gfx_texture_resize(GfxTexture texture, GfxTextureDesc desc) {
     InternalTexture* internal = resource_pool_get_data(texture.handle);
+    u32 gl_target = desc.layers > 0 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    ASSERT(gl_target == internal->gl_target, "Cannot change a texture between 2D and 2D array!");
     // Default to 4 since that's OpenGL's default.
     if (desc.alignment == 0) {
         desc.alignment = 4;
     }
+    if (desc.format == GFX_TEXTURE_FORMAT_R_U16_INT) {
+        desc.sampler = GFX_TEXTURE_SAMPLER_NEAREST;
+    }
 
     internal->size = desc.size;
+    internal->layers = desc.layers;
+    internal->format = desc.format;
+    internal->sampler = desc.sampler;
+    internal->opaque = desc.opaque;
+    internal->version++;
     glPixelStorei(GL_UNPACK_ALIGNMENT, desc.alignment);
 
     u32 gl_internal_format;
@@ -513,29 +879,45 @@ void gfx_texture_resize(GfxTexture texture, GfxTextureDesc desc) {
             break;
     }
 
-    glBindTexture(GL_TEXTURE_2D, internal->gl_handle);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gl_sampler);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, gl_sampler);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-
-    glTexImage2D(
-            GL_TEXTURE_2D,
-            0,
-            gl_internal_format,
-            desc.size.x,
-            desc.size.y,
-            0,
-            gl_format,
-            gl_type,
-            desc.data);
+    glBindTexture(gl_target, internal->gl_handle);
+
+    glTexParameteri(gl_target, GL_TEXTURE_MIN_FILTER, gl_sampler);
+    glTexParameteri(gl_target, GL_TEXTURE_MAG_FILTER, gl_sampler);
+    glTexParameteri(gl_target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(gl_target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+
+    if (gl_target == GL_TEXTURE_2D_ARRAY) {
+        glTexImage3D(
+                gl_target,
+                0,
+                gl_internal_format,
+                desc.size.x,
+                desc.size.y,
+                desc.layers,
+                0,
+                gl_format,
+                gl_type,
+                desc.data);
+    } else {
+        glTexImage2D(
+                gl_target,
+                0,
+                gl_internal_format,
+                desc.size.x,
+                desc.size.y,
+                0,
+                gl_format,
+                gl_type,
+                desc.data);
+    }
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(gl_target, 0);
 }
 
 void gfx_texture_subdata(GfxTexture texture, GfxTextureSubDataDesc desc) {
     InternalTexture* internal = resource_pool_get_data(texture.handle);
+    ASSERT(internal->gl_target == GL_TEXTURE_2D, "Subdata is only supported on 2D textures!");
+    internal->version++;
     // Default to 4 since that's OpenGL's default.
     if (desc.alignment == 0) {
         desc.alignment = 4;
@@ -550,15 +932,85 @@ void gfx_texture_subdata(GfxTexture texture, GfxTextureSubDataDesc desc) {
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+void gfx_texture_copy(GfxTextureCopyDesc desc) {
+    ASSERT(!gfx_texture_is_null(desc.src) && !gfx_texture_is_null(desc.dst), "Cannot copy from or to a NULL texture!");
+    InternalTexture* src = resource_pool_get_data(desc.src.handle);
+    InternalTexture* dst = resource_pool_get_data(desc.dst.handle);
+    if (desc.layer_count == 0) {
+        desc.layer_count = 1;
+    }
+
+    glCopyImageSubData(
+            src->gl_handle, src->gl_target, 0, 0, 0, desc.src_layer,
+            dst->gl_handle, dst->gl_target, 0, 0, 0, desc.dst_layer,
+            src->size.x, src->size.y, desc.layer_count);
+    dst->version++;
+}
+
+void gfx_texture_destroy(GfxTexture texture) {
+    InternalTexture* internal = resource_pool_get_data(texture.handle);
+    if (state.texture_destroy_callback != NULL) {
+        state.texture_destroy_callback(texture, state.texture_destroy_user_data);
+    }
+    glDeleteTextures(1, &internal->gl_handle);
+    internal->gl_handle = 0;
+    resource_pool_release(&state.texture_pool, texture.handle);
+}
+
 WDL_Ivec2 gfx_texture_get_size(GfxTexture texture) {
     InternalTexture* internal = resource_pool_get_data(texture.handle);
     return internal->size;
 }
 
+u32 gfx_texture_get_id(GfxTexture texture) {
+    if (gfx_texture_is_null(texture)) {
+        return 0;
+    }
+    InternalTexture* internal = resource_pool_get_data(texture.handle);
+    return internal->id;
+}
+
+u32 gfx_texture_get_version(GfxTexture texture) {
+    InternalTexture* internal = resource_pool_get_data(texture.handle);
+    return internal->version;
+}
+
+GfxTextureFormat gfx_texture_get_format(GfxTexture texture) {
+    InternalTexture* internal = resource_pool_get_data(texture.handle);
+    return internal->format;
+}
+
+GfxTextureSampler gfx_texture_get_sampler(GfxTexture texture) {
+    InternalTexture* internal = resource_pool_get_data(texture.handle);
+    return internal->sampler;
+}
+
+u32 gfx_texture_get_layers(GfxTexture texture) {
+    InternalTexture* internal = resource_pool_get_data(texture.handle);
+    return internal->layers;
+}
+
+b8 gfx_texture_is_opaque(GfxTexture texture) {
+    InternalTexture* internal = resource_pool_get_data(texture.handle);
+    switch (internal->format) {
+        case GFX_TEXTURE_FORMAT_RGBA_U8:
+        case GFX_TEXTURE_FORMAT_RGBA_F16:
+        case GFX_TEXTURE_FORMAT_RGBA_F32:
+            return internal->opaque;
+        default:
+            return true;
+    }
+}
+
 b8 gfx_texture_is_null(GfxTexture texture) {
     return texture.handle == NULL;
 }
 
+void gfx_texture_set_destroy_callback(GfxTextureDestroyCallback callback, void* user_data) {
+    state.texture_destroy_callback = callback;
+    state.texture_destroy_user_data = user_data;
+}
+
 // -- Framebuffer --------------------------------------------------------------
 
 GfxFramebuffer gfx_framebuffer_new(void) {
@@ -569,22 +1021,198 @@ GfxFramebuffer gfx_framebuffer_new(void) {
 }
 
 void gfx_framebuffer_attach(GfxFramebuffer framebuffer, GfxTexture texture, u32 slot) {
+    ASSERT(slot < GFX_FRAMEBUFFER_MAX_COLOR_ATTACHMENTS, "Color attachment slot out of range!");
     InternalFramebuffer* internal = resource_pool_get_data(framebuffer.handle);
+    internal->color_attachments[slot] = texture;
     glBindFramebuffer(GL_FRAMEBUFFER, internal->gl_handle);
     InternalTexture* internal_texture = resource_pool_get_data(texture.handle);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + slot, GL_TEXTURE_2D, internal_texture->gl_handle, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+void gfx_framebuffer_attach_depth(GfxFramebuffer framebuffer, GfxTexture texture) {
+    InternalFramebuffer* internal = resource_pool_get_data(framebuffer.handle);
+    InternalTexture* internal_texture = resource_pool_get_data(texture.handle);
+    ASSERT(internal_texture->format == GFX_TEXTURE_FORMAT_DEPTH_F32, "Depth attachment must be a depth texture!");
+    glBindFramebuffer(GL_FRAMEBUFFER, internal->gl_handle);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, internal_texture->gl_handle, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Marks the color attachments of the bound framebuffer as changed.
+static void _framebuffer_finish(void) {
+    if (state.bound_framebuffer == NULL) {
+        return;
+    }
+    InternalFramebuffer* internal = resource_pool_get_data(state.bound_framebuffer);
+    for (u32 i = 0; i < GFX_FRAMEBUFFER_MAX_COLOR_ATTACHMENTS; i++) {
+        GfxTexture texture = internal->color_attachments[i];
+        if (!gfx_texture_is_null(texture)) {
+            InternalTexture* internal_texture = resource_pool_get_data(texture.handle);
+            internal_texture->version++;
+        }
+    }
+    state.bound_framebuffer = NULL;
+}
+
 void gfx_framebuffer_bind(GfxFramebuffer framebuffer) {
     InternalFramebuffer* internal = resource_pool_get_data(framebuffer.handle);
+    _framebuffer_finish();
     glBindFramebuffer(GL_FRAMEBUFFER, internal->gl_handle);
+    state.bound_framebuffer = framebuffer.handle;
 }
 
 void gfx_framebuffer_unbind(void) {
+    _framebuffer_finish();
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+GfxFramebuffer gfx_framebuffer_get_bound(void) {
+    return (GfxFramebuffer) { state.bound_framebuffer };
+}
+
+b8 gfx_framebuffer_is_null(GfxFramebuffer framebuffer) {
+    return framebuffer.handle == NULL;
+}
+
+// -- Readback -----------------------------------------------------------------
+
+GfxReadback gfx_readback_new(u32 slot_count) {
+    ASSERT(slot_count > 0, "A readback ring needs at least one slot!");
+    PoolNode* node = resource_pool_aquire(&state.readback_pool);
+    InternalReadback* internal = node->data;
+    *internal = (InternalReadback) {
+        .slots = wdl_arena_push(state.arena, slot_count * sizeof(ReadbackSlot)),
+        .slot_count = slot_count,
+    };
+    return (GfxReadback) { .handle = node };
+}
+
+static void _readback_slot_destroy(ReadbackSlot* slot) {
+    if (slot->fence != NULL) {
+        glDeleteSync(slot->fence);
+        slot->fence = NULL;
+    }
+    if (slot->gl_handle != 0) {
+        glDeleteBuffers(1, &slot->gl_handle);
+        slot->gl_handle = 0;
+    }
+    slot->mapped = NULL;
+    slot->capacity = 0;
+}
+
+void gfx_readback_destroy(GfxReadback readback) {
+    ASSERT(!gfx_readback_is_null(readback), "Cannot destroy a NULL readback!");
+    InternalReadback* internal = resource_pool_get_data(readback.handle);
+    for (u32 i = 0; i < internal->slot_count; i++) {
+        _readback_slot_destroy(&internal->slots[i]);
+    }
+    resource_pool_release(&state.readback_pool, readback.handle);
+}
+
+b8 gfx_readback_is_null(GfxReadback readback) {
+    return readback.handle == NULL;
+}
+
+i32 gfx_framebuffer_read_async(GfxFramebuffer framebuffer, WDL_Ivec2 size, GfxReadback readback) {
+    ASSERT(!gfx_readback_is_null(readback), "Cannot read into a NULL readback!");
+    InternalReadback* internal = resource_pool_get_data(readback.handle);
+    u32 index = internal->head;
+    ReadbackSlot* slot = &internal->slots[index];
+    if (slot->state != READBACK_SLOT_FREE) {
+        return -1;
+    }
+
+    // Storage is immutable so a bigger copy needs a new buffer.
+    u64 bytes = (u64) size.x * size.y * 4;
+    if (bytes > slot->capacity) {
+        _readback_slot_destroy(slot);
+        const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &slot->gl_handle);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->gl_handle);
+        glBufferStorage(GL_PIXEL_PACK_BUFFER, bytes, NULL, flags);
+        slot->mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, flags);
+        slot->capacity = bytes;
+    }
+
+    GLint prev_read_framebuffer;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prev_read_framebuffer);
+    if (framebuffer.handle == NULL) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glReadBuffer(GL_BACK);
+    } else {
+        InternalFramebuffer* internal_fb = resource_pool_get_data(framebuffer.handle);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, internal_fb->gl_handle);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+    }
+
+    // Writes into the bound pack buffer, so this returns right away.
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->gl_handle);
+    GLint prev_pack_alignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &prev_pack_alignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glPixelStorei(GL_PACK_ALIGNMENT, prev_pack_alignment);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, prev_read_framebuffer);
+
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot->size = size;
+    slot->state = READBACK_SLOT_PENDING;
+    internal->head = (internal->head + 1) % internal->slot_count;
+    return index;
+}
+
+static b8 _readback_take(GfxReadback readback, GfxReadbackPixels* pixels, b8 wait) {
+    ASSERT(!gfx_readback_is_null(readback), "Cannot poll a NULL readback!");
+    InternalReadback* internal = resource_pool_get_data(readback.handle);
+    u32 index = internal->tail;
+    ReadbackSlot* slot = &internal->slots[index];
+    if (slot->state != READBACK_SLOT_PENDING) {
+        return false;
+    }
+
+    // Flushing makes sure the fence gets signaled without anyone waiting on
+    // it.
+    GLenum result = glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    while (wait && result == GL_TIMEOUT_EXPIRED) {
+        result = glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    }
+    if (result == GL_TIMEOUT_EXPIRED) {
+        return false;
+    }
+    if (result == GL_WAIT_FAILED) {
+        wdl_error("Waiting on readback fence failed.");
+    }
+    glDeleteSync(slot->fence);
+    slot->fence = NULL;
+
+    slot->state = READBACK_SLOT_HELD;
+    internal->tail = (internal->tail + 1) % internal->slot_count;
+    *pixels = (GfxReadbackPixels) {
+        .slot = index,
+        .size = slot->size,
+        .data = slot->mapped,
+    };
+    return true;
+}
+
+b8 gfx_readback_poll(GfxReadback readback, GfxReadbackPixels* pixels) {
+    return _readback_take(readback, pixels, false);
+}
+
+b8 gfx_readback_wait(GfxReadback readback, GfxReadbackPixels* pixels) {
+    return _readback_take(readback, pixels, true);
+}
+
+void gfx_readback_release(GfxReadback readback, u32 slot) {
+    ASSERT(!gfx_readback_is_null(readback), "Cannot release a slot of a NULL readback!");
+    InternalReadback* internal = resource_pool_get_data(readback.handle);
+    ASSERT(slot < internal->slot_count, "Readback slot out of range!");
+    ASSERT(internal->slots[slot].state == READBACK_SLOT_HELD, "Readback slot isn't held!");
+    internal->slots[slot].state = READBACK_SLOT_FREE;
+}
+
 // -- Drawing ------------------------------------------------------------------
 
 void gfx_clear(Color color) {
@@ -592,15 +1220,49 @@ void gfx_clear(Color color) {
     glClear(GL_COLOR_BUFFER_BIT);
 }
 
+void gfx_clear_depth(void) {
+    // Depth writes need to be enabled for the clear to have any effect, they
+    // stay enabled afterwards.
+    glDepthMask(GL_TRUE);
+    glClearDepth(1.0);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void gfx_blend(b8 enable) {
+    if (enable) {
+        glEnable(GL_BLEND);
+    } else {
+        glDisable(GL_BLEND);
+    }
+}
+
+void gfx_depth_test(b8 enable, b8 write) {
+    if (enable) {
+        glEnable(GL_DEPTH_TEST);
+    } else {
+        glDisable(GL_DEPTH_TEST);
+    }
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
 void gfx_draw(GfxVertexArray vertex_array, u32 vertex_count, u32 first_vertex) {
     ASSERT(!gfx_vertex_array_is_null(vertex_array), "No vertex buffer provided at draw!");
-    InternalVertexArray* node = vertex_array.handle;
+    InternalVertexArray* internal_va = resource_pool_get_data(vertex_array.handle);
 
-    glBindVertexArray(node->gl_handle);
+    glBindVertexArray(internal_va->gl_handle);
     glDrawArrays(GL_TRIANGLES, first_vertex, vertex_count);
     glBindVertexArray(0);
 }
 
+void gfx_draw_lines(GfxVertexArray vertex_array, u32 vertex_count, u32 first_vertex) {
+    ASSERT(!gfx_vertex_array_is_null(vertex_array), "No vertex array provided at draw!");
+    InternalVertexArray* internal_va = resource_pool_get_data(vertex_array.handle);
+
+    glBindVertexArray(internal_va->gl_handle);
+    glDrawArrays(GL_LINES, first_vertex, vertex_count);
+    glBindVertexArray(0);
+}
+
 void gfx_draw_indexed(GfxVertexArray vertex_array, u32 index_count, u32 first_index) {
     ASSERT(!gfx_vertex_array_is_null(vertex_array), "No vertex buffer provided at draw!");
     InternalVertexArray* internal_va = resource_pool_get_data(vertex_array.handle);
@@ -619,6 +1281,33 @@ void gfx_draw_indexed(GfxVertexArray vertex_array, u32 index_count, u32 first_in
     glBindVertexArray(0);
 }
 
+void gfx_draw_instanced(GfxVertexArray vertex_array, u32 vertex_count, u32 instance_count, u32 first_instance) {
+    ASSERT(!gfx_vertex_array_is_null(vertex_array), "No vertex array provided at draw!");
+    InternalVertexArray* internal_va = resource_pool_get_data(vertex_array.handle);
+
+    glBindVertexArray(internal_va->gl_handle);
+    glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, vertex_count, instance_count, first_instance);
+    glBindVertexArray(0);
+}
+
+void gfx_draw_instanced_indirect(GfxVertexArray vertex_array, GfxBuffer indirect_buffer, u64 offset, u32 draw_count) {
+    ASSERT(!gfx_vertex_array_is_null(vertex_array), "No vertex array provided at draw!");
+    ASSERT(!gfx_buffer_is_null(indirect_buffer), "No indirect buffer provided at draw!");
+    InternalVertexArray* internal_va = resource_pool_get_data(vertex_array.handle);
+    InternalBuffer* internal_buffer = resource_pool_get_data(indirect_buffer.handle);
+
+    glBindVertexArray(internal_va->gl_handle);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, internal_buffer->gl_handle);
+    glMultiDrawArraysIndirect(GL_TRIANGLES, (const void*) offset, draw_count, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
 void gfx_viewport(WDL_Ivec2 size) {
     glViewport(0, 0, size.x, size.y);
+    state.viewport = size;
+}
+
+WDL_Ivec2 gfx_get_viewport(void) {
+    return state.viewport;
 }
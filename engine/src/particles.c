@@ -0,0 +1,146 @@
+#include "engine/particles.h"
+#include "waddle.h"
+
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// -- Random --
+
+// xorshift32, the state must never be 0.
+static u32 particle_rand(ParticleSystem* ps) {
+    u32 x = ps->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    ps->rng = x;
+    return x;
+}
+
+// Uniform in [0, 1).
+static f32 particle_randf(ParticleSystem* ps) {
+    return (particle_rand(ps) >> 8) * (1.0f / 16777216.0f);
+}
+
+static f32 particle_rand_range(ParticleSystem* ps, f32 min, f32 max) {
+    return min + (max - min) * particle_randf(ps);
+}
+
+// -- API --
+
+ParticleSystem* particle_system_new(WDL_Arena* arena, ParticleSystemDesc desc) {
+    u32 capacity = (desc.capacity + 3) & ~3u;
+    ParticleSystem* ps = wdl_arena_push(arena, sizeof(ParticleSystem));
+    // Zeroed so the unused lanes of the last group are never NaN or denormal.
+    *ps = (ParticleSystem) {
+        .desc = desc,
+        .capacity = capacity,
+        .pos_x = wdl_arena_push(arena, capacity * sizeof(f32)),
+        .pos_y = wdl_arena_push(arena, capacity * sizeof(f32)),
+        .vel_x = wdl_arena_push(arena, capacity * sizeof(f32)),
+        .vel_y = wdl_arena_push(arena, capacity * sizeof(f32)),
+        .life = wdl_arena_push(arena, capacity * sizeof(f32)),
+        .life_rate = wdl_arena_push(arena, capacity * sizeof(f32)),
+        .rng = 0x9e3779b9,
+    };
+    return ps;
+}
+
+u32 particle_emit(ParticleSystem* ps, ParticleEmitDesc desc) {
+    wdl_assert(desc.lifetime_min > 0.0f && desc.lifetime_max > 0.0f, "Particle lifetime must be above zero.");
+
+    u32 count = desc.count;
+    if (count > ps->capacity - ps->count) {
+        count = ps->capacity - ps->count;
+    }
+
+    const f32 TAU = 6.28318530718f;
+    for (u32 i = ps->count; i < ps->count + count; i++) {
+        // sqrt keeps the density uniform over the disc.
+        f32 r = desc.radius * sqrtf(particle_randf(ps));
+        f32 theta = TAU * particle_randf(ps);
+        ps->pos_x[i] = desc.pos.x + cosf(theta) * r;
+        ps->pos_y[i] = desc.pos.y + sinf(theta) * r;
+
+        f32 angle = desc.angle + desc.spread * (particle_randf(ps) - 0.5f);
+        f32 speed = particle_rand_range(ps, desc.speed_min, desc.speed_max);
+        ps->vel_x[i] = cosf(angle) * speed;
+        ps->vel_y[i] = sinf(angle) * speed;
+
+        ps->life[i] = 0.0f;
+        ps->life_rate[i] = 1.0f / particle_rand_range(ps, desc.lifetime_min, desc.lifetime_max);
+    }
+    ps->count += count;
+
+    return count;
+}
+
+void particle_system_update(ParticleSystem* ps, f32 dt) {
+    u32 count = ps->count;
+    f32* pos_x = ps->pos_x;
+    f32* pos_y = ps->pos_y;
+    f32* vel_x = ps->vel_x;
+    f32* vel_y = ps->vel_y;
+    f32* life = ps->life;
+    f32* life_rate = ps->life_rate;
+
+    // Implicit drag so large time steps never reverse the velocity.
+    f32 damping = 1.0f / (1.0f + ps->desc.drag * dt);
+    f32 gravity_x = ps->desc.gravity.x * dt;
+    f32 gravity_y = ps->desc.gravity.y * dt;
+
+#ifdef __SSE2__
+    __m128 dt4 = _mm_set1_ps(dt);
+    __m128 damping4 = _mm_set1_ps(damping);
+    __m128 gravity_x4 = _mm_set1_ps(gravity_x);
+    __m128 gravity_y4 = _mm_set1_ps(gravity_y);
+    // The capacity is a multiple of four so the last group stays in bounds,
+    // its unused lanes are never read back.
+    for (u32 i = 0; i < count; i += 4) {
+        __m128 vx = _mm_loadu_ps(&vel_x[i]);
+        __m128 vy = _mm_loadu_ps(&vel_y[i]);
+        vx = _mm_mul_ps(_mm_add_ps(vx, gravity_x4), damping4);
+        vy = _mm_mul_ps(_mm_add_ps(vy, gravity_y4), damping4);
+        _mm_storeu_ps(&vel_x[i], vx);
+        _mm_storeu_ps(&vel_y[i], vy);
+
+        __m128 px = _mm_loadu_ps(&pos_x[i]);
+        __m128 py = _mm_loadu_ps(&pos_y[i]);
+        _mm_storeu_ps(&pos_x[i], _mm_add_ps(px, _mm_mul_ps(vx, dt4)));
+        _mm_storeu_ps(&pos_y[i], _mm_add_ps(py, _mm_mul_ps(vy, dt4)));
+
+        __m128 l = _mm_loadu_ps(&life[i]);
+        __m128 rate = _mm_loadu_ps(&life_rate[i]);
+        _mm_storeu_ps(&life[i], _mm_add_ps(l, _mm_mul_ps(rate, dt4)));
+    }
+#else
+    for (u32 i = 0; i < count; i++) {
+        vel_x[i] = (vel_x[i] + gravity_x) * damping;
+        vel_y[i] = (vel_y[i] + gravity_y) * damping;
+        pos_x[i] += vel_x[i] * dt;
+        pos_y[i] += vel_y[i] * dt;
+        life[i] += life_rate[i] * dt;
+    }
+#endif
+
+    // Every particle is copied to the end of the alive range and the range
+    // only grows past it if the particle is still alive, so there's no
+    // branch per particle. Survivors keep their relative order.
+    u32 alive = 0;
+    for (u32 i = 0; i < count; i++) {
+        b8 is_alive = life[i] < 1.0f;
+        pos_x[alive] = pos_x[i];
+        pos_y[alive] = pos_y[i];
+        vel_x[alive] = vel_x[i];
+        vel_y[alive] = vel_y[i];
+        life[alive] = life[i];
+        life_rate[alive] = life_rate[i];
+        alive += is_alive;
+    }
+    ps->count = alive;
+}
+
+void particle_system_clear(ParticleSystem* ps) {
+    ps->count = 0;
+}
@@ -0,0 +1,165 @@
+#include "engine/platform.h"
+#include "waddle.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#endif
+
+struct PlatformThread {
+    PlatformThreadFunc func;
+    void* user_data;
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+};
+
+struct PlatformMutex {
+#ifdef _WIN32
+    SRWLOCK lock;
+#else
+    pthread_mutex_t lock;
+#endif
+};
+
+struct PlatformCond {
+#ifdef _WIN32
+    CONDITION_VARIABLE cond;
+#else
+    pthread_cond_t cond;
+#endif
+};
+
+// -- Thread --
+
+#ifdef _WIN32
+static DWORD WINAPI thread_entry(LPVOID param) {
+    PlatformThread* thread = param;
+    thread->func(thread->user_data);
+    return 0;
+}
+#else
+static void* thread_entry(void* param) {
+    PlatformThread* thread = param;
+    thread->func(thread->user_data);
+    return NULL;
+}
+#endif
+
+PlatformThread* platform_thread_create(WDL_Arena* arena, PlatformThreadFunc func, void* user_data) {
+    PlatformThread* thread = wdl_arena_push(arena, sizeof(PlatformThread));
+    thread->func = func;
+    thread->user_data = user_data;
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, thread_entry, thread, 0, NULL);
+    if (thread->handle == NULL) {
+        return NULL;
+    }
+#else
+    if (pthread_create(&thread->handle, NULL, thread_entry, thread) != 0) {
+        return NULL;
+    }
+#endif
+    return thread;
+}
+
+void platform_thread_join(PlatformThread* thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+}
+
+// -- Mutex --
+
+PlatformMutex* platform_mutex_create(WDL_Arena* arena) {
+    PlatformMutex* mutex = wdl_arena_push(arena, sizeof(PlatformMutex));
+#ifdef _WIN32
+    InitializeSRWLock(&mutex->lock);
+#else
+    pthread_mutex_init(&mutex->lock, NULL);
+#endif
+    return mutex;
+}
+
+void platform_mutex_destroy(PlatformMutex* mutex) {
+#ifdef _WIN32
+    // Slim locks don't own any resources.
+    (void) mutex;
+#else
+    pthread_mutex_destroy(&mutex->lock);
+#endif
+}
+
+void platform_mutex_lock(PlatformMutex* mutex) {
+#ifdef _WIN32
+    AcquireSRWLockExclusive(&mutex->lock);
+#else
+    pthread_mutex_lock(&mutex->lock);
+#endif
+}
+
+void platform_mutex_unlock(PlatformMutex* mutex) {
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(&mutex->lock);
+#else
+    pthread_mutex_unlock(&mutex->lock);
+#endif
+}
+
+// -- Condition variable --
+
+PlatformCond* platform_cond_create(WDL_Arena* arena) {
+    PlatformCond* cond = wdl_arena_push(arena, sizeof(PlatformCond));
+#ifdef _WIN32
+    InitializeConditionVariable(&cond->cond);
+#else
+    pthread_cond_init(&cond->cond, NULL);
+#endif
+    return cond;
+}
+
+void platform_cond_destroy(PlatformCond* cond) {
+#ifdef _WIN32
+    (void) cond;
+#else
+    pthread_cond_destroy(&cond->cond);
+#endif
+}
+
+void platform_cond_wait(PlatformCond* cond, PlatformMutex* mutex) {
+#ifdef _WIN32
+    SleepConditionVariableSRW(&cond->cond, &mutex->lock, INFINITE, 0);
+#else
+    pthread_cond_wait(&cond->cond, &mutex->lock);
+#endif
+}
+
+void platform_cond_signal(PlatformCond* cond) {
+#ifdef _WIN32
+    WakeConditionVariable(&cond->cond);
+#else
+    pthread_cond_signal(&cond->cond);
+#endif
+}
+
+// -- File system --
+
+b8 platform_make_directory(WDL_Str path) {
+    WDL_Scratch scratch = wdl_scratch_begin(NULL, 0);
+    const char* cstr_path = wdl_str_to_cstr(scratch.arena, path);
+#ifdef _WIN32
+    b8 success = CreateDirectoryA(cstr_path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    b8 success = mkdir(cstr_path, 0755) == 0 || errno == EEXIST;
+#endif
+    wdl_scratch_end(scratch);
+    return success;
+}
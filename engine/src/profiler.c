@@ -17,10 +17,17 @@ struct Entry {
     f64 start_time;
 };
 
+typedef struct Counter Counter;
+struct Counter {
+    WDL_Str name;
+    u64 value;
+};
+
 typedef struct Profiler Profiler;
 struct Profiler {
     WDL_Arena* arena;
     WDL_HashMap* entry_map;
+    WDL_HashMap* counter_map;
     u32 current_frame;
     Entry* entry_stack;
 };
@@ -32,6 +39,7 @@ void profiler_init(void) {
     prof = (Profiler) {
         .arena = arena,
         .entry_map = wdl_hm_new(wdl_hm_desc_str(arena, 64, Entry)),
+        .counter_map = wdl_hm_new(wdl_hm_desc_str(arena, 32, Counter)),
     };
 }
 
@@ -46,6 +54,7 @@ void profiler_begin_frame(u32 frame_number) {
 void profiler_end_frame(void) {
     wdl_arena_clear(prof.arena);
     prof.entry_map = wdl_hm_new(wdl_hm_desc_str(prof.arena, 64, Entry));
+    prof.counter_map = wdl_hm_new(wdl_hm_desc_str(prof.arena, 32, Counter));
     prof.entry_stack = NULL;
 }
 
@@ -73,6 +82,13 @@ static void print_entry_map(WDL_HashMap* map, u32 depth) {
 void profiler_dump_frame(void) {
     wdl_info("-- Profiler dump of frame %u ------------------------------------", prof.current_frame);
     print_entry_map(prof.entry_map, 0);
+
+    WDL_HashMapIter iter = wdl_hm_iter_new(prof.counter_map);
+    while (wdl_hm_iter_valid(iter)) {
+        Counter* counter = wdl_hm_iter_get_valuep(iter);
+        wdl_info("%.*s: %llu", counter->name.len, counter->name.data, (unsigned long long) counter->value);
+        iter = wdl_hm_iter_next(iter);
+    }
 }
 
 void prof_begin(WDL_Str name) {
@@ -104,3 +120,17 @@ void prof_end(void) {
     prof.entry_stack = prof.entry_stack->next;
     entry->times.inclusive += wdl_os_get_time() - entry->start_time;
 }
+
+void prof_counter(WDL_Str name, u64 value) {
+    if (prof.arena == NULL) {
+        return;
+    }
+
+    Counter* counter = wdl_hm_getp(prof.counter_map, name);
+    if (counter == NULL) {
+        wdl_hm_insert(prof.counter_map, name, (Counter) {0});
+        counter = wdl_hm_getp(prof.counter_map, name);
+        counter->name = name;
+    }
+    counter->value += value;
+}
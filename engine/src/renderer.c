@@ -1,5 +1,6 @@
 #include "engine/renderer.h"
 #include "engine/graphics.h"
+#include "engine/utils.h"
 
 // -- Render pass --------------------------------------------------------------
 
@@ -18,6 +19,9 @@ RenderPass render_pass_new(RenderPassDesc desc) {
     for (u8 i = 0; i < desc.target_count; i++) {
         gfx_framebuffer_attach(pass.fb, desc.targets[i], i);
     }
+    if (!gfx_texture_is_null(desc.depth_target)) {
+        gfx_framebuffer_attach_depth(pass.fb, desc.depth_target);
+    }
 
     return pass;
 }
@@ -251,12 +255,17 @@ void draw_quad_atlas(BatchRenderer* br, Quad quad, WDL_Vec2 uvs[2], Camera cam)
     // TODO: Cache the projection matrix in the camera.
     WDL_Mat4 proj = camera_proj(cam);
     WDL_Mat4 view = camera_view(cam);
+    f32 c = 1.0f;
+    f32 s = 0.0f;
+    if (quad.rotation != 0.0f) {
+        c = cosf(quad.rotation);
+        s = sinf(quad.rotation);
+    }
     for (u8 i = 0; i < 4; i++) {
         WDL_Vec2 pos = vert_pos[i];
         pos = wdl_v2_sub(pos, quad.pivot);
         pos = wdl_v2_mul(pos, quad.size);
-        pos = wdl_v2(pos.x * cosf(quad.rotation) - pos.y * sinf(quad.rotation),
-            pos.x * sinf(quad.rotation) + pos.y * cosf(quad.rotation));
+        pos = wdl_v2(pos.x * c - pos.y * s, pos.x * s + pos.y * c);
         pos = wdl_v2_add(pos, quad.pos);
 
         WDL_Vec4 pos_v4 = wdl_v4(pos.x, pos.y, 0.0f, 1.0f);
@@ -276,8 +285,101 @@ void draw_quad_atlas(BatchRenderer* br, Quad quad, WDL_Vec2 uvs[2], Camera cam)
 
 // -- Debug --------------------------------------------------------------------
 
+typedef struct DebugVertex DebugVertex;
+struct DebugVertex {
+    WDL_Vec2 pos;
+    // RGBA8
+    u32 color;
+};
+
+struct DebugRenderer {
+    u32 max_vertex_count;
+    DebugVertex* vertices;
+    GfxBuffer vertex_buffer;
+    GfxVertexArray vertex_array;
+    GfxShader shader;
+};
+
 static DebugCtx* debug_curr_ctx = NULL;
 
+DebugRenderer* debug_renderer_new(WDL_Arena* arena, u32 max_vertex_count) {
+    // Lines need both end points in the same draw.
+    max_vertex_count -= max_vertex_count % 2;
+    u64 vertices_size = max_vertex_count * sizeof(DebugVertex);
+
+    GfxBuffer vertex_buffer = gfx_buffer_new((GfxBufferDesc) {
+            .size = vertices_size,
+            .data = NULL,
+            .usage = GFX_BUFFER_USAGE_DYNAMIC,
+        });
+
+    WDL_Scratch scratch = wdl_scratch_begin(&arena, 1);
+    WDL_Str vert_src = read_file(scratch.arena, wdl_str_lit("assets/shaders/debug.vert.glsl"));
+    WDL_Str frag_src = read_file(scratch.arena, wdl_str_lit("assets/shaders/debug.frag.glsl"));
+    GfxShader shader = gfx_shader_new(vert_src, frag_src);
+    wdl_scratch_end(scratch);
+
+    DebugRenderer* dr = wdl_arena_push_no_zero(arena, sizeof(DebugRenderer));
+    *dr = (DebugRenderer) {
+        .max_vertex_count = max_vertex_count,
+        .vertices = wdl_arena_push_no_zero(arena, vertices_size),
+        .vertex_buffer = vertex_buffer,
+        .vertex_array = gfx_vertex_array_new((GfxVertexArrayDesc) {
+                .layout = {
+                    .size = sizeof(DebugVertex),
+                    .attribs = {
+                        [0] = {
+                            .count = 2,
+                            .offset = wdl_offset(DebugVertex, pos),
+                        },
+                        [1] = {
+                            .count = 4,
+                            .offset = wdl_offset(DebugVertex, color),
+                            .type = GFX_VERTEX_ATTRIB_TYPE_U8,
+                            .normalized = true,
+                        },
+                    },
+                    .attrib_count = 2,
+                },
+                .vertex_buffer = vertex_buffer,
+            }),
+        .shader = shader,
+    };
+    return dr;
+}
+
+static void debug_flush(DebugRenderer* dr, u32 vertex_count, b8 lines) {
+    if (vertex_count == 0) {
+        return;
+    }
+    gfx_buffer_subdata(dr->vertex_buffer, dr->vertices, vertex_count * sizeof(DebugVertex), 0);
+    if (lines) {
+        gfx_draw_lines(dr->vertex_array, vertex_count, 0);
+    } else {
+        gfx_draw(dr->vertex_array, vertex_count, 0);
+    }
+}
+
+static void debug_execute_list(DebugRenderer* dr, DebugVertexList list, b8 lines) {
+    // Keep whole primitives within a single draw.
+    u32 primitive_size = lines ? 2 : 3;
+    u32 max_count = dr->max_vertex_count - dr->max_vertex_count % primitive_size;
+    u32 count = 0;
+    for (DebugVertexChunk* chunk = list.first; chunk != NULL; chunk = chunk->next) {
+        for (u32 i = 0; i < chunk->count; i++) {
+            if (count == max_count) {
+                debug_flush(dr, count, lines);
+                count = 0;
+            }
+            dr->vertices[count++] = (DebugVertex) {
+                .pos = wdl_v2(chunk->x[i], chunk->y[i]),
+                .color = chunk->color[i],
+            };
+        }
+    }
+    debug_flush(dr, count, lines);
+}
+
 void debug_ctx_push(DebugCtx* ctx) {
     if (debug_curr_ctx != NULL) {
         ctx->_next = debug_curr_ctx;
@@ -293,75 +395,141 @@ void debug_ctx_pop(void) {
     debug_curr_ctx = debug_curr_ctx->_next;
 }
 
-void debug_ctx_execute(const DebugCtx* ctx, BatchRenderer* br) {
-    DebugDrawCmd* cmd = ctx->_first_cmd;
-    while (cmd != NULL) {
-        draw_quad(br, cmd->quad, cmd->cam);
-        cmd = cmd->next;
-    }
+void debug_ctx_execute(const DebugCtx* ctx, DebugRenderer* dr) {
+    gfx_shader_use(dr->shader);
+    // Lines go on top of the filled quads.
+    debug_execute_list(dr, ctx->_triangles, false);
+    debug_execute_list(dr, ctx->_lines, true);
 }
 
 void debug_ctx_reset(DebugCtx* ctx) {
-    ctx->_first_cmd = NULL;
-    ctx->_last_cmd = NULL;
+    ctx->_lines = (DebugVertexList) {0};
+    ctx->_triangles = (DebugVertexList) {0};
+    ctx->_has_camera = false;
 }
 
-void debug_draw_quad(Quad quad, Camera cam) {
-    if (debug_curr_ctx == NULL) {
+static b8 debug_camera_equal(Camera a, Camera b) {
+    return a.screen_size.x == b.screen_size.x &&
+        a.screen_size.y == b.screen_size.y &&
+        a.pos.x == b.pos.x &&
+        a.pos.y == b.pos.y &&
+        a.zoom == b.zoom &&
+        a.invert_y == b.invert_y;
+}
+
+// Returns the active context with the matrices of 'cam' cached, NULL if there
+// is no active context.
+static DebugCtx* debug_ctx_begin(Camera cam) {
+    DebugCtx* ctx = debug_curr_ctx;
+    if (ctx == NULL) {
         wdl_error("No debug context active.");
-        return;
+        return NULL;
     }
 
-    DebugDrawCmd* cmd = wdl_arena_push_no_zero(debug_curr_ctx->arena, sizeof(DebugDrawCmd));
-    *cmd = (DebugDrawCmd) {
-        .quad = quad,
-        .cam = cam,
+    if (!ctx->_has_camera || !debug_camera_equal(ctx->_camera, cam)) {
+        ctx->_has_camera = true;
+        ctx->_camera = cam;
+        ctx->_proj = camera_proj(cam);
+        ctx->_view = camera_view(cam);
+    }
+    return ctx;
+}
+
+static void debug_push_vertex(DebugCtx* ctx, DebugVertexList* list, WDL_Vec2 pos, u32 color) {
+    if (list->last == NULL || list->last->count == DEBUG_CHUNK_VERTEX_COUNT) {
+        DebugVertexChunk* chunk = wdl_arena_push_no_zero(ctx->arena, sizeof(DebugVertexChunk));
+        chunk->next = NULL;
+        chunk->count = 0;
+        if (list->first == NULL) {
+            list->first = list->last = chunk;
+        } else {
+            list->last->next = chunk;
+            list->last = chunk;
+        }
+    }
+
+    if (ctx->_camera.invert_y) {
+        pos.y = -pos.y;
+    }
+    WDL_Vec4 pos_v4 = wdl_v4(pos.x, pos.y, 0.0f, 1.0f);
+    pos_v4 = wdl_m4_mul_vec(ctx->_view, pos_v4);
+    pos_v4 = wdl_m4_mul_vec(ctx->_proj, pos_v4);
+
+    DebugVertexChunk* chunk = list->last;
+    chunk->x[chunk->count] = pos_v4.x;
+    chunk->y[chunk->count] = pos_v4.y;
+    chunk->color[chunk->count] = color;
+    chunk->count++;
+    list->count++;
+}
+
+// Corners of a quad in the order bottom left, bottom right, top left, top
+// right.
+static void debug_quad_corners(Quad quad, WDL_Vec2 corners[4]) {
+    const WDL_Vec2 vert_pos[4] = {
+        wdl_v2(-0.5f, -0.5f),
+        wdl_v2( 0.5f, -0.5f),
+        wdl_v2(-0.5f,  0.5f),
+        wdl_v2( 0.5f,  0.5f),
     };
 
-    if (debug_curr_ctx->_first_cmd == NULL) {
-        debug_curr_ctx->_first_cmd = debug_curr_ctx->_last_cmd = cmd;
-    } else {
-        debug_curr_ctx->_last_cmd->next = cmd;
-        debug_curr_ctx->_last_cmd = cmd;
+    f32 c = 1.0f;
+    f32 s = 0.0f;
+    if (quad.rotation != 0.0f) {
+        c = cosf(quad.rotation);
+        s = sinf(quad.rotation);
+    }
+    for (u8 i = 0; i < 4; i++) {
+        WDL_Vec2 pos = vert_pos[i];
+        pos = wdl_v2_sub(pos, quad.pivot);
+        pos = wdl_v2_mul(pos, quad.size);
+        pos = wdl_v2(pos.x * c - pos.y * s, pos.x * s + pos.y * c);
+        corners[i] = wdl_v2_add(pos, quad.pos);
     }
 }
 
-static WDL_Vec2 vec2_rotate(WDL_Vec2 vec, f32 angle) {
-    return wdl_v2(vec.x * cosf(angle) - vec.y * sinf(angle),
-        vec.x * sinf(angle) + vec.y * cosf(angle));
+void debug_draw_quad(Quad quad, Camera cam) {
+    DebugCtx* ctx = debug_ctx_begin(cam);
+    if (ctx == NULL) {
+        return;
+    }
+
+    WDL_Vec2 corners[4];
+    debug_quad_corners(quad, corners);
+    u32 color = color_pack_rgba8(quad.color);
+    const u8 indices[6] = {0, 1, 2, 2, 3, 1};
+    for (u8 i = 0; i < 6; i++) {
+        debug_push_vertex(ctx, &ctx->_triangles, corners[indices[i]], color);
+    }
 }
 
 void debug_draw_quad_outline(Quad quad, Camera cam) {
-    WDL_Vec2 bl = wdl_v2_sub(wdl_v2s(-0.5f), quad.pivot);
-    bl = wdl_v2_mul(bl, quad.size);
-    bl = vec2_rotate(bl, quad.rotation);
-    bl = wdl_v2_add(bl, quad.pos);
-
-    WDL_Vec2 tr = wdl_v2_sub(wdl_v2s(0.5f), quad.pivot);
-    tr = wdl_v2_mul(tr, quad.size);
-    tr = vec2_rotate(tr, quad.rotation);
-    tr = wdl_v2_add(tr, quad.pos);
-
-    const f32 QUARTER_TURN = 3.14f / 2.0f;
-    debug_draw_line_angle(bl, quad.rotation, -quad.size.x, quad.color, cam);
-    debug_draw_line_angle(tr, quad.rotation, quad.size.x, quad.color, cam);
-    debug_draw_line_angle(bl, quad.rotation + QUARTER_TURN, -quad.size.y, quad.color, cam);
-    debug_draw_line_angle(tr, quad.rotation - QUARTER_TURN, -quad.size.y, quad.color, cam);
+    DebugCtx* ctx = debug_ctx_begin(cam);
+    if (ctx == NULL) {
+        return;
+    }
+
+    WDL_Vec2 corners[4];
+    debug_quad_corners(quad, corners);
+    u32 color = color_pack_rgba8(quad.color);
+    const u8 indices[8] = {0, 1, 1, 3, 3, 2, 2, 0};
+    for (u8 i = 0; i < 8; i++) {
+        debug_push_vertex(ctx, &ctx->_lines, corners[indices[i]], color);
+    }
 }
 
 void debug_draw_line(WDL_Vec2 a, WDL_Vec2 b, Color color, Camera cam) {
-    WDL_Vec2 diff = wdl_v2_sub(a, b);
-    f32 angle = atan2f(diff.y, diff.x);
-    debug_draw_line_angle(a, angle, wdl_v2_magnitude(diff), color, cam);
+    DebugCtx* ctx = debug_ctx_begin(cam);
+    if (ctx == NULL) {
+        return;
+    }
+
+    u32 packed = color_pack_rgba8(color);
+    debug_push_vertex(ctx, &ctx->_lines, a, packed);
+    debug_push_vertex(ctx, &ctx->_lines, b, packed);
 }
 
 void debug_draw_line_angle(WDL_Vec2 pos, f32 angle, f32 length, Color color, Camera cam) {
-    Quad quad = {
-        .pos = pos,
-        .color = color,
-        .size = wdl_v2(length, cam.zoom / cam.screen_size.y),
-        .pivot = wdl_v2(0.5f, 0.0f),
-        .rotation = angle,
-    };
-    debug_draw_quad(quad, cam);
+    WDL_Vec2 end = wdl_v2(pos.x + cosf(angle) * length, pos.y + sinf(angle) * length);
+    debug_draw_line(pos, end, color, cam);
 }
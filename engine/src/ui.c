@@ -0,0 +1,556 @@
+#include "engine/ui.h"
+#include "engine/font.h"
+#include "engine/profiler.h"
+#include "engine.h"
+#include "waddle.h"
+
+#include <string.h>
+
+#define UI_MAX_RECTS 1024
+#define UI_MAX_GLYPHS 8192
+#define UI_MAX_PANELS 64
+// Panel plus nested lists.
+#define UI_MAX_DEPTH 8
+
+typedef struct UIRect UIRect;
+struct UIRect {
+    WDL_Vec2 min;
+    WDL_Vec2 max;
+};
+
+typedef struct UIGlyph UIGlyph;
+struct UIGlyph {
+    // Top left corner relative to the top left of the text.
+    WDL_Vec2 offset;
+    WDL_Vec2 size;
+    WDL_Vec2 uv[2];
+};
+
+// State kept between frames.
+typedef struct UIWidget UIWidget;
+struct UIWidget {
+    // Text layout, redone when the text, font size or atlas changes. Buffers
+    // only grow so a widget with changing text settles on one allocation.
+    u8* text;
+    u32 text_len;
+    u32 font_size;
+    u32 atlas_generation;
+    // Atlas of 'font_size', the font may be at another size when the text is
+    // pushed.
+    GfxTexture atlas;
+    WDL_Vec2 text_size;
+    UIGlyph* glyphs;
+    u32 capacity;
+
+    // Height of the content of a panel or list.
+    f32 content_height;
+};
+
+typedef struct UIContainer UIContainer;
+struct UIContainer {
+    u64 id;
+    UIWidget* widget;
+    UIRect rect;
+    UIRect clip;
+    WDL_Vec2 cursor;
+    // Where the content started, before scrolling.
+    f32 content_top;
+    // Widgets declared in it so far, see 'ui_next_id()'.
+    u32 item_count;
+};
+
+// Source of a glyph quad of the frame, so its UVs can be looked up again if
+// the atlas grows after it was pushed. 't' is the visible part of the glyph
+// in [0, 1].
+typedef struct UIGlyphRef UIGlyphRef;
+struct UIGlyphRef {
+    u32 codepoint;
+    u32 font_size;
+    WDL_Vec2 t[2];
+};
+
+// Range of the frame's geometry belonging to a panel.
+typedef struct UIPanel UIPanel;
+struct UIPanel {
+    u32 first_rect;
+    u32 rect_count;
+    u32 first_glyph;
+    u32 glyph_count;
+};
+
+struct UI {
+    WDL_Arena* arena;
+    Font* font;
+    UIStyle style;
+
+    // Key: u64, widget id
+    // Value: UIWidget*, stable while the map grows
+    WDL_HashMap* widgets;
+
+    WDL_Ivec2 screen_size;
+    WDL_Vec2 mouse;
+    b8 mouse_pressed;
+    b8 mouse_released;
+    u64 active;
+
+    UIContainer stack[UI_MAX_DEPTH];
+    u32 depth;
+
+    QuadInstance* rects;
+    u32 rect_count;
+    QuadInstance* glyphs;
+    UIGlyphRef* glyph_refs;
+    u32 glyph_count;
+    // An atlas grew during a layout, so glyphs pushed before it are stale.
+    b8 atlas_grown;
+    UIPanel panels[UI_MAX_PANELS];
+    u32 panel_count;
+
+    u32 layouts;
+};
+
+static u64 ui_hash(u64 seed, const void* data, u64 len) {
+    // FNV-1a
+    const u8* bytes = data;
+    u64 hash = seed;
+    for (u64 i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+static UIRect ui_rect_intersect(UIRect a, UIRect b) {
+    return (UIRect) {
+        .min = wdl_v2(a.min.x > b.min.x ? a.min.x : b.min.x, a.min.y > b.min.y ? a.min.y : b.min.y),
+        .max = wdl_v2(a.max.x < b.max.x ? a.max.x : b.max.x, a.max.y < b.max.y ? a.max.y : b.max.y),
+    };
+}
+
+static b8 ui_rect_contains(UIRect rect, WDL_Vec2 point) {
+    return point.x >= rect.min.x && point.x < rect.max.x &&
+        point.y >= rect.min.y && point.y < rect.max.y;
+}
+
+static UIWidget* ui_widget_get(UI* ui, u64 id) {
+    UIWidget** widget = wdl_hm_getp(ui->widgets, id);
+    if (widget != NULL) {
+        return *widget;
+    }
+
+    UIWidget* new_widget = wdl_arena_push(ui->arena, sizeof(UIWidget));
+    wdl_hm_insert(ui->widgets, id, new_widget);
+    return new_widget;
+}
+
+static UIContainer* ui_container(UI* ui) {
+    wdl_assert(ui->depth > 0, "UI widgets have to be inside of a panel.");
+    return &ui->stack[ui->depth - 1];
+}
+
+// ID of the next widget in the current container, derived from its position
+// so text changing every frame still hits the same widget.
+static u64 ui_next_id(UI* ui) {
+    UIContainer* container = ui_container(ui);
+    u32 index = container->item_count++;
+    return ui_hash(container->id, &index, sizeof(index));
+}
+
+// -- Text layout --
+
+static void ui_layout_text_sized(UI* ui, UIWidget* widget, WDL_Str text) {
+    Font* font = ui->font;
+    u32 generation = font_get_atlas_generation(font);
+    if (widget->text != NULL &&
+            widget->text_len == text.len &&
+            widget->font_size == ui->style.font_size &&
+            widget->atlas_generation == generation &&
+            memcmp(widget->text, text.data, text.len) == 0) {
+        return;
+    }
+    ui->layouts++;
+
+    if (widget->capacity < text.len) {
+        widget->capacity = text.len;
+        widget->text = wdl_arena_push_no_zero(ui->arena, text.len);
+        widget->glyphs = wdl_arena_push_no_zero(ui->arena, text.len * sizeof(UIGlyph));
+    }
+    if (text.len > 0) {
+        memcpy(widget->text, text.data, text.len);
+    }
+    widget->text_len = text.len;
+    widget->font_size = ui->style.font_size;
+    // Captured before any glyph is added so an atlas expansion caused by this
+    // layout invalidates it.
+    widget->atlas_generation = generation;
+    widget->atlas = font_get_atlas(font);
+
+    FontMetrics metrics = font_get_metrics(font);
+    f32 pen = 0.0f;
+    for (u32 i = 0; i < text.len; i++) {
+        if (i > 0) {
+            pen += font_get_kerning(font, text.data[i - 1], text.data[i]);
+        }
+
+        Glyph glyph = font_get_glyph(font, text.data[i]);
+        widget->glyphs[i] = (UIGlyph) {
+            .offset = wdl_v2(pen + glyph.offset.x, metrics.ascent + glyph.offset.y),
+            .size = glyph.size,
+            .uv = {glyph.uv[0], glyph.uv[1]},
+        };
+
+        if (i < text.len - 1) {
+            pen += glyph.advance;
+        } else {
+            pen += glyph.size.x;
+        }
+    }
+    widget->text_size = wdl_v2(pen, metrics.ascent - metrics.descent);
+}
+
+// Lays the text out at the UI font size. The shared font is left at the size
+// it had.
+static void ui_layout_text(UI* ui, UIWidget* widget, WDL_Str text) {
+    Font* font = ui->font;
+    u32 prev_size = font_get_size(font);
+    font_set_size(font, ui->style.font_size);
+    u32 generation = font_get_atlas_generation(font);
+    ui_layout_text_sized(ui, widget, text);
+    if (font_get_atlas_generation(font) != generation) {
+        ui->atlas_grown = true;
+    }
+    if (prev_size != 0 && prev_size != ui->style.font_size) {
+        font_set_size(font, prev_size);
+    }
+}
+
+static void ui_glyph_uvs(const WDL_Vec2 uv[2], const WDL_Vec2 t[2], WDL_Vec2 out[2]) {
+    WDL_Vec2 uv_size = wdl_v2_sub(uv[1], uv[0]);
+    out[0] = wdl_v2_add(uv[0], wdl_v2_mul(uv_size, t[0]));
+    out[1] = wdl_v2_add(uv[0], wdl_v2_mul(uv_size, t[1]));
+}
+
+// Looks the UVs of every glyph of the frame up again. Only needed when an
+// atlas grew, the glyphs are all resident by then.
+static void ui_refresh_glyph_uvs(UI* ui) {
+    Font* font = ui->font;
+    u32 prev_size = font_get_size(font);
+    for (u32 i = 0; i < ui->glyph_count; i++) {
+        const UIGlyphRef* ref = &ui->glyph_refs[i];
+        if (font_get_size(font) != ref->font_size) {
+            font_set_size(font, ref->font_size);
+        }
+        Glyph glyph = font_get_glyph(font, ref->codepoint);
+        ui_glyph_uvs(glyph.uv, ref->t, ui->glyphs[i].uvs);
+    }
+    if (prev_size != 0 && prev_size != font_get_size(font)) {
+        font_set_size(font, prev_size);
+    }
+}
+
+// -- Geometry --
+
+// Clips a quad with its top left corner at 'pos', shrinking the uvs along
+// with it. Returns false if nothing is left.
+static b8 ui_clip(UIRect clip, QuadInstance* quad) {
+    UIRect rect = {quad->pos, wdl_v2_add(quad->pos, quad->size)};
+    UIRect visible = ui_rect_intersect(rect, clip);
+    if (visible.min.x >= visible.max.x || visible.min.y >= visible.max.y) {
+        return false;
+    }
+    if (visible.min.x == rect.min.x && visible.min.y == rect.min.y &&
+            visible.max.x == rect.max.x && visible.max.y == rect.max.y) {
+        return true;
+    }
+
+    WDL_Vec2 uv_min = quad->uvs[0];
+    WDL_Vec2 uv_size = wdl_v2_sub(quad->uvs[1], quad->uvs[0]);
+    WDL_Vec2 t_min = wdl_v2_div(wdl_v2_sub(visible.min, rect.min), quad->size);
+    WDL_Vec2 t_max = wdl_v2_div(wdl_v2_sub(visible.max, rect.min), quad->size);
+    quad->uvs[0] = wdl_v2_add(uv_min, wdl_v2_mul(uv_size, t_min));
+    quad->uvs[1] = wdl_v2_add(uv_min, wdl_v2_mul(uv_size, t_max));
+    quad->pos = visible.min;
+    quad->size = wdl_v2_sub(visible.max, visible.min);
+    return true;
+}
+
+// Geometry past the capacity of a frame is dropped.
+static void ui_push_rect(UI* ui, UIRect rect, Color color) {
+    if (ui->rect_count == UI_MAX_RECTS) {
+        return;
+    }
+
+    QuadInstance quad = {
+        .pos = rect.min,
+        .size = wdl_v2_sub(rect.max, rect.min),
+        .pivot = wdl_v2s(-1.0f),
+        .color = color,
+        .texture = GFX_TEXTURE_NULL,
+        .uvs = {wdl_v2s(0.0f), wdl_v2s(1.0f)},
+    };
+    if (ui->depth > 0 && !ui_clip(ui_container(ui)->clip, &quad)) {
+        return;
+    }
+    ui->rects[ui->rect_count++] = quad;
+}
+
+static void ui_push_text(UI* ui, const UIWidget* widget, WDL_Vec2 pos) {
+    UIRect clip = ui_container(ui)->clip;
+    for (u32 i = 0; i < widget->text_len; i++) {
+        if (ui->glyph_count == UI_MAX_GLYPHS) {
+            return;
+        }
+
+        const UIGlyph* glyph = &widget->glyphs[i];
+        QuadInstance quad = {
+            .pos = wdl_v2_add(pos, glyph->offset),
+            .size = glyph->size,
+            .pivot = wdl_v2s(-1.0f),
+            .color = ui->style.text,
+            .texture = widget->atlas,
+            .uvs = {wdl_v2s(0.0f), wdl_v2s(1.0f)},
+        };
+        // Clipped in glyph space first so the visible part can be kept.
+        if (ui_clip(clip, &quad)) {
+            UIGlyphRef* ref = &ui->glyph_refs[ui->glyph_count];
+            *ref = (UIGlyphRef) {
+                .codepoint = widget->text[i],
+                .font_size = widget->font_size,
+                .t = {quad.uvs[0], quad.uvs[1]},
+            };
+            ui_glyph_uvs(glyph->uv, ref->t, quad.uvs);
+            ui->glyphs[ui->glyph_count++] = quad;
+        }
+    }
+}
+
+// Reserves the next 'height' pixels of the current container.
+static UIRect ui_next_rect(UI* ui, f32 width, f32 height) {
+    UIContainer* container = ui_container(ui);
+    UIRect rect = {
+        .min = container->cursor,
+        .max = wdl_v2_add(container->cursor, wdl_v2(width, height)),
+    };
+    container->cursor.y += height + ui->style.spacing;
+    return rect;
+}
+
+static f32 ui_content_width(UI* ui) {
+    UIContainer* container = ui_container(ui);
+    f32 right = container->rect.max.x;
+    // Lists span the whole panel content area, panels have padding.
+    if (ui->depth == 1) {
+        right -= ui->style.padding;
+    }
+    return right - container->cursor.x;
+}
+
+// Hover is limited to the visible part of the widget.
+static b8 ui_hovered(UI* ui, UIRect rect) {
+    return ui_rect_contains(ui_rect_intersect(rect, ui_container(ui)->clip), ui->mouse);
+}
+
+// Returns true when clicked.
+static b8 ui_interact(UI* ui, u64 id, UIRect rect, b8* hot) {
+    *hot = ui_hovered(ui, rect);
+    if (*hot && ui->mouse_pressed) {
+        ui->active = id;
+    }
+    return *hot && ui->mouse_released && ui->active == id;
+}
+
+// -- API --
+
+UI* ui_new(WDL_Arena* arena, Font* font) {
+    UI* ui = wdl_arena_push(arena, sizeof(UI));
+    *ui = (UI) {
+        .arena = arena,
+        .font = font,
+        .style = {
+            .font_size = 24,
+            .padding = 8.0f,
+            .spacing = 4.0f,
+            .text = COLOR_WHITE,
+            .panel = {0.08f, 0.08f, 0.1f, 0.85f},
+            .list = {0.04f, 0.04f, 0.05f, 0.85f},
+            .button = {0.2f, 0.2f, 0.25f, 1.0f},
+            .button_hot = {0.3f, 0.3f, 0.38f, 1.0f},
+            .button_active = {0.15f, 0.15f, 0.2f, 1.0f},
+            .item_selected = {0.25f, 0.35f, 0.6f, 1.0f},
+        },
+        .widgets = wdl_hm_new(wdl_hm_desc_generic(arena, 256, u64, UIWidget*)),
+    };
+    return ui;
+}
+
+UIStyle* ui_style(UI* ui) {
+    return &ui->style;
+}
+
+void ui_begin(UI* ui, WDL_Ivec2 screen_size) {
+    WDL_Arena* frame_arena = get_frame_arena();
+    ui->screen_size = screen_size;
+    ui->mouse = mouse_pos();
+    ui->mouse_pressed = mouse_button_pressed(MOUSE_BUTTON_LEFT);
+    ui->mouse_released = mouse_button_released(MOUSE_BUTTON_LEFT);
+    ui->depth = 0;
+    ui->rects = wdl_arena_push_no_zero(frame_arena, UI_MAX_RECTS * sizeof(QuadInstance));
+    ui->rect_count = 0;
+    ui->glyphs = wdl_arena_push_no_zero(frame_arena, UI_MAX_GLYPHS * sizeof(QuadInstance));
+    ui->glyph_refs = wdl_arena_push_no_zero(frame_arena, UI_MAX_GLYPHS * sizeof(UIGlyphRef));
+    ui->glyph_count = 0;
+    ui->atlas_grown = false;
+    ui->panel_count = 0;
+    ui->layouts = 0;
+}
+
+void ui_end(UI* ui, Renderer* rend) {
+    wdl_assert(ui->depth == 0, "UI panel or list not ended.");
+    if (ui->mouse_released) {
+        ui->active = 0;
+    }
+    if (ui->atlas_grown) {
+        ui_refresh_glyph_uvs(ui);
+    }
+
+    Camera cam = {
+        .pos = wdl_v2(ui->screen_size.x / 2.0f, ui->screen_size.y / 2.0f),
+        .zoom = ui->screen_size.y,
+        .screen_size = ui->screen_size,
+        .invert_y = true,
+    };
+    renderer_begin(rend, cam);
+    renderer_set_layer(rend, RENDER_LAYER_UI);
+    for (u32 i = 0; i < ui->panel_count; i++) {
+        const UIPanel* panel = &ui->panels[i];
+        renderer_draw_quads(rend, &ui->rects[panel->first_rect], panel->rect_count);
+        renderer_draw_glyphs(rend, &ui->glyphs[panel->first_glyph], panel->glyph_count);
+    }
+    renderer_end(rend);
+
+    prof_counter(wdl_str_lit("ui_text_layouts"), ui->layouts);
+}
+
+void ui_panel_begin(UI* ui, WDL_Str id, WDL_Vec2 pos, WDL_Vec2 size) {
+    wdl_assert(ui->depth == 0, "UI panels can't be nested.");
+    wdl_assert(ui->panel_count < UI_MAX_PANELS, "Too many UI panels.");
+
+    u64 hash = ui_hash(0xcbf29ce484222325, id.data, id.len);
+    UIWidget* widget = ui_widget_get(ui, hash);
+    if (size.y <= 0.0f) {
+        size.y = widget->content_height + ui->style.padding * 2.0f;
+    }
+
+    UIRect rect = {pos, wdl_v2_add(pos, size)};
+    UIRect screen = {wdl_v2s(0.0f), wdl_v2(ui->screen_size.x, ui->screen_size.y)};
+    ui->panels[ui->panel_count++] = (UIPanel) {
+        .first_rect = ui->rect_count,
+        .first_glyph = ui->glyph_count,
+    };
+    ui->stack[ui->depth++] = (UIContainer) {
+        .id = hash,
+        .widget = widget,
+        .rect = rect,
+        .clip = ui_rect_intersect(rect, screen),
+        .cursor = wdl_v2_add(pos, wdl_v2s(ui->style.padding)),
+        .content_top = pos.y + ui->style.padding,
+    };
+    ui_push_rect(ui, rect, ui->style.panel);
+}
+
+void ui_panel_end(UI* ui) {
+    wdl_assert(ui->depth == 1, "UI panel ended without a matching begin.");
+    UIContainer* container = ui_container(ui);
+    f32 height = container->cursor.y - container->content_top;
+    if (height > 0.0f) {
+        height -= ui->style.spacing;
+    }
+    container->widget->content_height = height;
+    ui->depth--;
+
+    UIPanel* panel = &ui->panels[ui->panel_count - 1];
+    panel->rect_count = ui->rect_count - panel->first_rect;
+    panel->glyph_count = ui->glyph_count - panel->first_glyph;
+}
+
+void ui_label(UI* ui, WDL_Str text) {
+    UIWidget* widget = ui_widget_get(ui, ui_next_id(ui));
+    ui_layout_text(ui, widget, text);
+
+    UIRect rect = ui_next_rect(ui, widget->text_size.x, widget->text_size.y);
+    ui_push_text(ui, widget, rect.min);
+}
+
+b8 ui_button(UI* ui, WDL_Str label) {
+    u64 id = ui_next_id(ui);
+    UIWidget* widget = ui_widget_get(ui, id);
+    ui_layout_text(ui, widget, label);
+
+    f32 padding = ui->style.padding;
+    WDL_Vec2 size = wdl_v2_add(widget->text_size, wdl_v2s(padding * 2.0f));
+    UIRect rect = ui_next_rect(ui, size.x, size.y);
+
+    b8 hot;
+    b8 clicked = ui_interact(ui, id, rect, &hot);
+    Color color = ui->style.button;
+    if (hot) {
+        color = ui->active == id ? ui->style.button_active : ui->style.button_hot;
+    }
+    ui_push_rect(ui, rect, color);
+    ui_push_text(ui, widget, wdl_v2_add(rect.min, wdl_v2s(padding)));
+    return clicked;
+}
+
+void ui_list_begin(UI* ui, WDL_Str id, f32 height, f32* scroll) {
+    wdl_assert(ui->depth < UI_MAX_DEPTH, "UI lists nested too deep.");
+    UIContainer* parent = ui_container(ui);
+    u64 hash = ui_hash(parent->id, id.data, id.len);
+    UIWidget* widget = ui_widget_get(ui, hash);
+
+    f32 max_scroll = widget->content_height - height;
+    if (max_scroll < 0.0f) {
+        max_scroll = 0.0f;
+    }
+    *scroll = wdl_clamp(*scroll, 0.0f, max_scroll);
+
+    UIRect rect = ui_next_rect(ui, ui_content_width(ui), height);
+    ui_push_rect(ui, rect, ui->style.list);
+    ui->stack[ui->depth++] = (UIContainer) {
+        .id = hash,
+        .widget = widget,
+        .rect = rect,
+        .clip = ui_rect_intersect(rect, parent->clip),
+        .cursor = wdl_v2(rect.min.x, rect.min.y - *scroll),
+        .content_top = rect.min.y - *scroll,
+    };
+}
+
+void ui_list_end(UI* ui) {
+    wdl_assert(ui->depth > 1, "UI list ended without a matching begin.");
+    UIContainer* container = ui_container(ui);
+    f32 height = container->cursor.y - container->content_top;
+    if (height > 0.0f) {
+        height -= ui->style.spacing;
+    }
+    container->widget->content_height = height;
+    ui->depth--;
+}
+
+b8 ui_list_item(UI* ui, WDL_Str text, b8 selected) {
+    u64 id = ui_next_id(ui);
+    UIWidget* widget = ui_widget_get(ui, id);
+    ui_layout_text(ui, widget, text);
+
+    f32 padding = ui->style.padding;
+    UIRect rect = ui_next_rect(ui, ui_content_width(ui), widget->text_size.y + padding);
+
+    b8 hot;
+    b8 clicked = ui_interact(ui, id, rect, &hot);
+    if (selected) {
+        ui_push_rect(ui, rect, ui->style.item_selected);
+    } else if (hot) {
+        ui_push_rect(ui, rect, ui->style.button_hot);
+    }
+    ui_push_text(ui, widget, wdl_v2(rect.min.x + padding, rect.min.y + padding * 0.5f));
+    return clicked;
+}
@@ -20,3 +20,35 @@ WDL_Str read_file(WDL_Arena* arena, WDL_Str filename) {
 
     return wdl_str(content, len);
 }
+
+SortItem* radix_sort(SortItem* items, SortItem* temp, u32 count) {
+    if (count == 0) {
+        return items;
+    }
+
+    for (u32 shift = 0; shift < 64; shift += 8) {
+        u32 offsets[256] = {0};
+        for (u32 i = 0; i < count; i++) {
+            offsets[(items[i].key >> shift) & 0xff]++;
+        }
+        if (offsets[(items[0].key >> shift) & 0xff] == count) {
+            continue;
+        }
+
+        u32 sum = 0;
+        for (u32 i = 0; i < 256; i++) {
+            u32 bucket_count = offsets[i];
+            offsets[i] = sum;
+            sum += bucket_count;
+        }
+        for (u32 i = 0; i < count; i++) {
+            temp[offsets[(items[i].key >> shift) & 0xff]++] = items[i];
+        }
+
+        SortItem* swap = items;
+        items = temp;
+        temp = swap;
+    }
+
+    return items;
+}
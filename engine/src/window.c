@@ -89,6 +89,8 @@ Window* window_create(WDL_Arena* arena, WindowDesc desc) {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_RESIZABLE, desc.resizable);
+    // Used by the renderer to reject fragments hidden behind opaque quads.
+    glfwWindowHint(GLFW_DEPTH_BITS, 24);
     *window = (Window) {
         .handle = glfwCreateWindow(desc.size.x,
                 desc.size.y,
@@ -149,6 +151,21 @@ WDL_Ivec2 window_get_size(const Window* window) {
     return window->size;
 }
 
+u32 window_get_refresh_rate(const Window* window) {
+    GLFWmonitor* monitor = glfwGetWindowMonitor(window->handle);
+    if (monitor == NULL) {
+        monitor = glfwGetPrimaryMonitor();
+    }
+    if (monitor == NULL) {
+        return 0;
+    }
+    const GLFWvidmode* mode = glfwGetVideoMode(monitor);
+    if (mode == NULL || mode->refreshRate <= 0) {
+        return 0;
+    }
+    return mode->refreshRate;
+}
+
 void* window_get_user_data(const Window* window) {
     return window->user_data;
 }
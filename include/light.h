@@ -0,0 +1,35 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include "engine.h"
+
+// Terraria style tile lighting. Every tile has a light level that spreads to
+// its four neighbors, losing LIGHT_FALLOFF_EMPTY per empty tile and
+// LIGHT_FALLOFF_SOLID per solid one. Edits are applied with incremental BFS
+// passes that only visit the tiles whose light actually changes, never the
+// whole map.
+//
+// The levels are mirrored into an R_U8 texture meant for
+// 'renderer_set_lightmap()', only the chunks changed since the last upload
+// are sent to the GPU.
+#define LIGHT_MAX_LEVEL 15
+#define LIGHT_FALLOFF_EMPTY 1
+#define LIGHT_FALLOFF_SOLID 4
+#define LIGHT_CHUNK_SIZE 16
+
+typedef struct LightGrid LightGrid;
+
+// Every tile starts out empty and dark.
+extern LightGrid* light_grid_new(WDL_Arena* arena, WDL_Ivec2 size);
+// Level the tile emits by itself, 0 removes the source. Tiles outside of the
+// grid are ignored.
+extern void light_set_source(LightGrid* grid, i32 x, i32 y, u8 level);
+extern void light_set_solid(LightGrid* grid, i32 x, i32 y, b8 solid);
+// Returns 0 outside of the grid.
+extern u8   light_get(const LightGrid* grid, i32 x, i32 y);
+// Uploads the chunks changed since the last upload.
+extern void light_upload(LightGrid* grid);
+// Texel (x, y) holds the level of tile (x, y), LIGHT_MAX_LEVEL maps to 1.
+extern GfxTexture light_get_texture(const LightGrid* grid);
+
+#endif // LIGHT_H
@@ -0,0 +1,288 @@
+#include "light.h"
+#include "waddle.h"
+
+#include <string.h>
+
+// A tile is cleared at most once per edit and queues its four neighbors when
+// it is, and it's raised at most LIGHT_MAX_LEVEL times. Sizing the queues for
+// that means they can never overflow.
+typedef struct LightRemoval LightRemoval;
+struct LightRemoval {
+    u32 index;
+    u8 level;
+};
+
+// Changed tiles in grid coordinates, max is exclusive.
+typedef struct LightChunk LightChunk;
+struct LightChunk {
+    b8 dirty;
+    WDL_Ivec2 dirty_min;
+    WDL_Ivec2 dirty_max;
+};
+
+struct LightGrid {
+    WDL_Ivec2 size;
+    u8* levels;
+    u8* sources;
+    u8* falloffs;
+
+    // Ring buffers, the capacities are powers of two.
+    u32* add_queue;
+    u32 add_mask;
+    u32 add_head;
+    u32 add_count;
+    LightRemoval* remove_queue;
+    u32 remove_mask;
+    u32 remove_head;
+    u32 remove_count;
+
+    WDL_Ivec2 chunk_count;
+    LightChunk* chunks;
+    GfxTexture texture;
+};
+
+static u32 next_pow2(u32 value) {
+    u32 result = 1;
+    while (result < value) {
+        result *= 2;
+    }
+    return result;
+}
+
+LightGrid* light_grid_new(WDL_Arena* arena, WDL_Ivec2 size) {
+    u32 tile_count = size.x * size.y;
+    u32 add_capacity = next_pow2(tile_count * (LIGHT_MAX_LEVEL + 4) + 5);
+    u32 remove_capacity = next_pow2(tile_count);
+    WDL_Ivec2 chunk_count = wdl_iv2(
+            (size.x + LIGHT_CHUNK_SIZE - 1) / LIGHT_CHUNK_SIZE,
+            (size.y + LIGHT_CHUNK_SIZE - 1) / LIGHT_CHUNK_SIZE);
+
+    LightGrid* grid = wdl_arena_push(arena, sizeof(LightGrid));
+    *grid = (LightGrid) {
+        .size = size,
+        .levels = wdl_arena_push(arena, tile_count),
+        .sources = wdl_arena_push(arena, tile_count),
+        .falloffs = wdl_arena_push_no_zero(arena, tile_count),
+        .add_queue = wdl_arena_push_no_zero(arena, add_capacity * sizeof(u32)),
+        .add_mask = add_capacity - 1,
+        .remove_queue = wdl_arena_push_no_zero(arena, remove_capacity * sizeof(LightRemoval)),
+        .remove_mask = remove_capacity - 1,
+        .chunk_count = chunk_count,
+        .chunks = wdl_arena_push(arena, chunk_count.x * chunk_count.y * sizeof(LightChunk)),
+    };
+    memset(grid->falloffs, LIGHT_FALLOFF_EMPTY, tile_count);
+    grid->texture = gfx_texture_new((GfxTextureDesc) {
+            .data = grid->levels,
+            .size = size,
+            .format = GFX_TEXTURE_FORMAT_R_U8,
+            .sampler = GFX_TEXTURE_SAMPLER_LINEAR,
+            .alignment = 1,
+        });
+
+    return grid;
+}
+
+// -- Propagation --
+
+static void light_write(LightGrid* grid, u32 index, u8 level) {
+    grid->levels[index] = level;
+
+    i32 x = index % grid->size.x;
+    i32 y = index / grid->size.x;
+    LightChunk* chunk = &grid->chunks[x / LIGHT_CHUNK_SIZE + y / LIGHT_CHUNK_SIZE * grid->chunk_count.x];
+    if (!chunk->dirty) {
+        chunk->dirty = true;
+        chunk->dirty_min = wdl_iv2(x, y);
+        chunk->dirty_max = wdl_iv2(x + 1, y + 1);
+        return;
+    }
+    chunk->dirty_min.x = x < chunk->dirty_min.x ? x : chunk->dirty_min.x;
+    chunk->dirty_min.y = y < chunk->dirty_min.y ? y : chunk->dirty_min.y;
+    chunk->dirty_max.x = x + 1 > chunk->dirty_max.x ? x + 1 : chunk->dirty_max.x;
+    chunk->dirty_max.y = y + 1 > chunk->dirty_max.y ? y + 1 : chunk->dirty_max.y;
+}
+
+static void light_push_add(LightGrid* grid, u32 index) {
+    wdl_assert(grid->add_count <= grid->add_mask, "Light add queue overflow.");
+    grid->add_queue[(grid->add_head + grid->add_count) & grid->add_mask] = index;
+    grid->add_count++;
+}
+
+static void light_push_remove(LightGrid* grid, u32 index, u8 level) {
+    wdl_assert(grid->remove_count <= grid->remove_mask, "Light remove queue overflow.");
+    grid->remove_queue[(grid->remove_head + grid->remove_count) & grid->remove_mask] = (LightRemoval) { index, level };
+    grid->remove_count++;
+}
+
+// Writes the in bounds neighbors of 'index' to 'neighbors' and returns how
+// many there are.
+static u32 light_neighbors(const LightGrid* grid, u32 index, u32 neighbors[4]) {
+    i32 x = index % grid->size.x;
+    i32 y = index / grid->size.x;
+    u32 count = 0;
+    if (x > 0) {
+        neighbors[count++] = index - 1;
+    }
+    if (x < grid->size.x - 1) {
+        neighbors[count++] = index + 1;
+    }
+    if (y > 0) {
+        neighbors[count++] = index - grid->size.x;
+    }
+    if (y < grid->size.y - 1) {
+        neighbors[count++] = index + grid->size.x;
+    }
+    return count;
+}
+
+// Clears every tile lit through the queued tiles. Tiles at least as bright
+// as the light being removed are lit from elsewhere, they're queued to fill
+// the cleared area back in. Cleared sources are queued to shine again.
+static void light_unpropagate(LightGrid* grid) {
+    while (grid->remove_count > 0) {
+        LightRemoval removal = grid->remove_queue[grid->remove_head];
+        grid->remove_head = (grid->remove_head + 1) & grid->remove_mask;
+        grid->remove_count--;
+
+        u32 neighbors[4];
+        u32 neighbor_count = light_neighbors(grid, removal.index, neighbors);
+        for (u32 i = 0; i < neighbor_count; i++) {
+            u32 neighbor = neighbors[i];
+            u8 level = grid->levels[neighbor];
+            if (level == 0) {
+                continue;
+            }
+
+            if (level < removal.level) {
+                light_write(grid, neighbor, 0);
+                light_push_remove(grid, neighbor, level);
+                if (grid->sources[neighbor] > 0) {
+                    light_push_add(grid, neighbor);
+                }
+            } else {
+                light_push_add(grid, neighbor);
+            }
+        }
+    }
+}
+
+// Spreads light out from the queued tiles, each tile is first raised to its
+// own source level.
+static void light_propagate(LightGrid* grid) {
+    while (grid->add_count > 0) {
+        u32 index = grid->add_queue[grid->add_head];
+        grid->add_head = (grid->add_head + 1) & grid->add_mask;
+        grid->add_count--;
+
+        if (grid->sources[index] > grid->levels[index]) {
+            light_write(grid, index, grid->sources[index]);
+        }
+        u8 level = grid->levels[index];
+
+        u32 neighbors[4];
+        u32 neighbor_count = light_neighbors(grid, index, neighbors);
+        for (u32 i = 0; i < neighbor_count; i++) {
+            u32 neighbor = neighbors[i];
+            u8 falloff = grid->falloffs[neighbor];
+            if (level <= falloff) {
+                continue;
+            }
+            u8 spread = level - falloff;
+            if (spread > grid->levels[neighbor]) {
+                light_write(grid, neighbor, spread);
+                light_push_add(grid, neighbor);
+            }
+        }
+    }
+}
+
+// Recomputes the light around a tile whose source or falloff changed. Its
+// old light is removed first, which handles anything getting darker, then
+// the tile and its neighbors spread light again, which handles anything
+// getting brighter.
+static void light_refresh(LightGrid* grid, u32 index) {
+    u8 level = grid->levels[index];
+    if (level > 0) {
+        light_write(grid, index, 0);
+        light_push_remove(grid, index, level);
+        light_unpropagate(grid);
+    }
+
+    light_push_add(grid, index);
+    u32 neighbors[4];
+    u32 neighbor_count = light_neighbors(grid, index, neighbors);
+    for (u32 i = 0; i < neighbor_count; i++) {
+        light_push_add(grid, neighbors[i]);
+    }
+    light_propagate(grid);
+}
+
+// -- API --
+
+void light_set_source(LightGrid* grid, i32 x, i32 y, u8 level) {
+    if (x < 0 || x >= grid->size.x || y < 0 || y >= grid->size.y) {
+        return;
+    }
+    u32 index = x + y * grid->size.x;
+    level = level < LIGHT_MAX_LEVEL ? level : LIGHT_MAX_LEVEL;
+    if (grid->sources[index] == level) {
+        return;
+    }
+    grid->sources[index] = level;
+    light_refresh(grid, index);
+}
+
+void light_set_solid(LightGrid* grid, i32 x, i32 y, b8 solid) {
+    if (x < 0 || x >= grid->size.x || y < 0 || y >= grid->size.y) {
+        return;
+    }
+    u32 index = x + y * grid->size.x;
+    u8 falloff = solid ? LIGHT_FALLOFF_SOLID : LIGHT_FALLOFF_EMPTY;
+    if (grid->falloffs[index] == falloff) {
+        return;
+    }
+    grid->falloffs[index] = falloff;
+    light_refresh(grid, index);
+}
+
+u8 light_get(const LightGrid* grid, i32 x, i32 y) {
+    if (x < 0 || x >= grid->size.x || y < 0 || y >= grid->size.y) {
+        return 0;
+    }
+    return grid->levels[x + y * grid->size.x];
+}
+
+void light_upload(LightGrid* grid) {
+    u32 chunk_count = grid->chunk_count.x * grid->chunk_count.y;
+    for (u32 i = 0; i < chunk_count; i++) {
+        LightChunk* chunk = &grid->chunks[i];
+        if (!chunk->dirty) {
+            continue;
+        }
+        chunk->dirty = false;
+
+        // Levels are scaled to the full range of the texture, rows of the
+        // region are packed.
+        WDL_Ivec2 size = wdl_iv2(chunk->dirty_max.x - chunk->dirty_min.x, chunk->dirty_max.y - chunk->dirty_min.y);
+        WDL_Scratch scratch = wdl_scratch_begin(NULL, 0);
+        u8* region = wdl_arena_push_no_zero(scratch.arena, size.x * size.y);
+        for (i32 y = 0; y < size.y; y++) {
+            const u8* row = &grid->levels[chunk->dirty_min.x + (chunk->dirty_min.y + y) * grid->size.x];
+            for (i32 x = 0; x < size.x; x++) {
+                region[x + y * size.x] = row[x] * 255 / LIGHT_MAX_LEVEL;
+            }
+        }
+        gfx_texture_subdata(grid->texture, (GfxTextureSubDataDesc) {
+                .data = region,
+                .size = size,
+                .pos = chunk->dirty_min,
+                .format = GFX_TEXTURE_FORMAT_R_U8,
+                .alignment = 1,
+            });
+        wdl_scratch_end(scratch);
+    }
+}
+
+GfxTexture light_get_texture(const LightGrid* grid) {
+    return grid->texture;
+}
@@ -1,9 +1,12 @@
 #include "engine.h"
 #include "engine/assman.h"
+#include "engine/capture.h"
 #include "engine/font.h"
 #include "engine/graphics.h"
+#include "engine/ui.h"
 #include "waddle.h"
 #include "tile.h"
+#include "light.h"
 
 typedef enum EntityType {
     ENTITY_NULL,
@@ -20,7 +23,10 @@ struct Entity {
 
     // Rendering
     b8 renderable;
-    GfxTexture texture;
+    Sprite sprite;
+    // Animator instance, drawn instead of the sprite.
+    b8 animated;
+    u32 animation;
     Color color;
 
     // Physics
@@ -40,7 +46,7 @@ const Entity ENTITY_DEFAULT = {
     .pivot = {0.0f, 0.0f},
 
     .renderable = false,
-    .texture = GFX_TEXTURE_NULL,
+    .sprite = {.sheet = GFX_TEXTURE_NULL},
     .color = COLOR_WHITE,
 
     .vel = {0.0f, 0.0f},
@@ -79,6 +85,19 @@ struct Game {
     Camera cam;
     EntityWorld ent_world;
     TileType tile_world[64 * 64];
+    // Autotiled copy of 'tile_world', only the tiles that change are
+    // re-uploaded.
+    Tilemap* tilemap;
+    // Parallel to 'tile_world'.
+    LightGrid* light;
+    // Placed with L, the player's torch never replaces them.
+    b8 lamps[64 * 64];
+    WDL_Ivec2 torch;
+    // Only redrawn when the FPS counter updates.
+    CachedLayer* hud;
+    UI* ui;
+    Animator* animator;
+    ParticleSystem* sparks;
 };
 
 static Game game;
@@ -103,6 +122,91 @@ void entity_kill(Entity* ent) {
     wdl_sll_stack_push(world->free_list, ent);
 }
 
+// Tilemap index 0 is empty, so every neighbor combination of
+// 'TILE_NEIGHBOR_SPRITE_LOOKUP' is offset by one.
+static void tile_refresh(i32 x, i32 y) {
+    if (x < 0 || x >= 64 || y < 0 || y >= 64) {
+        return;
+    }
+
+    TileType type = game.tile_world[x + y * 64];
+    if (type == TILE_NONE) {
+        tilemap_set(game.tilemap, x, y, 0);
+        return;
+    }
+
+    TileNeighbor neighbor_index = 0;
+    for (i32 ny = -1; ny < 2; ny++) {
+        if (y + ny < 0 || y + ny >= 64) {
+            continue;
+        }
+        for (i32 nx = -1; nx < 2; nx++) {
+            if (x + nx < 0 || x + nx >= 64) {
+                continue;
+            }
+
+            if (game.tile_world[(x + nx) + (y + ny) * 64] == TILE_NONE) {
+                continue;
+            }
+            neighbor_index |= TILE_NEIGHBOR_GRID[(nx + 1) + (ny + 1) * 3];
+        }
+    }
+
+    tilemap_set(game.tilemap, x, y, neighbor_index + 1);
+}
+
+#define LAMP_LEVEL LIGHT_MAX_LEVEL
+#define TORCH_LEVEL 12
+
+// Source level of a tile without the torch.
+static u8 light_base_level(i32 x, i32 y) {
+    if (x < 0 || x >= 64 || y < 0 || y >= 64) {
+        return 0;
+    }
+    return game.lamps[x + y * 64] ? LAMP_LEVEL : 0;
+}
+
+static void torch_move(WDL_Ivec2 pos) {
+    if (pos.x == game.torch.x && pos.y == game.torch.y) {
+        return;
+    }
+    light_set_source(game.light, game.torch.x, game.torch.y, light_base_level(game.torch.x, game.torch.y));
+    game.torch = pos;
+    if (light_base_level(pos.x, pos.y) == 0) {
+        light_set_source(game.light, pos.x, pos.y, TORCH_LEVEL);
+    }
+}
+
+static void lamp_toggle(i32 x, i32 y) {
+    if (x < 0 || x >= 64 || y < 0 || y >= 64) {
+        return;
+    }
+    b8* lamp = &game.lamps[x + y * 64];
+    *lamp = !*lamp;
+    u8 level = light_base_level(x, y);
+    if (level == 0 && x == game.torch.x && y == game.torch.y) {
+        level = TORCH_LEVEL;
+    }
+    light_set_source(game.light, x, y, level);
+}
+
+static void tile_set(i32 x, i32 y, TileType type) {
+    if (x < 0 || x >= 64 || y < 0 || y >= 64) {
+        return;
+    }
+    if (game.tile_world[x + y * 64] == type) {
+        return;
+    }
+
+    game.tile_world[x + y * 64] = type;
+    light_set_solid(game.light, x, y, type != TILE_NONE);
+    for (i32 ny = -1; ny < 2; ny++) {
+        for (i32 nx = -1; nx < 2; nx++) {
+            tile_refresh(x + nx, y + ny);
+        }
+    }
+}
+
 // void func(Entity* ent)
 #define iter_alive_entities for (Entity* ent = game.ent_world.alive.first; ent != NULL; ent = ent->next)
 
@@ -129,6 +233,32 @@ void app_startup(void) {
     asset_load_font(wdl_str_lit("spline-sans"), wdl_str_lit("assets/fonts/Spline_Sans/static/SplineSans-Regular.ttf"));
     asset_load_font(wdl_str_lit("roboto"), wdl_str_lit("assets/fonts/Roboto/Roboto-Regular.ttf"));
 
+    // Tiles
+    // Tile (x, y) is centered on (x, y).
+    game.tilemap = tilemap_new(get_presistent_arena(), (TilemapDesc) {
+            .size = wdl_iv2(64, 64),
+            .origin = wdl_v2s(-0.5f),
+            .sheet = asset_get_texture(wdl_str_lit("tile404")),
+            .tiles = TILE_NEIGHBOR_SPRITE_LOOKUP,
+            .tile_count = COUNT,
+        });
+    game.light = light_grid_new(get_presistent_arena(), wdl_iv2(64, 64));
+    game.torch = wdl_iv2(-1, -1);
+
+    game.hud = cached_layer_new(get_presistent_arena());
+    game.ui = ui_new(get_presistent_arena(), asset_get_font(wdl_str_lit("tiny5")));
+    game.animator = animator_new(get_presistent_arena(), 1024);
+    ui_style(game.ui)->font_size = 32;
+    game.sparks = particle_system_new(get_presistent_arena(), (ParticleSystemDesc) {
+            .capacity = 1 << 17,
+            .color_start = color_rgba_f(1.0f, 0.8f, 0.3f, 1.0f),
+            .color_end = COLOR_TRANSPARENT,
+            .size_start = 0.2f,
+            .size_end = 0.05f,
+            .gravity = wdl_v2(0.0f, -20.0f),
+            .drag = 0.5f,
+        });
+
     // Player
     Entity* player = entity_spawn();
     *player = (Entity) {
@@ -140,12 +270,22 @@ void app_startup(void) {
         .pivot = wdl_v2(0.0f, 0.0f),
 
         .renderable = true,
-        .texture = asset_get_texture(wdl_str_lit("player")),
+        .sprite = sprite_trim(sprite_from_texture(asset_get_texture(wdl_str_lit("player")))),
         .color = COLOR_WHITE,
     };
 
     // Entity* enemy = entity_spawn();
     // enemy->renderable = true;
+
+    Animation* character = asset_load_animation(wdl_str_lit("test_character"), wdl_str_lit("assets/textures/test_character.json"), GFX_TEXTURE_SAMPLER_NEAREST);
+    if (character != NULL) {
+        Entity* npc = entity_spawn();
+        npc->pos = wdl_v2(4.0f, 0.0f);
+        npc->size = wdl_v2(2.0f, 2.0f);
+        npc->renderable = true;
+        npc->animated = true;
+        npc->animation = animator_add(game.animator, character, animation_find_tag(character, wdl_str_lit("Wave")));
+    }
 }
 
 #define sign(V) ((V) > 0 ? 1 : (V) < 0 ? -1 : 0)
@@ -166,11 +306,13 @@ void app_update(void) {
     static u32 fps = 0;
     static u32 last_fps = 0;
     fps_timer += game.dt;
+    animator_update(game.animator, game.dt);
     fps++;
     if (fps_timer >= 1.0f) {
         last_fps = fps;
         fps = 0;
         fps_timer = 0.0f;
+        cached_layer_mark_dirty(game.hud);
     }
 
     // Player controller
@@ -243,6 +385,9 @@ void app_update(void) {
             ent->grounded = true;
         }
 
+        // The torch is held at chest height.
+        torch_move(wdl_iv2(roundf(ent->pos.x), roundf(ent->pos.y + 1.0f)));
+
         // Camera follow
         game.cam.pos.x = lerp(game.cam.pos.x, ent->pos.x, game.dt * 4.0f);
         game.cam.pos.y = lerp(game.cam.pos.y, ent->pos.y, game.dt * 4.0f);
@@ -250,6 +395,39 @@ void app_update(void) {
     }
 
 
+    // Sparks, hold P to spray a lot more from the cursor.
+    // Clamped so a long hitch doesn't dump seconds worth of particles at once.
+    f32 spark_dt = wdl_clamp(game.dt, 0.0f, 0.1f);
+    static f32 spark_timer = 0.0f;
+    spark_timer += spark_dt;
+    const f32 spark_rate = 2000.0f;
+    u32 spark_count = spark_timer * spark_rate;
+    spark_timer -= spark_count / spark_rate;
+    particle_emit(game.sparks, (ParticleEmitDesc) {
+            .count = spark_count,
+            .pos = wdl_v2(-6.0f, 0.0f),
+            .radius = 0.25f,
+            .angle = 1.5707963f,
+            .spread = 0.6f,
+            .speed_min = 10.0f,
+            .speed_max = 20.0f,
+            .lifetime_min = 1.0f,
+            .lifetime_max = 2.0f,
+        });
+    if (key_down(KEY_P)) {
+        particle_emit(game.sparks, (ParticleEmitDesc) {
+                .count = 60000.0f * spark_dt,
+                .pos = screen_to_world_space(mouse_pos(), game.cam),
+                .radius = 0.5f,
+                .spread = 6.2831853f,
+                .speed_min = 2.0f,
+                .speed_max = 15.0f,
+                .lifetime_min = 1.0f,
+                .lifetime_max = 3.0f,
+            });
+    }
+    particle_system_update(game.sparks, game.dt);
+
     if (key_down(KEY_DOWN)) {
         game.cam.zoom += 100.0f * game.dt;
     }
@@ -257,52 +435,55 @@ void app_update(void) {
         game.cam.zoom -= 100.0f * game.dt;
     }
 
+    if (key_pressed(KEY_F12)) {
+        capture_screenshot(wdl_str_lit("screenshot.png"), CAPTURE_FORMAT_PNG);
+    }
+    if (key_pressed(KEY_F11)) {
+        if (capture_is_recording()) {
+            capture_stop();
+            wdl_info("Capture stopped, %u frames dropped.", capture_get_dropped_frames());
+        } else {
+            capture_start(wdl_str_lit("captures"), CAPTURE_FORMAT_PNG);
+        }
+    }
+
     // Rendering
+    light_upload(game.light);
+    renderer_begin_scaled(renderer);
     renderer_begin(renderer, game.cam);
+    // Texel (x, y) lights tile (x, y), same as the tilemap.
+    renderer_set_lightmap(renderer, (RendererLightmap) {
+            .texture = light_get_texture(game.light),
+            .origin = wdl_v2s(-0.5f),
+            .ambient = 0.2f,
+        });
 
     gfx_clear(COLOR_BLACK);
 
     f32 aspect = (f32) game.cam.screen_size.x / (f32) game.cam.screen_size.y;
     WDL_Vec2 full_screen_quad_size = wdl_v2(aspect * game.cam.zoom, game.cam.zoom);
+    renderer_set_layer(renderer, RENDER_LAYER_BACKGROUND);
     renderer_draw_quad_textured(renderer, wdl_v2s(0.0f), game.cam.pos, full_screen_quad_size, 0.0, COLOR_WHITE, asset_get_texture(wdl_str_lit("sky")));
 
     // Tiles
-    for (i32 y = 0; y < 64; y++) {
-        for (i32 x = 0; x < 64; x++) {
-            TileType type = game.tile_world[x + y * 64];
-            if (type == TILE_NONE) {
-                continue;
-            }
-
-            TileNeighbor neighbor_index = 0;
-            for (i32 ny = -1; ny < 2; ny++) {
-                if (y + ny < 0 || y + ny >= 64) {
-                    continue;
-                }
-                for (i32 nx = -1; nx < 2; nx++) {
-                    if (x + nx < 0 || x + nx >= 64) {
-                        continue;
-                    }
-
-                    if (game.tile_world[(x + nx) + (y + ny) * 64] == TILE_NONE) {
-                        continue;
-                    }
-                    neighbor_index |= TILE_NEIGHBOR_GRID[(nx + 1) + (ny + 1) * 3];
-                }
-            }
-
-            Sprite sprite = TILE_NEIGHBOR_SPRITE_LOOKUP[neighbor_index];
-            sprite.sheet = asset_get_texture(wdl_str_lit("tile404"));
-            renderer_draw_sprite(renderer, wdl_v2s(0.0f), wdl_v2(x, y), wdl_v2s(1.0), 0.0, COLOR_WHITE, sprite);
-        }
-    }
+    renderer_set_layer(renderer, RENDER_LAYER_TILES);
+    renderer_draw_tilemap(renderer, game.tilemap);
 
     Font* font = asset_get_font(wdl_str_lit("tiny5"));
+    renderer_set_layer(renderer, RENDER_LAYER_ENTITIES);
     iter_alive_entities {
         if (!ent->renderable) {
             continue;
         }
-        renderer_draw_quad_textured(renderer, ent->pivot, ent->pos, ent->size, ent->rot, ent->color, ent->texture);
+        if (ent->animated) {
+            WDL_Vec2 uvs[2];
+            animator_get_uvs(game.animator, ent->animation, uvs);
+            renderer_draw_quad_textured_uvs(renderer, ent->pivot, ent->pos, ent->size, ent->rot, ent->color, animator_get_texture(game.animator, ent->animation), uvs);
+        } else if (gfx_texture_is_null(ent->sprite.sheet)) {
+            renderer_draw_quad(renderer, ent->pivot, ent->pos, ent->size, ent->rot, ent->color);
+        } else {
+            renderer_draw_sprite(renderer, ent->pivot, ent->pos, ent->size, ent->rot, ent->color, ent->sprite);
+        }
 
         if (ent->type == ENTITY_PLAYER) {
             WDL_Vec2 pos = ent->pos;
@@ -312,6 +493,7 @@ void app_update(void) {
             renderer_draw_text(renderer, wdl_str_lit("Player"), font, wdl_v2(0.0f, -1.0f), pos, COLOR_WHITE);
         }
     };
+    renderer_draw_particles(renderer, game.sparks);
 
     WDL_Vec2 pos = screen_to_world_space(mouse_pos(), game.cam);
     pos.x = roundf(pos.x);
@@ -320,29 +502,34 @@ void app_update(void) {
 
     WDL_Ivec2 ipos = wdl_v2_to_iv2(pos);
     if (mouse_button_down(MOUSE_BUTTON_LEFT)) {
-        game.tile_world[ipos.x + ipos.y * 64] = TILE_404;
+        tile_set(ipos.x, ipos.y, TILE_404);
     }
     if (mouse_button_down(MOUSE_BUTTON_RIGHT)) {
-        game.tile_world[ipos.x + ipos.y * 64] = TILE_NONE;
+        tile_set(ipos.x, ipos.y, TILE_NONE);
+    }
+    if (key_pressed(KEY_L)) {
+        lamp_toggle(ipos.x, ipos.y);
     }
 
     renderer_end(renderer);
+    RendererStats world_stats = renderer_get_stats(renderer);
+    renderer_end_scaled(renderer);
 
     // UI
-    Camera ui_cam = {
-        .pos = wdl_v2(get_screen_size().x / 2.0f, get_screen_size().y / 2.0f),
-        .zoom = get_screen_size().y,
-        .screen_size = get_screen_size(),
-        .invert_y = true,
-    };
-    renderer_begin(renderer, ui_cam);
-
-    font_set_size(font, 32);
-    FontMetrics metrics = font_get_metrics(font);
-    WDL_Str text = wdl_str_pushf(get_frame_arena(), "FPS: %u", last_fps);
-    renderer_draw_text(renderer, text, font, wdl_v2(-1.0f, -1.0f), wdl_v2(16.0f, get_screen_size().y - metrics.ascent - 16.0f), COLOR_WHITE);
+    if (cached_layer_begin(game.hud, get_screen_size())) {
+        ui_begin(game.ui, get_screen_size());
+        ui_panel_begin(game.ui, wdl_str_lit("hud"), wdl_v2s(16.0f), wdl_v2(420.0f, 0.0f));
+        ui_label(game.ui, wdl_str_pushf(get_frame_arena(), "FPS: %u", last_fps));
+        ui_label(game.ui, wdl_str_pushf(get_frame_arena(), "Culled: %u/%u", world_stats.culled_quads, world_stats.quads + world_stats.culled_quads));
+        RendererStats stats = renderer_get_frame_stats(renderer);
+        ui_label(game.ui, wdl_str_pushf(get_frame_arena(), "Draw calls: %u", stats.draw_calls));
+        ui_label(game.ui, wdl_str_pushf(get_frame_arena(), "Particles: %u", game.sparks->count));
+        ui_panel_end(game.ui);
+        ui_end(game.ui, renderer);
+        cached_layer_end(game.hud);
+    }
 
-    renderer_end(renderer);
+    renderer_draw_cached_layer(renderer, game.hud);
 }
 
 void app_shutdown(void) {
@@ -364,6 +551,12 @@ i32 main(void) {
                 .resizable = false,
                 .vsync = true,
             },
+            .renderer = {
+                .multi_draw = true,
+                .dynamic_resolution = {
+                    .enabled = true,
+                },
+            },
             .startup = app_startup,
             .update = app_update,
             .shutdown = app_shutdown,
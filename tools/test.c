@@ -1,10 +1,208 @@
 #include "engine.h"
+#include "engine/animation.h"
 #include "engine/assman.h"
 #include "engine/font.h"
 #include "engine/graphics.h"
+#include "engine/particles.h"
+#include "engine/utils.h"
+#include "light.h"
 #include "waddle.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+
+// -- Checks --
+//
+// CPU side checks, run once at startup before the text is drawn. Failures are
+// logged and make the tool exit with 1.
+//
+
+static u32 check_failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            wdl_error("Check failed: %s", #cond); \
+            check_failures++; \
+        } \
+    } while (0)
+
+// Few distinct keys spread over several bytes, so equal keys go through
+// multiple passes.
+static void test_radix_sort_stable(void) {
+    enum { COUNT = 1000 };
+    WDL_Scratch scratch = wdl_scratch_begin(NULL, 0);
+    SortItem* items = wdl_arena_push_no_zero(scratch.arena, COUNT * sizeof(SortItem));
+    SortItem* temp = wdl_arena_push_no_zero(scratch.arena, COUNT * sizeof(SortItem));
+    for (u32 i = 0; i < COUNT; i++) {
+        items[i] = (SortItem) {
+            .key = (u64) (i * 7 % 5) << 40 | (i % 3) << 8,
+            .index = i,
+        };
+    }
+
+    SortItem* sorted = radix_sort(items, temp, COUNT);
+    for (u32 i = 1; i < COUNT; i++) {
+        CHECK(sorted[i - 1].key <= sorted[i].key);
+        if (sorted[i - 1].key == sorted[i].key) {
+            CHECK(sorted[i - 1].index < sorted[i].index);
+        }
+    }
+    wdl_scratch_end(scratch);
+}
+
+// Written next to the working directory and removed again.
+static Animation* load_animation_source(WDL_Str name, const char* source) {
+    const char* path = "test_animation.json";
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        wdl_error("Failed to write %s.", path);
+        check_failures++;
+        return NULL;
+    }
+    fputs(source, fp);
+    fclose(fp);
+    Animation* animation = asset_load_animation(name, wdl_str_lit("test_animation.json"), GFX_TEXTURE_SAMPLER_NEAREST);
+    remove(path);
+    return animation;
+}
+
+static void test_aseprite_malformed(void) {
+    // Cut off in the middle of a frame.
+    CHECK(load_animation_source(wdl_str_lit("truncated"),
+                "{\"frames\": [{\"frame\": {\"x\": 0, \"y\": 0, \"w\": 16") == NULL);
+    // Frames but no image.
+    CHECK(load_animation_source(wdl_str_lit("no_image"),
+                "{\"frames\": [{\"frame\": {\"x\": 0, \"y\": 0, \"w\": 16, \"h\": 16}, \"duration\": 100}],"
+                " \"meta\": {}}") == NULL);
+    CHECK(load_animation_source(wdl_str_lit("not_json"), "frames") == NULL);
+}
+
+static void test_animator_update(void) {
+    // Powers of two so the timers stay exact.
+    f32 durations[3] = {0.125f, 0.125f, 0.125f};
+    WDL_Vec2 uvs[6] = {0};
+    AnimationTag tags[1] = {
+        {
+            .name = wdl_str_lit("pingpong"),
+            .from = 0,
+            .to = 2,
+            .direction = ANIMATION_DIRECTION_PINGPONG,
+        },
+    };
+    Animation animation = {
+        .frame_count = 3,
+        .uvs = uvs,
+        .durations = durations,
+        .tags = tags,
+        .tag_count = 1,
+    };
+
+    WDL_Scratch scratch = wdl_scratch_begin(NULL, 0);
+    Animator* animator = animator_new(scratch.arena, 2);
+    u32 forward = animator_add(animator, &animation, -1);
+    u32 pingpong = animator_add(animator, &animation, 0);
+
+    animator_update(animator, 0.0625f);
+    CHECK(animator_get_frame(animator, forward) == 0);
+    u32 expected_forward[] = {1, 2, 0, 1};
+    u32 expected_pingpong[] = {1, 2, 1, 0};
+    for (u32 i = 0; i < wdl_arrlen(expected_forward); i++) {
+        animator_update(animator, 0.125f);
+        CHECK(animator_get_frame(animator, forward) == expected_forward[i]);
+        CHECK(animator_get_frame(animator, pingpong) == expected_pingpong[i]);
+    }
+
+    // Paused instances stay on their frame.
+    animator_set_speed(animator, forward, 0.0f);
+    animator_update(animator, 0.125f);
+    CHECK(animator_get_frame(animator, forward) == 1);
+    wdl_scratch_end(scratch);
+}
+
+// Short lived particles between long lived ones, told apart by position.
+static void test_particle_compaction(void) {
+    WDL_Scratch scratch = wdl_scratch_begin(NULL, 0);
+    ParticleSystem* ps = particle_system_new(scratch.arena, (ParticleSystemDesc) {
+            .capacity = 16,
+        });
+    f32 lifetimes[4] = {1.0f, 0.25f, 1.0f, 0.25f};
+    for (u32 i = 0; i < wdl_arrlen(lifetimes); i++) {
+        particle_emit(ps, (ParticleEmitDesc) {
+                .count = 3,
+                .pos = wdl_v2(i, 0.0f),
+                .lifetime_min = lifetimes[i],
+                .lifetime_max = lifetimes[i],
+            });
+    }
+    CHECK(ps->count == 12);
+
+    particle_system_update(ps, 0.5f);
+    CHECK(ps->count == 6);
+    for (u32 i = 0; i < ps->count; i++) {
+        CHECK(ps->pos_x[i] == (i < 3 ? 0.0f : 2.0f));
+        CHECK(ps->life[i] < 1.0f);
+    }
+
+    particle_system_update(ps, 0.5f);
+    CHECK(ps->count == 0);
+    wdl_scratch_end(scratch);
+}
+
+#define LIGHT_TEST_SIZE wdl_iv2(40, 8)
+
+// Every tile of an empty grid holds the brightest source minus its distance.
+static b8 light_matches_sources(const LightGrid* grid, const WDL_Ivec2* sources, const u8* levels, u32 source_count) {
+    for (i32 y = 0; y < LIGHT_TEST_SIZE.y; y++) {
+        for (i32 x = 0; x < LIGHT_TEST_SIZE.x; x++) {
+            i32 expected = 0;
+            for (u32 i = 0; i < source_count; i++) {
+                i32 dist = abs(x - sources[i].x) + abs(y - sources[i].y);
+                i32 level = levels[i] - dist * LIGHT_FALLOFF_EMPTY;
+                expected = level > expected ? level : expected;
+            }
+            if (light_get(grid, x, y) != expected) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void test_light_add_remove(void) {
+    WDL_Scratch scratch = wdl_scratch_begin(NULL, 0);
+    LightGrid* grid = light_grid_new(scratch.arena, LIGHT_TEST_SIZE);
+    WDL_Ivec2 sources[2] = {wdl_iv2(5, 4), wdl_iv2(12, 4)};
+    u8 levels[2] = {LIGHT_MAX_LEVEL, 10};
+
+    light_set_source(grid, sources[0].x, sources[0].y, levels[0]);
+    light_set_source(grid, sources[1].x, sources[1].y, levels[1]);
+    CHECK(light_matches_sources(grid, sources, levels, 2));
+
+    // The light the first source spread over the second one has to go
+    // without taking the second one's light with it.
+    light_set_source(grid, sources[0].x, sources[0].y, 0);
+    CHECK(light_matches_sources(grid, &sources[1], &levels[1], 1));
+
+    light_set_source(grid, sources[1].x, sources[1].y, 0);
+    CHECK(light_matches_sources(grid, NULL, NULL, 0));
+
+    gfx_texture_destroy(light_get_texture(grid));
+    wdl_scratch_end(scratch);
+}
+
+static void run_checks(void) {
+    test_radix_sort_stable();
+    test_aseprite_malformed();
+    test_animator_update();
+    test_particle_compaction();
+    test_light_add_remove();
+    if (check_failures == 0) {
+        wdl_info("All checks passed.");
+    }
+}
+
 void startup(void) {
+    run_checks();
     asset_load_font(wdl_str_lit("roboto"), wdl_str_lit("assets/fonts/Roboto/Roboto-Regular.ttf"));
 }
 
@@ -31,7 +229,7 @@ void update(void) {
 void shutdown(void) {}
 
 i32 main(void) {
-    return engine_run((ApplicationDesc) {
+    i32 result = engine_run((ApplicationDesc) {
             .window = {
                 .size = wdl_iv2(800, 600),
                 .title = wdl_str_lit("Test Tool"),
@@ -42,4 +240,8 @@ i32 main(void) {
             .update = update,
             .shutdown = shutdown,
         });
+    if (result == 0 && check_failures > 0) {
+        result = 1;
+    }
+    return result;
 }